@@ -0,0 +1,222 @@
+// bench.cpp
+// Copyright (c) 2022, zhiayang
+// SPDX-License-Identifier: Apache-2.0
+
+// microbenchmarks for the key-processing path (handleInputEvent and everything under it), run
+// against a sink that just counts events and a focus provider that always returns the same window,
+// so this only measures our own code. `make bench` builds it; pass a substring to run only the
+// matching cases, and --iterations=N to change how many times each pattern is repeated.
+
+#include "slug.h"
+
+#include <time.h>
+
+#include <new>
+#include <vector>
+#include <algorithm>
+
+#include <linux/input.h>
+
+static uint64_t g_allocations = 0;
+
+void* operator new(size_t size)
+{
+	g_allocations++;
+	if(auto p = malloc(size == 0 ? 1 : size); p != nullptr)
+		return p;
+
+	abort();
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void* p) noexcept                  { free(p); }
+void operator delete[](void* p) noexcept                { free(p); }
+void operator delete(void* p, size_t) noexcept          { free(p); }
+void operator delete[](void* p, size_t) noexcept        { free(p); }
+
+static inline uint64_t monotonic_ns()
+{
+	struct timespec ts {};
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return static_cast<uint64_t>(ts.tv_sec) * 1'000'000'000 + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+struct CountingSink : slug::EventSink
+{
+	virtual void write(const struct input_event* events, size_t count) override
+	{
+		this->count += count;
+	}
+
+	uint64_t count = 0;
+};
+
+struct FixedFocus : slug::FocusProvider
+{
+	FixedFocus(std::string wm_class, std::string wm_name)
+	{
+		m_info.wm_class = std::move(wm_class);
+		m_info.wm_name = std::move(wm_name);
+		m_info.title_profiles = slug::matchWindowTitle(m_info.wm_name);
+	}
+
+	virtual const slug::WindowInfo& getCurrentWindowInfo() override
+	{
+		return m_info;
+	}
+
+private:
+	slug::WindowInfo m_info;
+};
+
+struct Pattern
+{
+	std::vector<struct input_event> events;
+
+	Pattern& key(slug::keycode_t code, slug::KeyAction action)
+	{
+		this->events.push_back({ .time = {}, .type = EV_KEY, .code = static_cast<uint16_t>(code), .value = static_cast<int>(action) });
+		this->events.push_back({ .time = {}, .type = EV_SYN, .code = SYN_REPORT, .value = 0 });
+		return *this;
+	}
+
+	Pattern& press(slug::keycode_t code)    { return this->key(code, slug::KeyAction::Press); }
+	Pattern& release(slug::keycode_t code)  { return this->key(code, slug::KeyAction::Release); }
+	Pattern& repeat(slug::keycode_t code)   { return this->key(code, slug::KeyAction::Repeat); }
+	Pattern& tap(slug::keycode_t code)      { return this->press(code).release(code); }
+};
+
+struct Case
+{
+	const char* name;
+	const char* wm_class;
+	const char* wm_name;
+	Pattern pattern;
+};
+
+static std::vector<Case> make_cases()
+{
+	std::vector<Case> cases;
+
+	cases.push_back({ "single-key forward", "xterm", "bash", Pattern().tap(KEY_X) });
+	cases.push_back({ "single-key remap", "xterm", "bash", Pattern().tap(KEY_LEFTMETA) });
+
+	{
+		auto p = Pattern().press(KEY_CAPSLOCK);
+		for(auto k : { KEY_D, KEY_D, KEY_D, KEY_S, KEY_A, KEY_W, KEY_SEMICOLON, KEY_APOSTROPHE, KEY_Q })
+			p.tap(k);
+
+		cases.push_back({ "capslock layer burst", "xterm", "bash", p.release(KEY_CAPSLOCK) });
+	}
+
+	cases.push_back({ "konsole combo", "konsole", "~ : bash",
+		Pattern().press(KEY_LEFTMETA).tap(KEY_T).tap(KEY_K).release(KEY_LEFTMETA) });
+
+	{
+		auto p = Pattern().press(KEY_J);
+		for(int i = 0; i < 64; i++)
+			p.repeat(KEY_J);
+
+		cases.push_back({ "autorepeat storm", "xterm", "bash", p.release(KEY_J) });
+	}
+
+	return cases;
+}
+
+static void run_case(const Case& c, size_t iterations)
+{
+	auto sink = CountingSink();
+	auto focus = FixedFocus(c.wm_class, c.wm_name);
+	auto uinput = slug::UInputDevice(&sink);
+
+	auto& events = c.pattern.events;
+	auto num_events = iterations * events.size();
+
+	// warm up, so the hash tables have their buckets already.
+	for(auto& ev : events)
+		slug::handleInputEvent(&uinput, &focus, ev);
+
+	// throughput: no timing inside the loop.
+	auto allocs_before = g_allocations;
+	auto output_before = sink.count;
+	auto start = monotonic_ns();
+
+	for(size_t i = 0; i < iterations; i++)
+	{
+		for(auto& ev : events)
+			slug::handleInputEvent(&uinput, &focus, ev);
+	}
+
+	auto elapsed = monotonic_ns() - start;
+	auto allocs = g_allocations - allocs_before;
+	auto output = sink.count - output_before;
+
+	// latency: time each event separately. this includes the clock_gettime overhead (so subtract
+	// the cost of an empty measurement), but it's the only way to see the tail.
+	std::vector<uint64_t> samples;
+	samples.reserve(num_events);
+
+	uint64_t overhead = UINT64_MAX;
+	for(int i = 0; i < 1000; i++)
+	{
+		auto a = monotonic_ns();
+		overhead = std::min(overhead, monotonic_ns() - a);
+	}
+
+	for(size_t i = 0; i < iterations; i++)
+	{
+		for(auto& ev : events)
+		{
+			auto a = monotonic_ns();
+			slug::handleInputEvent(&uinput, &focus, ev);
+			auto b = monotonic_ns();
+
+			samples.push_back(b - a > overhead ? b - a - overhead : 0);
+		}
+	}
+
+	std::sort(samples.begin(), samples.end());
+	auto pct = [&](double p) {
+		return samples[std::min(samples.size() - 1, static_cast<size_t>(p * static_cast<double>(samples.size())))];
+	};
+
+	auto per_event = static_cast<double>(elapsed) / static_cast<double>(num_events);
+	zpr::println("{-24} {9.2f} Mev/s {7.1f} ns/ev   p50 {5}  p99 {5}  p999 {5} ns   {.2f} allocs/ev   {.2f} out/in",
+		c.name, 1000.0 / per_event, per_event, pct(0.50), pct(0.99), pct(0.999),
+		static_cast<double>(allocs) / static_cast<double>(num_events),
+		static_cast<double>(output) / static_cast<double>(num_events));
+}
+
+int main(int argc, char** argv)
+{
+	size_t iterations = 20000;
+	std::string_view filter;
+
+	for(int i = 1; i < argc; i++)
+	{
+		auto arg = std::string_view(argv[i]);
+		if(arg.starts_with("--iterations="))
+		{
+			iterations = std::max(1ul, strtoul(arg.substr(13).data(), nullptr, 10));
+		}
+		else if(not arg.starts_with("-"))
+		{
+			filter = arg;
+		}
+		else
+		{
+			zpr::fprintln(stderr, "usage: {} [--iterations=N] [filter]", argv[0]);
+			exit(1);
+		}
+	}
+
+	for(auto& c : make_cases())
+	{
+		if(filter.empty() || std::string_view(c.name).find(filter) != std::string_view::npos)
+			run_case(c, iterations);
+	}
+}
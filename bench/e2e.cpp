@@ -0,0 +1,448 @@
+// e2e.cpp
+// Copyright (c) 2022, zhiayang
+// SPDX-License-Identifier: Apache-2.0
+
+// end-to-end latency: creates a virtual keyboard through /dev/uinput, starts xkeyslug on it, finds the
+// uinput device that xkeyslug creates in turn, and measures the time from writing an event into the
+// source keyboard to the kernel timestamp of the first key event that comes out the other side. this
+// covers both kernel hops and xkeyslug's wakeup, which the microbenchmarks (bench.cpp) don't.
+//
+// needs /dev/uinput and an X display (xkeyslug won't start without one; `xvfb-run` is enough). with
+// --focus-window, an X window pretending to be konsole is created and focused, so the window-dependent
+// rules can be measured too. arguments after `--` are passed on to xkeyslug.
+
+#include "slug.h"
+
+#include <time.h>
+#include <poll.h>
+#include <dirent.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <sys/ioctl.h>
+
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+
+#include <linux/input.h>
+#include <linux/uinput.h>
+
+static constexpr const char* DEVICE_NAME = "xkeyslug e2e source";
+
+static inline uint64_t monotonic_ns()
+{
+	struct timespec ts {};
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return static_cast<uint64_t>(ts.tv_sec) * 1'000'000'000 + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+static void sleep_us(uint64_t us)
+{
+	std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+static int create_source_keyboard()
+{
+	auto fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+	if(fd == -1)
+	{
+		zpr::fprintln(stderr, "failed to open /dev/uinput: {} ({})", strerror(errno), errno);
+		return -1;
+	}
+
+	ioctl(fd, UI_SET_EVBIT, EV_KEY);
+	for(int k = 1; k < KEY_MAX; k++)
+		ioctl(fd, UI_SET_KEYBIT, k);
+
+	uinput_setup setup {};
+	setup.id.bustype = BUS_VIRTUAL;
+	setup.id.vendor = 0x1209;
+	setup.id.product = 0x0002;
+	strncpy(setup.name, DEVICE_NAME, sizeof(setup.name) - 1);
+
+	if(ioctl(fd, UI_DEV_SETUP, &setup) != 0 || ioctl(fd, UI_DEV_CREATE) != 0)
+	{
+		zpr::fprintln(stderr, "failed to create uinput device: {} ({})", strerror(errno), errno);
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+// the eventN node under /sys/class/input/<dir>, if there is one.
+static std::string find_event_node(const std::string& dir)
+{
+	std::string ret;
+	if(auto d = opendir(dir.c_str()); d != nullptr)
+	{
+		while(auto ent = readdir(d))
+		{
+			if(strncmp(ent->d_name, "event", 5) == 0)
+				ret = ent->d_name;
+		}
+
+		closedir(d);
+	}
+
+	return ret;
+}
+
+static std::string source_event_node(int uinput_fd)
+{
+	char sysname[64] {};
+	if(ioctl(uinput_fd, UI_GET_SYSNAME(sizeof(sysname)), sysname) < 0)
+		return {};
+
+	for(int tries = 0; tries < 100; tries++)
+	{
+		if(auto node = find_event_node(zpr::sprint("/sys/devices/virtual/input/{}", sysname)); not node.empty())
+			return node;
+
+		sleep_us(20'000);
+	}
+
+	return {};
+}
+
+// xkeyslug's output device is created from ours, so it has the same name.
+static std::string find_output_node(const std::string& exclude, pid_t child)
+{
+	for(int tries = 0; tries < 250; tries++)
+	{
+		if(waitpid(child, nullptr, WNOHANG) == child)
+			return {};
+
+		if(auto dir = opendir("/sys/class/input"); dir != nullptr)
+		{
+			while(auto ent = readdir(dir))
+			{
+				if(strncmp(ent->d_name, "event", 5) != 0 || exclude == ent->d_name)
+					continue;
+
+				char name[256] {};
+				auto path = zpr::sprint("/sys/class/input/{}/device/name", ent->d_name);
+				if(auto fd = open(path.c_str(), O_RDONLY); fd != -1)
+				{
+					auto n = read(fd, name, sizeof(name) - 1);
+					close(fd);
+
+					if(n > 0 && std::string_view(name, static_cast<size_t>(n)).starts_with(DEVICE_NAME))
+					{
+						closedir(dir);
+						return ent->d_name;
+					}
+				}
+			}
+
+			closedir(dir);
+		}
+
+		sleep_us(20'000);
+	}
+
+	return {};
+}
+
+static Window create_focus_window(Display* x_display)
+{
+	auto root = DefaultRootWindow(x_display);
+	auto window = XCreateSimpleWindow(x_display, root, 0, 0, 200, 100, 0, 0, 0);
+
+	char res_name[] = "konsole";
+	char res_class[] = "konsole";
+	XClassHint hints { .res_name = res_name, .res_class = res_class };
+	XSetClassHint(x_display, window, &hints);
+	XStoreName(x_display, window, "~ : bash");
+
+	XMapWindow(x_display, window);
+	XSync(x_display, False);
+	sleep_us(100'000);
+
+	XSetInputFocus(x_display, window, RevertToParent, CurrentTime);
+	XSync(x_display, False);
+
+	return window;
+}
+
+struct Frame
+{
+	slug::keycode_t code;
+	int value;
+};
+
+struct Pattern
+{
+	const char* name;
+	bool needs_window;
+	std::vector<Frame> frames;
+};
+
+static std::vector<Pattern> make_patterns()
+{
+	std::vector<Pattern> ret;
+
+	auto tap = [](std::vector<Frame>& f, slug::keycode_t k) {
+		f.push_back({ k, 1 });
+		f.push_back({ k, 0 });
+	};
+
+	{
+		std::vector<Frame> f;
+		for(auto k : { KEY_T, KEY_H, KEY_E, KEY_SPACE, KEY_Q, KEY_U, KEY_I, KEY_C, KEY_K, KEY_SPACE, KEY_F, KEY_O, KEY_X })
+			tap(f, k);
+
+		ret.push_back({ "typing burst", false, std::move(f) });
+	}
+
+	{
+		std::vector<Frame> f { { KEY_LEFTALT, 1 } };
+		tap(f, KEY_LEFT);
+		tap(f, KEY_BACKSPACE);
+		f.push_back({ KEY_LEFTALT, 0 });
+
+		f.push_back({ KEY_CAPSLOCK, 1 });
+		tap(f, KEY_D);
+		tap(f, KEY_A);
+		f.push_back({ KEY_CAPSLOCK, 0 });
+
+		ret.push_back({ "chords", false, std::move(f) });
+	}
+
+	{
+		std::vector<Frame> f { { KEY_J, 1 } };
+		for(int i = 0; i < 30; i++)
+			f.push_back({ KEY_J, 2 });
+
+		f.push_back({ KEY_J, 0 });
+		ret.push_back({ "autorepeat", false, std::move(f) });
+	}
+
+	{
+		std::vector<Frame> f { { KEY_LEFTMETA, 1 } };
+		tap(f, KEY_T);
+		tap(f, KEY_K);
+		f.push_back({ KEY_LEFTMETA, 0 });
+
+		ret.push_back({ "konsole combo", true, std::move(f) });
+	}
+
+	return ret;
+}
+
+static bool inject(int fd, const Frame& frame)
+{
+	input_event evs[2] {};
+	evs[0].type = EV_KEY;
+	evs[0].code = static_cast<uint16_t>(frame.code);
+	evs[0].value = frame.value;
+	evs[1].type = EV_SYN;
+	evs[1].code = SYN_REPORT;
+
+	return write(fd, evs, sizeof(evs)) == sizeof(evs);
+}
+
+static void drain(int fd)
+{
+	input_event ev {};
+	while(read(fd, &ev, sizeof(ev)) == sizeof(ev))
+		;
+}
+
+// wait for the first key event (and the rest of its frame); returns its timestamp, or 0 on timeout.
+static uint64_t wait_for_key(int fd, int timeout_ms)
+{
+	uint64_t ret = 0;
+	pollfd pfd { .fd = fd, .events = POLLIN, .revents = 0 };
+	while(poll(&pfd, 1, timeout_ms) > 0)
+	{
+		input_event ev {};
+		while(read(fd, &ev, sizeof(ev)) == sizeof(ev))
+		{
+			if(ev.type == EV_KEY && ret == 0)
+			{
+				ret = static_cast<uint64_t>(ev.input_event_sec) * 1'000'000'000
+					+ static_cast<uint64_t>(ev.input_event_usec) * 1000;
+			}
+			else if(ev.type == EV_SYN && ev.code == SYN_REPORT && ret != 0)
+			{
+				return ret;
+			}
+		}
+	}
+
+	return ret;
+}
+
+static void report(const char* name, std::vector<uint64_t>& samples, size_t missed)
+{
+	if(samples.empty())
+	{
+		zpr::println("{-16} no samples ({} missed)", name, missed);
+		return;
+	}
+
+	std::sort(samples.begin(), samples.end());
+	auto pct = [&](double p) {
+		auto ns = samples[std::min(samples.size() - 1, static_cast<size_t>(p * static_cast<double>(samples.size())))];
+		return static_cast<double>(ns) / 1000.0;
+	};
+
+	zpr::println("{-16} n={-6} p50 {6.1f}  p99 {6.1f}  p999 {6.1f}  max {7.1f} us   ({} missed)", name, samples.size(),
+		pct(0.50), pct(0.99), pct(0.999), static_cast<double>(samples.back()) / 1000.0, missed);
+}
+
+static void usage(const char* argv0)
+{
+	zpr::fprintln(stderr, "usage: {} [--xkeyslug=<path>] [--iterations=N] [--gap-us=N] [--focus-window] [-- <xkeyslug args>]", argv0);
+	exit(1);
+}
+
+int main(int argc, char** argv)
+{
+	const char* xkeyslug = "build/xkeyslug";
+	size_t iterations = 200;
+	uint64_t gap_us = 2000;
+	bool focus_window = false;
+	std::vector<std::string> child_args;
+
+	for(int i = 1; i < argc; i++)
+	{
+		auto arg = std::string_view(argv[i]);
+		if(arg == "--")
+		{
+			for(i++; i < argc; i++)
+				child_args.push_back(argv[i]);
+		}
+		else if(arg.starts_with("--xkeyslug="))
+		{
+			xkeyslug = argv[i] + 11;
+		}
+		else if(arg.starts_with("--iterations="))
+		{
+			iterations = std::max(1ul, strtoul(arg.substr(13).data(), nullptr, 10));
+		}
+		else if(arg.starts_with("--gap-us="))
+		{
+			gap_us = strtoul(arg.substr(9).data(), nullptr, 10);
+		}
+		else if(arg == "--focus-window")
+		{
+			focus_window = true;
+		}
+		else
+		{
+			usage(argv[0]);
+		}
+	}
+
+	Display* x_display = nullptr;
+	if(focus_window)
+	{
+		x_display = XOpenDisplay(0);
+		if(x_display == nullptr)
+		{
+			zpr::fprintln(stderr, "could not open display '{}'", XDisplayName(0));
+			return 1;
+		}
+
+		create_focus_window(x_display);
+	}
+
+	auto source_fd = create_source_keyboard();
+	if(source_fd == -1)
+		return 1;
+
+	auto source_node = source_event_node(source_fd);
+	if(source_node.empty())
+	{
+		zpr::fprintln(stderr, "could not find the evdev node for the source keyboard");
+		return 1;
+	}
+
+	auto device_arg = zpr::sprint("--device=/dev/input/{}", source_node);
+
+	std::vector<char*> exec_args { const_cast<char*>(xkeyslug), device_arg.data() };
+	for(auto& a : child_args)
+		exec_args.push_back(a.data());
+
+	exec_args.push_back(nullptr);
+
+	auto child = fork();
+	if(child == 0)
+	{
+		// keep our output readable.
+		if(auto null = open("/dev/null", O_WRONLY); null != -1)
+			dup2(null, STDOUT_FILENO);
+
+		execv(xkeyslug, exec_args.data());
+		zpr::fprintln(stderr, "failed to run '{}': {} ({})", xkeyslug, strerror(errno), errno);
+		_exit(1);
+	}
+
+	auto output_node = find_output_node(source_node, child);
+	auto output_fd = output_node.empty() ? -1 : open(zpr::sprint("/dev/input/{}", output_node).c_str(), O_RDONLY | O_NONBLOCK);
+	if(output_fd == -1)
+	{
+		zpr::fprintln(stderr, "xkeyslug did not create an output device");
+		kill(child, SIGTERM);
+		waitpid(child, nullptr, 0);
+		return 1;
+	}
+
+	int clock = CLOCK_MONOTONIC;
+	ioctl(output_fd, EVIOCSCLOCKID, &clock);
+
+	zpr::println("source /dev/input/{}, xkeyslug output /dev/input/{}, {}us between frames", source_node, output_node, gap_us);
+
+	for(auto& pattern : make_patterns())
+	{
+		if(pattern.needs_window && not focus_window)
+			continue;
+
+		std::vector<uint64_t> samples;
+		samples.reserve(iterations * pattern.frames.size());
+
+		size_t missed = 0;
+		for(size_t i = 0; i < iterations; i++)
+		{
+			for(auto& frame : pattern.frames)
+			{
+				drain(output_fd);
+
+				auto sent = monotonic_ns();
+				if(not inject(source_fd, frame))
+				{
+					zpr::fprintln(stderr, "failed to write to the source keyboard: {} ({})", strerror(errno), errno);
+					break;
+				}
+
+				if(auto received = wait_for_key(output_fd, 100); received == 0)
+					missed++;
+				else
+					samples.push_back(received > sent ? received - sent : 0);
+
+				sleep_us(gap_us);
+			}
+		}
+
+		report(pattern.name, samples, missed);
+	}
+
+	// xkeyslug only checks for the signal between events, so give it one.
+	kill(child, SIGTERM);
+	inject(source_fd, { KEY_F24, 1 });
+	inject(source_fd, { KEY_F24, 0 });
+	waitpid(child, nullptr, 0);
+
+	close(output_fd);
+	ioctl(source_fd, UI_DEV_DESTROY);
+	close(source_fd);
+
+	if(x_display != nullptr)
+		XCloseDisplay(x_display);
+}
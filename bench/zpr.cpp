@@ -0,0 +1,603 @@
+// zpr.cpp
+// Copyright (c) 2022, zhiayang
+// SPDX-License-Identifier: Apache-2.0
+
+// benchmarks for zpr's integer and float formatting, against the implementations it replaced
+// (zpr_legacy.h), snprintf and std::to_chars. each case formats the same set of values into a stack
+// buffer, and is also checked against a reference: the mismatch count is printed next to the timing.
+// `make bench-zpr` builds and runs it; pass a substring to run only the matching cases, and
+// --iterations=N to change how many times each set of values is formatted.
+
+#include "zpr.h"
+#include "zpr_legacy.h"
+
+#include <time.h>
+#include <math.h>
+#include <limits.h>
+
+#include <random>
+#include <string>
+#include <vector>
+#include <charconv>
+#include <functional>
+#include <string_view>
+
+#if __has_include(<format>)
+	#include <format>
+#endif
+
+using namespace zpr::literals;
+
+static inline uint64_t monotonic_ns()
+{
+	struct timespec ts {};
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return static_cast<uint64_t>(ts.tv_sec) * 1'000'000'000 + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+// formats one value into `buf` (at least 512 bytes) and returns the length.
+using FormatFn = std::function<size_t (char* buf, size_t idx)>;
+
+struct Case
+{
+	std::string name;
+	FormatFn format;
+	FormatFn reference;     // may be empty
+};
+
+static void run_case(const Case& c, size_t num_values, size_t iterations)
+{
+	char buf[512];
+	char ref[512];
+
+	size_t mismatches = 0;
+	std::string first_mismatch;
+
+	if(c.reference)
+	{
+		for(size_t i = 0; i < num_values; i++)
+		{
+			auto n = c.format(buf, i);
+			auto m = c.reference(ref, i);
+			if(std::string_view(buf, n) == std::string_view(ref, m))
+				continue;
+
+			if(mismatches++ == 0)
+				first_mismatch = zpr::sprint("'{}' vs '{}'", std::string_view(buf, n), std::string_view(ref, m));
+		}
+	}
+
+	// the sum keeps the compiler from throwing the formatting away.
+	size_t total = 0;
+	auto start = monotonic_ns();
+
+	for(size_t k = 0; k < iterations; k++)
+	{
+		for(size_t i = 0; i < num_values; i++)
+			total += c.format(buf, i);
+	}
+
+	auto elapsed = monotonic_ns() - start;
+	auto per_value = static_cast<double>(elapsed) / static_cast<double>(iterations * num_values);
+
+	if(not c.reference)
+		zpr::println("{-40} {7.1f} ns   ({} bytes)", c.name, per_value, total);
+	else if(mismatches == 0)
+		zpr::println("{-40} {7.1f} ns   ok", c.name, per_value);
+	else
+		zpr::println("{-40} {7.1f} ns   {} mismatches, eg. {}", c.name, per_value, mismatches, first_mismatch);
+}
+
+static size_t to_chars_shortest(char* buf, double value)
+{
+	return static_cast<size_t>(std::to_chars(buf, buf + 512, value).ptr - buf);
+}
+
+static size_t to_chars_fixed(char* buf, double value, int prec)
+{
+	return static_cast<size_t>(std::to_chars(buf, buf + 512, value, std::chars_format::fixed, prec).ptr - buf);
+}
+
+static std::vector<Case> float_cases(const std::vector<double>& values, const char* set)
+{
+	std::vector<Case> cases;
+	auto v = [&values](size_t i) { return values[i]; };
+
+	auto add = [&](const char* what, FormatFn format, FormatFn reference = {}) {
+		cases.push_back({ zpr::sprint("{} {}", set, what), std::move(format), std::move(reference) });
+	};
+
+	auto shortest_ref = [v](char* buf, size_t i) { return to_chars_shortest(buf, v(i)); };
+	auto fixed3_ref = [v](char* buf, size_t i) { return static_cast<size_t>(snprintf(buf, 512, "%.3f", v(i))); };
+	auto fixed6_ref = [v](char* buf, size_t i) { return static_cast<size_t>(snprintf(buf, 512, "%f", v(i))); };
+	auto exp_ref = [v](char* buf, size_t i) { return static_cast<size_t>(snprintf(buf, 512, "%e", v(i))); };
+
+	// '{}': shortest round-trip, which the old code didn't do (it was '%g').
+	add("{} zpr", [v](char* buf, size_t i) { return zpr::sprint(512, buf, "{}"_fmt, v(i)); }, shortest_ref);
+	add("{} zpr (old)", [v](char* buf, size_t i) { return zpr::sprint(512, buf, "{}"_fmt, legacy_float { v(i) }); });
+	add("{} to_chars", shortest_ref);
+	add("%g snprintf", [v](char* buf, size_t i) { return static_cast<size_t>(snprintf(buf, 512, "%g", v(i))); });
+
+	add("{.3f} zpr", [v](char* buf, size_t i) { return zpr::sprint(512, buf, "{.3f}"_fmt, v(i)); }, fixed3_ref);
+	add("{.3f} zpr (old)", [v](char* buf, size_t i) { return zpr::sprint(512, buf, "{.3f}"_fmt, legacy_float { v(i) }); }, fixed3_ref);
+	add("{.3f} to_chars", [v](char* buf, size_t i) { return to_chars_fixed(buf, v(i), 3); }, fixed3_ref);
+	add("%.3f snprintf", fixed3_ref);
+
+	add("{f} zpr", [v](char* buf, size_t i) { return zpr::sprint(512, buf, "{f}"_fmt, v(i)); }, fixed6_ref);
+	add("{f} zpr (old)", [v](char* buf, size_t i) { return zpr::sprint(512, buf, "{f}"_fmt, legacy_float { v(i) }); }, fixed6_ref);
+	add("{f} to_chars", [v](char* buf, size_t i) { return to_chars_fixed(buf, v(i), 6); }, fixed6_ref);
+
+	add("{e} zpr", [v](char* buf, size_t i) { return zpr::sprint(512, buf, "{e}"_fmt, v(i)); }, exp_ref);
+	add("{e} zpr (old)", [v](char* buf, size_t i) { return zpr::sprint(512, buf, "{e}"_fmt, legacy_float { v(i) }); }, exp_ref);
+
+	return cases;
+}
+
+static std::vector<Case> int_cases(const std::vector<uint64_t>& values, const char* set)
+{
+	using zpr::detail::decimal_table;
+
+	std::vector<Case> cases;
+	auto v = [&values](size_t i) { return values[i]; };
+
+	auto add = [&](const char* what, FormatFn format, FormatFn reference = {}) {
+		cases.push_back({ zpr::sprint("{} {}", set, what), std::move(format), std::move(reference) });
+	};
+
+	auto ref = [v](char* buf, size_t i) { return static_cast<size_t>(snprintf(buf, 512, "%lu", v(i))); };
+
+	// the digits alone. print_decimal_integer writes into the end of a buffer, so those get copied to the front.
+	add("digits (old)", [v](char* buf, size_t i) {
+		char tmp[24];
+		auto p = zpr::detail::legacy::print_decimal_integer(tmp, sizeof(tmp), v(i));
+		memcpy(buf, p, static_cast<size_t>(tmp + sizeof(tmp) - p));
+		return static_cast<size_t>(tmp + sizeof(tmp) - p);
+	}, ref);
+
+	add("digits", [v](char* buf, size_t i) {
+		char tmp[24];
+		auto p = zpr::detail::print_decimal_integer(tmp, sizeof(tmp), v(i));
+		memcpy(buf, p, static_cast<size_t>(tmp + sizeof(tmp) - p));
+		return static_cast<size_t>(tmp + sizeof(tmp) - p);
+	}, ref);
+
+	auto in_place = [v]<decimal_table _Table>(char* buf, size_t i) {
+		auto n = zpr::detail::count_decimal_digits(v(i));
+		zpr::detail::write_decimal<_Table>(buf, v(i), n);
+		return n;
+	};
+
+	add("digits in place, no table", [in_place](char* buf, size_t i) {
+		return in_place.template operator()<decimal_table::none>(buf, i);
+	}, ref);
+
+	add("digits in place, pairs", [in_place](char* buf, size_t i) {
+		return in_place.template operator()<decimal_table::pairs>(buf, i);
+	}, ref);
+
+	add("digits in place, quads", [in_place](char* buf, size_t i) {
+		return in_place.template operator()<decimal_table::quads>(buf, i);
+	}, ref);
+
+	add("to_chars", [v](char* buf, size_t i) { return static_cast<size_t>(std::to_chars(buf, buf + 512, v(i)).ptr - buf); }, ref);
+
+	// and through the formatter.
+	add("{} zpr", [v](char* buf, size_t i) { return zpr::sprint(512, buf, "{}"_fmt, v(i)); }, ref);
+	add("%lu snprintf", ref);
+
+	return cases;
+}
+
+struct LogLine
+{
+	uint64_t timestamp;
+	const char* rule;
+	double latency;
+	uint32_t code;
+};
+
+struct CountingCallback
+{
+	void operator() (const char* str, size_t len) { this->len += len; (void) str; }
+	size_t len = 0;
+};
+
+static std::vector<Case> misc_cases(const std::vector<uint64_t>& ints, const std::vector<LogLine>& lines,
+	const std::vector<std::vector<int>>& vectors)
+{
+	std::vector<Case> cases;
+	auto n = [&ints](size_t i) { return ints[i]; };
+	auto line = [&lines](size_t i) -> const LogLine& { return lines[i]; };
+	auto snp = [](char* buf, const char* fmt, auto... xs) { return static_cast<size_t>(snprintf(buf, 512, fmt, xs...)); };
+
+	auto add = [&](const char* what, FormatFn format, FormatFn reference = {}) {
+		cases.push_back({ what, std::move(format), std::move(reference) });
+	};
+
+	// hex, and strings with padding.
+	add("hex {x} zpr", [n](char* buf, size_t i) { return zpr::sprint(512, buf, "{x}"_fmt, n(i)); },
+		[n, snp](char* buf, size_t i) { return snp(buf, "%lx", n(i)); });
+	add("hex %lx snprintf", [n, snp](char* buf, size_t i) { return snp(buf, "%lx", n(i)); });
+	add("hex {#018x} zpr", [n](char* buf, size_t i) { return zpr::sprint(512, buf, "{#018x}"_fmt, n(i)); },
+		[n, snp](char* buf, size_t i) { return snp(buf, "%#018lx", n(i)); });
+	add("hex %#018lx snprintf", [n, snp](char* buf, size_t i) { return snp(buf, "%#018lx", n(i)); });
+
+	add("string {-24}|{8.5} zpr", [line](char* buf, size_t i) {
+		return zpr::sprint(512, buf, "{-24}|{8.5}"_fmt, line(i).rule, line(i).rule);
+	}, [line, snp](char* buf, size_t i) { return snp(buf, "%-24s|%8.5s", line(i).rule, line(i).rule); });
+	add("string %-24s|%8.5s snprintf", [line, snp](char* buf, size_t i) {
+		return snp(buf, "%-24s|%8.5s", line(i).rule, line(i).rule);
+	});
+
+	// containers, and zpr::fwd nested in another call.
+	add("container vector<int> zpr", [&vectors](char* buf, size_t i) { return zpr::sprint(512, buf, "{}"_fmt, vectors[i]); });
+
+	add("fwd nested zpr", [n](char* buf, size_t i) {
+		return zpr::sprint(512, buf, "[{}]"_fmt, zpr::fwd("{} <{}>", n(i) % 1000, zpr::fwd("{x}", n(i))));
+	}, [n, snp](char* buf, size_t i) { return snp(buf, "[%lu <%lx>]", n(i) % 1000, n(i)); });
+	add("fwd flat zpr", [n](char* buf, size_t i) { return zpr::sprint(512, buf, "[{} <{x}>]"_fmt, n(i) % 1000, n(i)); });
+
+	// a log line, through each kind of output.
+	auto ref = [line, snp](char* buf, size_t i) {
+		auto& l = line(i);
+		return snp(buf, "%lu %-24s %10.3f us  code %u", l.timestamp, l.rule, l.latency, l.code);
+	};
+
+	add("log line sprint(buf) zpr", [line](char* buf, size_t i) {
+		auto& l = line(i);
+		return zpr::sprint(512, buf, "{} {-24} {10.3f} us  code {}"_fmt, l.timestamp, l.rule, l.latency, l.code);
+	}, ref);
+
+	add("log line sprint(buf) zpr, runtime fmt", [line](char* buf, size_t i) {
+		auto& l = line(i);
+		return zpr::sprint(512, buf, "{} {-24} {10.3f} us  code {}", l.timestamp, l.rule, l.latency, l.code);
+	}, ref);
+
+	add("log line sprint(std::string) zpr", [line](char* buf, size_t i) {
+		auto& l = line(i);
+		auto s = zpr::sprint("{} {-24} {10.3f} us  code {}"_fmt, l.timestamp, l.rule, l.latency, l.code);
+		memcpy(buf, s.data(), s.size());
+		return s.size();
+	}, ref);
+
+	static zpr::arena_buffer arena;
+	add("log line sprint(arena_buffer) zpr", [line](char* buf, size_t i) {
+		auto& l = line(i);
+		arena.reset();
+		zpr::sprint(arena, "{} {-24} {10.3f} us  code {}"_fmt, l.timestamp, l.rule, l.latency, l.code);
+		auto s = arena.view();
+		memcpy(buf, s.data(), s.size());
+		return s.size();
+	}, ref);
+
+	add("log line cprint zpr", [line](char*, size_t i) {
+		auto& l = line(i);
+		auto cb = CountingCallback();
+		zpr::cprint(cb, "{} {-24} {10.3f} us  code {}"_fmt, l.timestamp, l.rule, l.latency, l.code);
+		return cb.len;
+	});
+
+	static FILE* devnull = fopen("/dev/null", "w");
+	add("log line fprint zpr", [line](char*, size_t i) {
+		auto& l = line(i);
+		return zpr::fprint(devnull, "{} {-24} {10.3f} us  code {}"_fmt, l.timestamp, l.rule, l.latency, l.code);
+	});
+
+	// what the synchronous log path used to do, and what it does now.
+	add("log line fprintln + fflush zpr", [line](char*, size_t i) {
+		auto& l = line(i);
+		auto n = zpr::fprintln(devnull, "{} {-24} {10.3f} us  code {}"_fmt, l.timestamp, l.rule, l.latency, l.code);
+		fflush(devnull);
+		return n;
+	});
+
+	add("log line dprintln zpr", [line](char*, size_t i) {
+		auto& l = line(i);
+		return zpr::dprintln(fileno(devnull), "{} {-24} {10.3f} us  code {}"_fmt, l.timestamp, l.rule, l.latency, l.code);
+	});
+
+	add("log line snprintf", ref);
+	add("log line fprintf", [line](char*, size_t i) {
+		auto& l = line(i);
+		return static_cast<size_t>(fprintf(devnull, "%lu %-24s %10.3f us  code %u", l.timestamp, l.rule, l.latency, l.code));
+	});
+
+#if defined(__cpp_lib_format)
+	add("log line std::format_to_n", [line](char* buf, size_t i) {
+		auto& l = line(i);
+		return static_cast<size_t>(std::format_to_n(buf, 512, "{} {:<24} {:10.3f} us  code {}", l.timestamp, l.rule,
+			l.latency, l.code).size);
+	}, ref);
+#endif
+
+	return cases;
+}
+
+// conformance: every combination of flags, width and precision, against snprintf with the same spec.
+struct Conformance
+{
+	size_t checked = 0;
+	size_t failed = 0;
+
+	void expect(std::string_view spec, std::string_view got, std::string_view want)
+	{
+		this->checked++;
+		if(got == want)
+			return;
+
+		if(this->failed++ < 20)
+			zpr::println("  {-20} zpr '{}', expected '{}'", spec, got, want);
+	}
+};
+
+static const char* FLAG_CHARS = "-+ #0";
+static const char* WIDTHS[] = { "", "1", "7", "26" };
+
+// calls fn(zpr spec, printf spec) for each combination; `conv` is the printf conversion for each zpr
+// specifier (eg. "" -> "d"), and `flags` limits which flags are used.
+template <typename Fn>
+static void for_each_spec(const char* flags, std::initializer_list<std::pair<const char*, const char*>> conv,
+	std::initializer_list<const char*> precisions, Fn&& fn)
+{
+	auto nflags = strlen(flags);
+	for(size_t mask = 0; mask < (1u << nflags); mask++)
+	{
+		std::string f;
+		for(size_t i = 0; i < nflags; i++)
+		{
+			if(mask & (1u << i))
+				f += flags[i];
+		}
+
+		for(auto width : WIDTHS)
+		{
+			for(auto prec : precisions)
+			{
+				for(auto& [zspec, cspec] : conv)
+				{
+					auto z = "{" + f + width + prec + zspec + "}";
+					auto c = "%" + f + width + prec + cspec;
+					fn(z, c);
+				}
+			}
+		}
+	}
+}
+
+template <typename T>
+static void check(Conformance& conf, std::string_view zfmt, std::string_view cfmt, T value)
+{
+	char got[512];
+	char want[512];
+
+	auto n = zpr::sprint(sizeof(got), got, zpr::tt::str_view(zfmt.data(), zfmt.size()), value);
+	auto m = snprintf(want, sizeof(want), std::string(cfmt).c_str(), value);
+
+	// zpr writes '0x' even for '{#X}', unless ZPR_HEX_0X_RESPECTS_UPPERCASE.
+	if(not ZPR_HEX_0X_RESPECTS_UPPERCASE && cfmt.ends_with('X'))
+	{
+		if(auto x = std::string_view(want, static_cast<size_t>(m)).find("0X"); x != std::string_view::npos)
+			want[x + 1] = 'x';
+	}
+
+	conf.expect(zpr::sprint("{} {}", zfmt, cfmt), std::string_view(got, n), std::string_view(want, static_cast<size_t>(m)));
+}
+
+static void check_integers(Conformance& conf)
+{
+	auto all = { "", ".0", ".1", ".4", ".19" };
+
+	for(long long v : { 0ll, 1ll, -1ll, 7ll, -42ll, 255ll, 65535ll, 123456789ll, -987654321ll, LLONG_MAX, LLONG_MIN })
+	{
+		for_each_spec(FLAG_CHARS, { { "", "lld" }, { "d", "lld" } }, all, [&](auto& z, auto& c) { check(conf, z, c, v); });
+		for_each_spec(FLAG_CHARS, { { "x", "llx" }, { "X", "llX" }, { "b", "llb" } }, all, [&](auto& z, auto& c) {
+			check(conf, z, c, static_cast<unsigned long long>(v));
+		});
+
+		auto i = static_cast<int>(v);
+		for_each_spec(FLAG_CHARS, { { "", "d" }, { "x", "x" } }, all, [&](auto& z, auto& c) { check(conf, z, c, i); });
+
+		auto u = static_cast<unsigned int>(v);
+		for_each_spec(FLAG_CHARS, { { "", "u" } }, all, [&](auto& z, auto& c) { check(conf, z, c, u); });
+
+		auto s = static_cast<short>(v);
+		for_each_spec(FLAG_CHARS, { { "", "hd" } }, all, [&](auto& z, auto& c) { check(conf, z, c, s); });
+	}
+}
+
+static void check_floats(Conformance& conf)
+{
+	auto all = { "", ".0", ".1", ".4", ".19", ".40" };
+
+	for(double v : { 0.0, -0.0, 1.0, -1.5, 0.5, 2.5, 0.1, 1e-7, 123.456, 999.9999, 1e15, 1e16, 1e22, 1.7976931348623157e308,
+		5e-324, 2.2250738585072014e-308, 3.14159265358979, -2.718281828, 1e100, 9.5, 0.000123456 })
+	{
+		auto conv = { std::pair { "f", "f" }, { "F", "F" }, { "e", "e" }, { "E", "E" }, { "g", "g" }, { "G", "G" } };
+		for_each_spec(FLAG_CHARS, conv, all, [&](auto& z, auto& c) { check(conf, z, c, v); });
+
+		// no specifier, but a precision, is '%g'.
+		for_each_spec(FLAG_CHARS, { { "", "g" } }, { ".0", ".1", ".4", ".19" }, [&](auto& z, auto& c) { check(conf, z, c, v); });
+
+		// without either, it's the shortest round-trip, like to_chars.
+		char want[64];
+		auto n = static_cast<size_t>(std::to_chars(want, want + sizeof(want), v).ptr - want);
+		conf.expect("{} to_chars", zpr::sprint("{}", v), std::string_view(want, n));
+
+		auto f = static_cast<float>(v);
+		n = static_cast<size_t>(std::to_chars(want, want + sizeof(want), f).ptr - want);
+		if(f == f && f <= FLT_MAX && f >= -FLT_MAX)
+			conf.expect("{} to_chars (float)", zpr::sprint("{}", f), std::string_view(want, n));
+	}
+
+	for(double v : { HUGE_VAL, -HUGE_VAL, static_cast<double>(NAN), -static_cast<double>(NAN) })
+	{
+		auto conv = { std::pair { "f", "f" }, { "F", "F" }, { "e", "e" }, { "E", "E" }, { "g", "g" }, { "G", "G" } };
+		for_each_spec(FLAG_CHARS, conv, all, [&](auto& z, auto& c) { check(conf, z, c, v); });
+	}
+}
+
+static void check_strings(Conformance& conf)
+{
+	for(const char* v : { "", "a", "hello", "hello, world!" })
+	{
+		for_each_spec("-", { { "", "s" }, { "s", "s" } }, { "", ".0", ".1", ".4", ".19" }, [&](auto& z, auto& c) {
+			check(conf, z, c, v);
+		});
+	}
+
+	for(char v : { 'a', 'Z', ' ' })
+		for_each_spec("-", { { "", "c" }, { "c", "c" } }, { "" }, [&](auto& z, auto& c) { check(conf, z, c, v); });
+
+	for(auto v : { reinterpret_cast<void*>(0x1), reinterpret_cast<void*>(0xdeadbeef), reinterpret_cast<void*>(UINTPTR_MAX) })
+		for_each_spec("-", { { "p", "p" } }, { "" }, [&](auto& z, auto& c) { check(conf, z, c, v); });
+}
+
+// "..."_fmt is parsed at compile time by different code, so it gets checked against the runtime parser
+// instead; mostly for the escapes, which are only unescaped up to the last argument.
+template <zpr::detail::fixed_string _Str, typename... Args>
+static void check_compiled(Conformance& conf, Args... args)
+{
+	auto fmt = zpr::tt::str_view(_Str.chars, _Str.size());
+	conf.expect(zpr::sprint("'{}' _fmt", fmt), zpr::sprint(zpr::detail::compiled_format<_Str> {}, args...),
+		zpr::sprint(fmt, args...));
+}
+
+static void check_escapes(Conformance& conf)
+{
+	check_compiled<"">(conf);
+	check_compiled<"a}b">(conf);
+	check_compiled<"a}}b">(conf);
+	check_compiled<"a}}}b">(conf);
+	check_compiled<"{{">(conf);
+	check_compiled<"{{}}">(conf);
+	check_compiled<"}}{}">(conf, 1);
+	check_compiled<"{}}">(conf, 1);
+	check_compiled<"{}}}">(conf, 1);
+	check_compiled<"x{}y}}">(conf, 1);
+	check_compiled<"{{{}}}">(conf, 1);
+	check_compiled<"{{{x}}} {{">(conf, 255);
+	check_compiled<"{} }} {{ {}">(conf, 1, "two");
+	check_compiled<"{}{{\"a\":{}}}">(conf, "x", 2);
+	check_compiled<"{-4}}}|{{{4}">(conf, 'c', 3.5);
+}
+
+static bool run_conformance()
+{
+	Conformance conf;
+	check_integers(conf);
+	check_floats(conf);
+	check_strings(conf);
+	check_escapes(conf);
+
+	zpr::println("conformance: {} checked, {} failed", conf.checked, conf.failed);
+	return conf.failed == 0;
+}
+
+int main(int argc, char** argv)
+{
+	size_t iterations = 20;
+	bool check_only = false;
+	std::string_view filter;
+
+	for(int i = 1; i < argc; i++)
+	{
+		auto arg = std::string_view(argv[i]);
+		if(arg.starts_with("--iterations="))
+		{
+			iterations = std::max(1ul, strtoul(arg.substr(13).data(), nullptr, 10));
+		}
+		else if(arg == "--check")
+		{
+			check_only = true;
+		}
+		else if(not arg.starts_with("-"))
+		{
+			filter = arg;
+		}
+		else
+		{
+			zpr::fprintln(stderr, "usage: {} [--check] [--iterations=N] [filter]", argv[0]);
+			exit(1);
+		}
+	}
+
+	if(not run_conformance())
+		return 1;
+	else if(check_only)
+		return 0;
+
+	constexpr size_t NUM_VALUES = 10000;
+	auto rng = std::mt19937_64(1234);
+
+	// what the stats output looks like: latencies in microseconds, with a fractional part.
+	std::vector<double> latencies;
+	auto latency = std::lognormal_distribution<double>(3.0, 1.5);
+	for(size_t i = 0; i < NUM_VALUES; i++)
+		latencies.push_back(latency(rng) / 7.0);
+
+	// and any finite double at all, which is where the old code did worst.
+	std::vector<double> random;
+	while(random.size() < NUM_VALUES)
+	{
+		auto bits = rng();
+		double value = 0;
+		memcpy(&value, &bits, sizeof(double));
+
+		if(value == value && value <= DBL_MAX && value >= -DBL_MAX)
+			random.push_back(value);
+	}
+
+	// trace timestamps (ns since the epoch), keycodes, and everything in between.
+	std::vector<uint64_t> timestamps;
+	std::vector<uint64_t> keycodes;
+	std::vector<uint64_t> mixed;
+	for(size_t i = 0; i < NUM_VALUES; i++)
+	{
+		timestamps.push_back(1'700'000'000'000'000'000 + rng() % 100'000'000'000'000);
+		keycodes.push_back(rng() % 768);
+		mixed.push_back(rng() >> (rng() % 64));
+	}
+
+	const char* rule_names[] = { "capslock", "konsole: meta+t", "fnmode", "terminal copy/paste", "leftmeta -> leftctrl" };
+
+	std::vector<LogLine> lines;
+	std::vector<std::vector<int>> vectors;
+	for(size_t i = 0; i < NUM_VALUES; i++)
+	{
+		lines.push_back({
+			.timestamp = timestamps[i],
+			.rule = rule_names[rng() % 5],
+			.latency = latencies[i],
+			.code = static_cast<uint32_t>(keycodes[i]),
+		});
+
+		vectors.push_back({});
+		for(size_t k = 0; k < 8; k++)
+			vectors.back().push_back(static_cast<int>(rng() % 2000) - 1000);
+	}
+
+	std::vector<Case> cases;
+	for(auto& c : int_cases(timestamps, "int/timestamp"))
+		cases.push_back(std::move(c));
+
+	for(auto& c : int_cases(keycodes, "int/keycode"))
+		cases.push_back(std::move(c));
+
+	for(auto& c : int_cases(mixed, "int/mixed"))
+		cases.push_back(std::move(c));
+
+	for(auto& c : float_cases(latencies, "float/latency"))
+		cases.push_back(std::move(c));
+
+	for(auto& c : float_cases(random, "float/random"))
+		cases.push_back(std::move(c));
+
+	for(auto& c : misc_cases(mixed, lines, vectors))
+		cases.push_back(std::move(c));
+
+	for(auto& c : cases)
+	{
+		if(filter.empty() || c.name.find(filter) != std::string::npos)
+			run_case(c, NUM_VALUES, iterations);
+	}
+}
@@ -0,0 +1,436 @@
+// zpr_legacy.h
+// Copyright (c) 2022, zhiayang
+// SPDX-License-Identifier: Apache-2.0
+
+// the old implementations from zpr.h, kept here only so that bench/zpr.cpp can compare against them.
+// legacy::print_decimal_integer is the two-digits-per-division loop from before the digit count.
+//
+// legacy::print_floating and legacy::print_exponent are adapted from _ftoa and _etoa from
+// https://github.com/mpaland/printf, which is licensed under the MIT license, reproduced below:
+//
+// Copyright Marco Paland (info@paland.com), 2014-2019, PALANDesign Hannover, Germany
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#pragma once
+
+#include "zpr.h"
+
+namespace zpr::detail::legacy
+{
+	template <typename _CallbackFn>
+	size_t print_floating(_CallbackFn& cb, double value, format_args args);
+
+	template <typename _CallbackFn>
+	size_t print_exponent(_CallbackFn& cb, double value, format_args args)
+	{
+		constexpr int DEFAULT_PRECISION = 6;
+
+		// check for NaN and special values
+		if((value != value) || (value > DBL_MAX) || (value < -DBL_MAX))
+			return print_special_floating(cb, value, static_cast<format_args&&>(args));
+
+		int prec = (args.have_precision() ? static_cast<int>(args.precision) : DEFAULT_PRECISION);
+
+		bool use_precision  = args.have_precision();
+		bool use_zero_pad   = args.zero_pad() && args.positive_width();
+		bool use_right_pad  = !use_zero_pad && args.negative_width();
+		// bool use_left_pad   = !use_zero_pad && args.positive_width();
+
+		// determine the sign
+		const bool negative = (value < 0);
+		if(negative)
+			value = -value;
+
+		// determine the decimal exponent
+		// based on the algorithm by David Gay (https://www.ampl.com/netlib/fp/dtoa.c)
+		union {
+			uint64_t U;
+			double F;
+		} conv;
+
+		conv.F = value;
+		auto exp2 = static_cast<int64_t>((conv.U >> 52U) & 0x07FFU) - 1023; // effectively log2
+		conv.U = (conv.U & ((1ULL << 52U) - 1U)) | (1023ULL << 52U);        // drop the exponent so conv.F is now in [1,2)
+
+		// now approximate log10 from the log2 integer part and an expansion of ln around 1.5
+		auto expval = static_cast<int64_t>(0.1760912590558 + exp2 * 0.301029995663981 + (conv.F - 1.5) * 0.289529654602168);
+
+		// now we want to compute 10^expval but we want to be sure it won't overflow
+		exp2 = static_cast<int64_t>(expval * 3.321928094887362 + 0.5);
+
+		const double z = expval * 2.302585092994046 - exp2 * 0.6931471805599453;
+		const double z2 = z * z;
+
+		conv.U = static_cast<uint64_t>(exp2 + 1023) << 52U;
+
+		// compute exp(z) using continued fractions, see https://en.wikipedia.org/wiki/Exponential_function#Continued_fractions_for_ex
+		conv.F *= 1 + 2 * z / (2 - z + (z2 / (6 + (z2 / (10 + z2 / 14)))));
+
+		// correct for rounding errors
+		if(value < conv.F)
+		{
+			expval--;
+			conv.F /= 10;
+		}
+
+		// the exponent format is "%+02d" and largest value is "307", so set aside 4-5 characters (including the e+ part)
+		int minwidth = (-100 < expval && expval < 100) ? 4U : 5U;
+
+		// in "%g" mode, "prec" is the number of *significant figures* not decimals
+		if(args.specifier == 'g' || args.specifier == 'G')
+		{
+			// do we want to fall-back to "%f" mode?
+			if((value >= 1e-4) && (value < 1e6))
+			{
+				if(static_cast<int64_t>(prec) > expval)
+					prec = static_cast<uint64_t>(static_cast<int64_t>(prec) - expval - 1);
+
+				else
+					prec = 0;
+
+				args.precision = prec;
+
+				// no characters in exponent
+				minwidth = 0;
+				expval = 0;
+			}
+			else
+			{
+				// we use one sigfig for the whole part
+				if(prec > 0 && use_precision)
+					prec -= 1;
+			}
+		}
+
+		// will everything fit?
+		uint64_t fwidth = args.width;
+		if(args.width > minwidth)
+		{
+			// we didn't fall-back so subtract the characters required for the exponent
+			fwidth -= minwidth;
+		}
+		else
+		{
+			// not enough characters, so go back to default sizing
+			fwidth = 0;
+		}
+
+		if(use_right_pad && minwidth)
+		{
+			// if we're padding on the right, DON'T pad the floating part
+			fwidth = 0;
+		}
+
+		// rescale the float value
+		if(expval)
+			value /= conv.F;
+
+		// output the floating part
+
+		auto args_copy = args;
+		args_copy.width = fwidth;
+		auto len = static_cast<int64_t>(legacy::print_floating(cb, negative ? -value : value, args_copy));
+
+		// output the exponent part
+		if(minwidth > 0)
+		{
+			len++;
+			if(args.specifier & 0x20)   cb('e');
+			else                        cb('E');
+
+			// output the exponent value
+			char digits_buf[8] = { };
+			size_t digits_len = 0;
+
+			auto buf = print_decimal_integer(digits_buf, 8, static_cast<int64_t>(tt::_Absolute(expval)));
+			digits_len = 8 - (buf - digits_buf);
+
+			len += digits_len + 1;
+			cb(expval < 0 ? '-' : '+');
+
+			// zero-pad to minwidth - 2
+			if(auto tmp = (minwidth - 2) - static_cast<int>(digits_len); tmp > 0)
+				len += tmp, cb('0', tmp);
+
+			cb(buf, digits_len);
+
+			// might need to right-pad spaces
+			if(use_right_pad && args.width > len)
+				cb(' ', args.width - len), len = args.width;
+		}
+
+		return len;
+	}
+
+
+	template <typename _CallbackFn>
+	size_t print_floating(_CallbackFn& cb, double value, format_args args)
+	{
+		constexpr int DEFAULT_PRECISION = 6;
+		constexpr size_t MAX_BUFFER_LEN = 128;
+		constexpr long double EXPONENTIAL_CUTOFF = 1e15;
+
+		char buf[MAX_BUFFER_LEN] = { 0 };
+
+		size_t len = 0;
+
+		int prec = (args.have_precision() ? static_cast<int>(args.precision) : DEFAULT_PRECISION);
+
+		bool use_zero_pad   = args.zero_pad() && args.positive_width();
+		bool use_left_pad   = !use_zero_pad && args.positive_width();
+		bool use_right_pad  = !use_zero_pad && args.negative_width();
+
+		// powers of 10
+		constexpr double pow10[] = {
+			1,
+			10,
+			100,
+			1000,
+			10000,
+			100000,
+			1000000,
+			10000000,
+			100000000,
+			1000000000,
+			10000000000,
+			100000000000,
+			1000000000000,
+			10000000000000,
+			100000000000000,
+			1000000000000000,
+			10000000000000000,
+		};
+
+		// test for special values
+		if((value != value) || (value > DBL_MAX) || (value < -DBL_MAX))
+			return print_special_floating(cb, value, static_cast<format_args&&>(args));
+
+		// switch to exponential for large values.
+		if((value > EXPONENTIAL_CUTOFF) || (value < -EXPONENTIAL_CUTOFF))
+			return legacy::print_exponent(cb, value, static_cast<format_args&&>(args));
+
+		// default to g.
+		if(args.specifier == -1)
+			args.specifier = 'g';
+
+		// test for negative
+		const bool negative = (value < 0);
+		if(value < 0)
+			value = -value;
+
+		// limit precision to 16, cause a prec >= 17 can lead to overflow errors
+		while((len < MAX_BUFFER_LEN) && (prec > 16))
+		{
+			buf[len++] = '0';
+			prec--;
+		}
+
+		auto whole = static_cast<int64_t>(value);
+		auto tmp = (value - whole) * pow10[prec];
+		auto frac = static_cast<unsigned long>(tmp);
+
+		double diff = tmp - frac;
+
+		if(diff > 0.5)
+		{
+			frac += 1;
+
+			// handle rollover, e.g. case 0.99 with prec 1 is 1.0
+			if(frac >= pow10[prec])
+			{
+				frac = 0;
+				whole += 1;
+			}
+		}
+		else if(diff < 0.5)
+		{
+			// ?
+		}
+		else if((frac == 0U) || (frac & 1U))
+		{
+			// if halfway, round up if odd OR if last digit is 0
+			frac += 1;
+		}
+
+		if(prec == 0U)
+		{
+			diff = value - static_cast<double>(whole);
+			if((!(diff < 0.5) || (diff > 0.5)) && (whole & 1))
+			{
+				// exactly 0.5 and ODD, then round up
+				// 1.5 -> 2, but 2.5 -> 2
+				whole += 1;
+			}
+		}
+		else
+		{
+			auto count = prec;
+
+			bool flag = (args.specifier == 'g' || args.specifier == 'G');
+			// now do fractional part, as an unsigned number
+			while(len < MAX_BUFFER_LEN)
+			{
+				if(flag && (frac % 10) == 0)
+					goto skip;
+
+				flag = false;
+				buf[len++] = static_cast<char>('0' + (frac % 10));
+
+			skip:
+				count -= 1;
+				if(!(frac /= 10))
+					break;
+			}
+
+			// add extra 0s
+			while((len < MAX_BUFFER_LEN) && (count-- > 0))
+				buf[len++] = '0';
+
+			// add decimal
+			if(len < MAX_BUFFER_LEN)
+				buf[len++] = '.';
+		}
+
+		// do whole part, number is reversed
+		while(len < MAX_BUFFER_LEN)
+		{
+			buf[len++] = static_cast<char>('0' + (whole % 10));
+			if(!(whole /= 10))
+				break;
+		}
+
+		// pad leading zeros
+		if(use_zero_pad)
+		{
+			auto width = args.width;
+
+			if(args.have_width() != 0 && (negative || args.prepend_plus() || args.prepend_space()))
+				width--;
+
+			while((len < static_cast<size_t>(width)) && (len < MAX_BUFFER_LEN))
+				buf[len++] = '0';
+		}
+
+		if(len < MAX_BUFFER_LEN)
+		{
+			if(negative)
+				buf[len++] = '-';
+
+			else if(args.prepend_plus())
+				buf[len++] = '+'; // ignore the space if the '+' exists
+
+			else if(args.prepend_space())
+				buf[len++] = ' ';
+		}
+
+		// reverse it.
+		for(size_t i = 0; i < len / 2; i++)
+			tt::swap(buf[i], buf[len - i - 1]);
+
+		auto padding_width = tt::_Maximum(int64_t(0), args.width - static_cast<int64_t>(len));
+
+		if(use_left_pad) cb(' ', padding_width);
+		if(use_zero_pad) cb('0', padding_width);
+
+		cb(buf, len);
+
+		if(use_right_pad)
+			cb(' ', padding_width);
+
+		return len + ((use_left_pad || use_right_pad) ? padding_width : 0);
+	}
+
+	template <typename _Type>
+	char* print_decimal_integer(char* buf, size_t bufsz, _Type value)
+	{
+		static_assert(sizeof(_Type) <= 8);
+
+	#if ZPR_DECIMAL_LOOKUP_TABLE
+		constexpr const char lookup_table[] =
+			"000102030405060708091011121314151617181920212223242526272829"
+			"303132333435363738394041424344454647484950515253545556575859"
+			"606162636465666768697071727374757677787980818283848586878889"
+			"90919293949596979899";
+	#endif
+
+		bool neg = false;
+		if constexpr (tt::is_signed_v<_Type>)
+		{
+			neg = (value < 0);
+			if(neg)
+				value = -value;
+		}
+
+		char* ptr = buf + bufsz;
+
+		// if we have the lookup table, do two digits at a time.
+	#if ZPR_DECIMAL_LOOKUP_TABLE
+
+		constexpr auto copy = [](char* dst, const char* src) {
+			memcpy(dst, src, 2);
+		};
+
+		while(value >= 100)
+		{
+			copy((ptr -= 2), &lookup_table[(value % 100) * 2]);
+			value /= 100;
+		}
+
+		if(value < 10)
+			*(--ptr) = static_cast<char>(value + '0');
+
+		else
+			copy((ptr -= 2), &lookup_table[value * 2]);
+
+	#else
+
+		do {
+			*(--ptr) = ('0' + (value % 10));
+			value /= 10;
+
+		} while(value > 0);
+
+	#endif
+
+		if(neg)
+			*(--ptr) = '-';
+
+		return ptr;
+	}
+}
+
+// wraps a double so that it prints with the old code; same parsing, so only the formatting differs.
+struct legacy_float
+{
+	double value;
+};
+
+template <>
+struct zpr::print_formatter<legacy_float>
+{
+	template <typename _Cb>
+	void print(legacy_float x, _Cb&& cb, format_args args)
+	{
+		if(args.specifier == 'e' || args.specifier == 'E')
+			detail::legacy::print_exponent(cb, x.value, static_cast<format_args&&>(args));
+		else
+			detail::legacy::print_floating(cb, x.value, static_cast<format_args&&>(args));
+	}
+};
@@ -0,0 +1,81 @@
+// hid_remap.bpf.c
+// Copyright (c) 2022, zhiayang
+// SPDX-License-Identifier: GPL-2.0-only OR Apache-2.0
+
+// HID-BPF program that rewrites the key array of a keyboard's input reports. this handles
+// the remaps that don't depend on the focused window (see hidbpf.cpp), so those keystrokes
+// never leave the kernel. since every report lists all the keys that are currently held,
+// the capslock layer can be done statelessly: if the layer key is in the report, drop it
+// and translate the other keys through `layer_remap`.
+
+#include "vmlinux.h"
+
+#include <bpf/bpf_helpers.h>
+#include <bpf/bpf_tracing.h>
+
+#define MAX_REPORT_SIZE     16
+#define MAX_KEYS            8
+
+extern __u8* hid_bpf_get_data(struct hid_bpf_ctx* ctx, unsigned int offset, const size_t sz) __ksym;
+
+// filled in by the loader from the report descriptor.
+const volatile __u8 report_id = 0;
+const volatile __u8 key_offset = 0;
+const volatile __u8 key_count = 0;
+const volatile __u8 layer_usage = 0;
+
+// usage -> usage, 0 meaning "leave it alone".
+__u8 plain_remap[256] = { };
+__u8 layer_remap[256] = { };
+
+SEC("struct_ops/hid_device_event")
+int BPF_PROG(slug_hid_event, struct hid_bpf_ctx* hctx, enum hid_report_type type, __u64 source)
+{
+	if(type != HID_INPUT_REPORT)
+		return 0;
+
+	__u8* data = hid_bpf_get_data(hctx, 0, MAX_REPORT_SIZE);
+	if(!data)
+		return 0;
+
+	if(report_id != 0 && data[0] != report_id)
+		return 0;
+
+	int layer = 0;
+	for(__u32 i = 0; i < MAX_KEYS && i < key_count; i++)
+	{
+		__u32 idx = key_offset + i;
+		if(idx >= MAX_REPORT_SIZE)
+			break;
+
+		if(layer_usage != 0 && data[idx] == layer_usage)
+		{
+			data[idx] = 0;
+			layer = 1;
+		}
+	}
+
+	for(__u32 i = 0; i < MAX_KEYS && i < key_count; i++)
+	{
+		__u32 idx = key_offset + i;
+		if(idx >= MAX_REPORT_SIZE)
+			break;
+
+		__u8 usage = data[idx];
+		__u8 to = layer ? layer_remap[usage] : 0;
+		if(to == 0)
+			to = plain_remap[usage];
+
+		if(to != 0)
+			data[idx] = to;
+	}
+
+	return 0;
+}
+
+SEC(".struct_ops.link")
+struct hid_bpf_ops slug_hid_ops = {
+	.hid_device_event = (void*) slug_hid_event,
+};
+
+char _license[] SEC("license") = "GPL";
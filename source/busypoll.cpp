@@ -0,0 +1,208 @@
+// busypoll.cpp
+// Copyright (c) 2022, zhiayang
+// SPDX-License-Identifier: Apache-2.0
+
+#include "slug.h"
+#include "stats.h"
+#include "trace.h"
+
+#include <sys/epoll.h>
+#include <sys/resource.h>
+
+#include <algorithm>
+
+#include <linux/input.h>
+#include <libevdev/libevdev.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+	#include <immintrin.h>
+#endif
+
+// keystrokes tend to come in bursts, so after each event we spin on a non-blocking read for a while
+// (backing off with pause in between) before going to sleep in epoll. this trades cpu time for not
+// paying the scheduler wakeup latency on the next key. since the right window depends on the machine,
+// we measure both: the cpu time we used, and how long events sat in the kernel before we read them,
+// split by whether we were spinning or asleep at the time.
+
+namespace slug
+{
+	static inline void cpu_relax()
+	{
+	#if defined(__x86_64__) || defined(__i386__)
+		_mm_pause();
+	#elif defined(__aarch64__)
+		asm volatile("yield");
+	#endif
+	}
+
+	static uint64_t cpu_time_ns()
+	{
+		struct rusage ru {};
+		getrusage(RUSAGE_THREAD, &ru);
+
+		auto us = [](const struct timeval& tv) {
+			return static_cast<uint64_t>(tv.tv_sec) * 1'000'000 + static_cast<uint64_t>(tv.tv_usec);
+		};
+
+		return (us(ru.ru_utime) + us(ru.ru_stime)) * 1000;
+	}
+
+	// 1us buckets up to 2ms, which is plenty for wakeup latency; everything else goes in the last one.
+	struct WakeupLatency
+	{
+		static constexpr size_t NUM_BUCKETS = 2001;
+
+		uint64_t count = 0;
+		uint64_t max_ns = 0;
+		uint32_t buckets[NUM_BUCKETS] {};
+
+		void record(uint64_t ns)
+		{
+			this->count++;
+			this->max_ns = std::max(this->max_ns, ns);
+			this->buckets[std::min(ns / 1000, NUM_BUCKETS - 1)]++;
+		}
+
+		uint64_t percentile_us(double p) const
+		{
+			auto target = static_cast<uint64_t>(p * static_cast<double>(this->count));
+			uint64_t seen = 0;
+			for(size_t i = 0; i < NUM_BUCKETS; i++)
+			{
+				seen += this->buckets[i];
+				if(seen > target)
+					return i;
+			}
+
+			return NUM_BUCKETS - 1;
+		}
+
+		void print(const char* what) const
+		{
+			if(this->count == 0)
+			{
+				zpr::println("    {}: no samples", what);
+				return;
+			}
+
+			zpr::println("    {}: n={}, p50={}us, p99={}us, max={.1f}us", what, this->count, this->percentile_us(0.50),
+				this->percentile_us(0.99), static_cast<double>(this->max_ns) / 1000.0);
+		}
+	};
+
+	bool runBusyPollLoop(struct libevdev* device_ev, UInputDevice* uinput, FocusProvider* focus,
+		const Options& opts, LoopStats* stats)
+	{
+		auto fd = libevdev_get_fd(device_ev);
+
+		auto epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+		struct epoll_event epev {};
+		epev.events = EPOLLIN;
+		epev.data.fd = fd;
+
+		struct epoll_event quit_epev {};
+		quit_epev.events = EPOLLIN;
+		quit_epev.data.fd = getQuitFd();
+
+		if(epoll_fd == -1 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &epev) != 0
+			|| epoll_ctl(epoll_fd, EPOLL_CTL_ADD, getQuitFd(), &quit_epev) != 0)
+		{
+			zpr::fprintln(stderr, "xkeyslug: epoll setup failed: {} ({}), using the classic loop", strerror(errno), errno);
+			if(epoll_fd != -1)
+				close(epoll_fd);
+
+			return false;
+		}
+
+		// the flags belong to the open file, which outlives us if it gets handed over (or was
+		// handed to us), so they are put back on the way out.
+		auto old_flags = fcntl(fd, F_GETFL);
+		fcntl(fd, F_SETFL, old_flags | O_NONBLOCK);
+
+		zpr::println("xkeyslug: busy-polling for {}us after each event", opts.busy_poll_us);
+		fflush(stdout);
+
+		auto window_ns = static_cast<uint64_t>(opts.busy_poll_us) * 1000;
+
+		WakeupLatency spin_latency {};
+		WakeupLatency sleep_latency {};
+
+		auto start_wall = monotonicNs();
+		auto start_cpu = cpu_time_ns();
+
+		uint64_t spin_until = 0;
+		uint32_t backoff = 1;
+		bool waiting = false;
+		bool slept = false;
+		bool at_frame_end = true;
+
+		while(not shouldStopReading(device_ev, at_frame_end))
+		{
+			struct input_event event {};
+			auto r = libevdev_next_event(device_ev, LIBEVDEV_READ_FLAG_NORMAL, &event);
+			if(r == -EAGAIN)
+			{
+				waiting = true;
+				if(monotonicNs() < spin_until)
+				{
+					for(uint32_t i = 0; i < backoff; i++)
+						cpu_relax();
+
+					backoff = std::min(backoff * 2, 32u);
+					continue;
+				}
+
+				slept = true;
+
+				struct epoll_event out {};
+				traceBegin("epoll_wait");
+				epoll_wait(epoll_fd, &out, 1, -1);
+				traceEnd("epoll_wait");
+				continue;
+			}
+			else if(r < 0)
+			{
+				zpr::fprintln(stderr, "libevdev error: {}", r);
+				continue;
+			}
+
+			auto now = monotonicNs();
+
+			// only the first event we get after waiting says anything about wakeup latency;
+			// the rest were already queued.
+			if(waiting)
+			{
+				auto event_ns = static_cast<uint64_t>(event.input_event_sec) * 1'000'000'000
+					+ static_cast<uint64_t>(event.input_event_usec) * 1000;
+
+				if(now > event_ns)
+					(slept ? sleep_latency : spin_latency).record(now - event_ns);
+			}
+
+			waiting = false;
+			slept = false;
+			backoff = 1;
+
+			handleInputEvent(uinput, focus, event);
+			stats->events++;
+
+			at_frame_end = (event.type == EV_SYN && event.code == SYN_REPORT);
+
+			spin_until = now + window_ns;
+		}
+
+		auto wall = monotonicNs() - start_wall;
+		auto cpu = cpu_time_ns() - start_cpu;
+
+		zpr::println("xkeyslug: busy-poll ({}us window): used {.2f}% of a cpu", opts.busy_poll_us,
+			wall == 0 ? 0.0 : 100.0 * static_cast<double>(cpu) / static_cast<double>(wall));
+		zpr::println("  wakeup latency (kernel timestamp to read):");
+		spin_latency.print("while spinning");
+		sleep_latency.print("from sleep");
+		fflush(stdout);
+
+		fcntl(fd, F_SETFL, old_flags);
+		close(epoll_fd);
+		return true;
+	}
+}
@@ -0,0 +1,216 @@
+// handoff.cpp
+// Copyright (c) 2022, zhiayang
+// SPDX-License-Identifier: Apache-2.0
+
+#include "handoff.h"
+#include "listener.h"
+
+#include <sys/socket.h>
+
+#include <atomic>
+
+namespace slug
+{
+	static UnixListener g_listener;
+	static std::atomic<int> g_clientFd = -1;
+
+	// only the same user gets the keyboard; anyone else could use it to log or inject keys.
+	static bool is_same_user(int sock)
+	{
+		struct ucred cred {};
+		socklen_t len = sizeof(cred);
+		if(getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0)
+			return false;
+
+		return cred.uid == geteuid();
+	}
+
+	// takes the first connection from the same user, then stops the event loop (which also wakes
+	// it up, see getQuitFd()).
+	static bool on_takeover(int client)
+	{
+		if(not is_same_user(client))
+		{
+			zpr::fprintln(stderr, "xkeyslug: refusing handoff to a process owned by another user");
+			close(client);
+			return true;
+		}
+
+		zpr::println("xkeyslug: handing over to a new instance");
+		fflush(stdout);
+
+		g_clientFd = client;
+		requestQuit();
+		return false;
+	}
+
+	bool startHandoffListener(const char* path)
+	{
+		return g_listener.start(path, "handoff socket", 1, &on_takeover);
+	}
+
+	void stopHandoffListener()
+	{
+		g_listener.stop();
+	}
+
+	bool handoffRequested()
+	{
+		return g_clientFd.load() != -1;
+	}
+
+	bool completeHandoff(int evdev_fd, UInputSink* sink, UInputDevice* uinput)
+	{
+		auto client = g_clientFd.exchange(-1);
+		if(client == -1)
+			return false;
+
+		// anything still batched has to go out from here, before the new instance starts writing.
+		uinput->flush();
+
+		HandoffMessage msg {};
+		msg.magic = HandoffMessage::MAGIC;
+		msg.version = HandoffMessage::VERSION;
+
+		auto copy_keys = [](const std::unordered_set<keycode_t>& keys, keycode_t* out, uint32_t* count) {
+			for(auto k : keys)
+			{
+				if(*count < HandoffMessage::MAX_KEYS)
+					out[(*count)++] = k;
+			}
+		};
+
+		copy_keys(uinput->getModifiers(), msg.modifiers, &msg.num_modifiers);
+		copy_keys(uinput->getRealModifiers(), msg.real_modifiers, &msg.num_real_modifiers);
+
+		for(auto [from, to] : getHeldRemaps())
+		{
+			if(msg.num_remaps == HandoffMessage::MAX_KEYS)
+				break;
+
+			msg.remaps[msg.num_remaps][0] = from;
+			msg.remaps[msg.num_remaps][1] = to;
+			msg.num_remaps++;
+		}
+
+		int fds[2] = { evdev_fd, sink->fd() };
+
+		alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))] {};
+		struct iovec iov { .iov_base = &msg, .iov_len = sizeof(msg) };
+
+		msghdr hdr {};
+		hdr.msg_iov = &iov;
+		hdr.msg_iovlen = 1;
+		hdr.msg_control = control;
+		hdr.msg_controllen = sizeof(control);
+
+		auto cmsg = CMSG_FIRSTHDR(&hdr);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+		memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+		ssize_t n = -1;
+		do {
+			n = sendmsg(client, &hdr, MSG_NOSIGNAL);
+		} while(n == -1 && errno == EINTR);
+
+		close(client);
+
+		if(n != static_cast<ssize_t>(sizeof(msg)))
+		{
+			zpr::fprintln(stderr, "xkeyslug: handoff failed: {} ({})", strerror(errno), errno);
+			return false;
+		}
+
+		sink->release();
+		return true;
+	}
+
+	std::optional<Takeover> takeOver(const char* path)
+	{
+		sockaddr_un addr {};
+		if(not makeUnixAddress(&addr, path))
+			return std::nullopt;
+
+		auto sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if(sock == -1 || connect(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0)
+		{
+			zpr::fprintln(stderr, "xkeyslug: could not connect to '{}' to take over: {} ({})", path, strerror(errno), errno);
+			if(sock != -1)
+				close(sock);
+
+			return std::nullopt;
+		}
+
+		if(not is_same_user(sock))
+		{
+			zpr::fprintln(stderr, "xkeyslug: not taking over from '{}', which belongs to another user", path);
+			close(sock);
+			return std::nullopt;
+		}
+
+		HandoffMessage msg {};
+		int fds[2] = { -1, -1 };
+
+		alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))] {};
+		struct iovec iov { .iov_base = &msg, .iov_len = sizeof(msg) };
+
+		msghdr hdr {};
+		hdr.msg_iov = &iov;
+		hdr.msg_iovlen = 1;
+		hdr.msg_control = control;
+		hdr.msg_controllen = sizeof(control);
+
+		// the old instance only sends once its loop has stopped and everything else is shut down.
+		ssize_t n = -1;
+		do {
+			n = recvmsg(sock, &hdr, MSG_WAITALL | MSG_CMSG_CLOEXEC);
+		} while(n == -1 && errno == EINTR);
+
+		close(sock);
+
+		auto cmsg = CMSG_FIRSTHDR(&hdr);
+		if(cmsg != nullptr && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS
+			&& cmsg->cmsg_len == CMSG_LEN(sizeof(fds)))
+		{
+			memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+		}
+
+		auto fail = [&fds](const char* why) -> std::optional<Takeover> {
+			zpr::fprintln(stderr, "xkeyslug: takeover failed: {}", why);
+			for(auto fd : fds)
+			{
+				if(fd != -1)
+					close(fd);
+			}
+
+			return std::nullopt;
+		};
+
+		if(n != static_cast<ssize_t>(sizeof(msg)) || fds[0] == -1 || fds[1] == -1)
+			return fail("the running instance did not hand anything over");
+
+		if(msg.magic != HandoffMessage::MAGIC || msg.version != HandoffMessage::VERSION)
+			return fail("the running instance speaks a different handoff protocol");
+
+		if(msg.num_modifiers > HandoffMessage::MAX_KEYS || msg.num_real_modifiers > HandoffMessage::MAX_KEYS
+			|| msg.num_remaps > HandoffMessage::MAX_KEYS)
+		{
+			return fail("malformed key state");
+		}
+
+		auto ret = Takeover {
+			.evdev_fd = fds[0],
+			.uinput_fd = fds[1],
+			.modifiers = { msg.modifiers, msg.modifiers + msg.num_modifiers },
+			.real_modifiers = { msg.real_modifiers, msg.real_modifiers + msg.num_real_modifiers },
+			.remaps = {},
+		};
+
+		for(uint32_t i = 0; i < msg.num_remaps; i++)
+			ret.remaps.emplace_back(msg.remaps[i][0], msg.remaps[i][1]);
+
+		return ret;
+	}
+}
@@ -0,0 +1,271 @@
+// hidbpf.cpp
+// Copyright (c) 2022, zhiayang
+// SPDX-License-Identifier: Apache-2.0
+
+#include "slug.h"
+
+#include <linux/input.h>
+
+// the remaps that don't depend on the window (the static remaps and the capslock layer) can be done
+// by rewriting the keyboard's HID reports before hid-input ever sees them; see bpf/hid_remap.bpf.c.
+// we translate our keycodes back into usages (keyboard page only) and hand the tables to the program.
+// anything without a usage (eg. MOD_CAPSLOCK) can't be offloaded, and stays in userspace.
+
+namespace slug
+{
+	// the start of hid_keyboard[] in drivers/hid/hid-input.c, indexed by usage.
+	static constexpr keycode_t g_usageToKeycode[] = {
+		0, 0, 0, 0, KEY_A, KEY_B, KEY_C, KEY_D, KEY_E, KEY_F, KEY_G, KEY_H, KEY_I, KEY_J, KEY_K, KEY_L,
+		KEY_M, KEY_N, KEY_O, KEY_P, KEY_Q, KEY_R, KEY_S, KEY_T, KEY_U, KEY_V, KEY_W, KEY_X, KEY_Y, KEY_Z, KEY_1, KEY_2,
+		KEY_3, KEY_4, KEY_5, KEY_6, KEY_7, KEY_8, KEY_9, KEY_0, KEY_ENTER, KEY_ESC, KEY_BACKSPACE, KEY_TAB, KEY_SPACE,
+			KEY_MINUS, KEY_EQUAL, KEY_LEFTBRACE,
+		KEY_RIGHTBRACE, KEY_BACKSLASH, KEY_BACKSLASH, KEY_SEMICOLON, KEY_APOSTROPHE, KEY_GRAVE, KEY_COMMA, KEY_DOT,
+			KEY_SLASH, KEY_CAPSLOCK, KEY_F1, KEY_F2, KEY_F3, KEY_F4, KEY_F5, KEY_F6,
+		KEY_F7, KEY_F8, KEY_F9, KEY_F10, KEY_F11, KEY_F12, KEY_SYSRQ, KEY_SCROLLLOCK, KEY_PAUSE, KEY_INSERT, KEY_HOME,
+			KEY_PAGEUP, KEY_DELETE, KEY_END, KEY_PAGEDOWN, KEY_RIGHT,
+		KEY_LEFT, KEY_DOWN, KEY_UP, KEY_NUMLOCK, KEY_KPSLASH, KEY_KPASTERISK, KEY_KPMINUS, KEY_KPPLUS, KEY_KPENTER,
+			KEY_KP1, KEY_KP2, KEY_KP3, KEY_KP4, KEY_KP5, KEY_KP6, KEY_KP7,
+		KEY_KP8, KEY_KP9, KEY_KP0, KEY_KPDOT, KEY_102ND, KEY_COMPOSE,
+	};
+
+	uint8_t hidUsageForKeycode(keycode_t keycode)
+	{
+		for(size_t i = 0; i < std::size(g_usageToKeycode); i++)
+		{
+			if(g_usageToKeycode[i] != 0 && g_usageToKeycode[i] == keycode)
+				return static_cast<uint8_t>(i);
+		}
+
+		return 0;
+	}
+}
+
+#if SLUG_HID_BPF
+
+#include <limits.h>
+#include <sys/sysmacros.h>
+
+#include <vector>
+#include <optional>
+#include <unordered_map>
+
+#include <bpf/libbpf.h>
+
+#include "hid_remap.skel.h"
+
+namespace slug
+{
+	struct KeyArrayLayout
+	{
+		uint8_t report_id;
+		uint8_t offset;     // in bytes, from the start of the report (including the id)
+		uint8_t count;
+	};
+
+	// find the keyboard-page key array (8-bit data array input) in a report descriptor.
+	static std::optional<KeyArrayLayout> find_key_array(const std::vector<uint8_t>& desc)
+	{
+		uint32_t usage_page = 0;
+		uint32_t report_size = 0;
+		uint32_t report_count = 0;
+		uint32_t report_id = 0;
+		std::unordered_map<uint32_t, uint32_t> bit_offsets;
+
+		for(size_t i = 0; i < desc.size(); )
+		{
+			auto prefix = desc[i];
+			if(prefix == 0xFE)
+			{
+				// long item; nobody uses these
+				i += 3 + (i + 1 < desc.size() ? desc[i + 1] : 0);
+				continue;
+			}
+
+			size_t size = (prefix & 3) == 3 ? 4 : (prefix & 3);
+			if(i + 1 + size > desc.size())
+				break;
+
+			uint32_t value = 0;
+			for(size_t k = 0; k < size; k++)
+				value |= static_cast<uint32_t>(desc[i + 1 + k]) << (8 * k);
+
+			switch(prefix & 0xFC)
+			{
+				case 0x04: usage_page = value; break;
+				case 0x74: report_size = value; break;
+				case 0x94: report_count = value; break;
+				case 0x84: report_id = value; break;
+
+				case 0x80: {
+					auto& bits = bit_offsets[report_id];
+					if(usage_page == 0x07 && report_size == 8 && (value & 3) == 0 && bits % 8 == 0)
+					{
+						return KeyArrayLayout {
+							.report_id = static_cast<uint8_t>(report_id),
+							.offset = static_cast<uint8_t>(bits / 8 + (report_id != 0 ? 1 : 0)),
+							.count = static_cast<uint8_t>(report_count)
+						};
+					}
+
+					bits += report_size * report_count;
+					break;
+				}
+			}
+
+			i += 1 + size;
+		}
+
+		return std::nullopt;
+	}
+
+	// eventN -> inputM -> the hid device, eg. /sys/devices/.../0003:05AC:027E.0001
+	static std::string find_hid_device(int evdev_fd)
+	{
+		struct stat st {};
+		if(fstat(evdev_fd, &st) != 0)
+			return {};
+
+		auto link = zpr::sprint("/sys/dev/char/{}:{}/device/device", major(st.st_rdev), minor(st.st_rdev));
+
+		char buf[PATH_MAX] {};
+		if(realpath(link.c_str(), buf) == nullptr)
+			return {};
+
+		return buf;
+	}
+
+	static std::vector<uint8_t> read_file(const std::string& path)
+	{
+		std::vector<uint8_t> ret;
+
+		auto fd = open(path.c_str(), O_RDONLY);
+		if(fd == -1)
+			return ret;
+
+		uint8_t buf[4096];
+		while(true)
+		{
+			auto n = read(fd, buf, sizeof(buf));
+			if(n <= 0)
+				break;
+
+			ret.insert(ret.end(), buf, buf + n);
+		}
+
+		close(fd);
+		return ret;
+	}
+
+	static struct hid_remap_bpf* g_skel = nullptr;
+	static struct bpf_link* g_link = nullptr;
+
+	bool loadHidBpf(int evdev_fd)
+	{
+		auto hid_path = find_hid_device(evdev_fd);
+		auto dot = hid_path.rfind('.');
+		if(hid_path.empty() || dot == std::string::npos)
+		{
+			zpr::fprintln(stderr, "xkeyslug: HID-BPF: input device is not a HID device");
+			return false;
+		}
+
+		auto hid_id = strtoul(hid_path.c_str() + dot + 1, nullptr, 16);
+
+		auto layout = find_key_array(read_file(hid_path + "/report_descriptor"));
+		if(not layout.has_value() || layout->offset + layout->count > 16)
+		{
+			zpr::fprintln(stderr, "xkeyslug: HID-BPF: could not find a key array in the report descriptor");
+			return false;
+		}
+
+		g_skel = hid_remap_bpf__open();
+		if(g_skel == nullptr)
+		{
+			zpr::fprintln(stderr, "xkeyslug: HID-BPF: failed to open program: {} ({})", strerror(errno), errno);
+			return false;
+		}
+
+		g_skel->struct_ops.slug_hid_ops->hid_id = static_cast<int>(hid_id);
+		g_skel->rodata->report_id = layout->report_id;
+		g_skel->rodata->key_offset = layout->offset;
+		g_skel->rodata->key_count = layout->count;
+
+		size_t num_remaps = 0;
+		for(auto& remap : getStaticRemaps())
+		{
+			auto from = hidUsageForKeycode(remap.from);
+			auto to = hidUsageForKeycode(remap.to);
+			if(from != 0 && to != 0)
+			{
+				g_skel->data->plain_remap[from] = to;
+				num_remaps++;
+			}
+		}
+
+		auto layer = getCapslockLayer();
+		if(auto layer_usage = hidUsageForKeycode(layer.key); layer_usage != 0)
+		{
+			g_skel->rodata->layer_usage = layer_usage;
+			for(auto& remap : layer.remaps)
+			{
+				auto from = hidUsageForKeycode(remap.from);
+				auto to = hidUsageForKeycode(remap.to);
+				if(from != 0 && to != 0)
+				{
+					g_skel->data->layer_remap[from] = to;
+					num_remaps++;
+				}
+			}
+		}
+
+		if(auto err = hid_remap_bpf__load(g_skel); err != 0)
+		{
+			zpr::fprintln(stderr, "xkeyslug: HID-BPF: failed to load program: {} ({})", strerror(-err), err);
+			unloadHidBpf();
+			return false;
+		}
+
+		g_link = bpf_map__attach_struct_ops(g_skel->maps.slug_hid_ops);
+		if(g_link == nullptr)
+		{
+			zpr::fprintln(stderr, "xkeyslug: HID-BPF: failed to attach to hid device {}: {} ({})",
+				hid_id, strerror(errno), errno);
+			unloadHidBpf();
+			return false;
+		}
+
+		zpr::println("xkeyslug: HID-BPF handling {} remaps on hid device {x}", num_remaps, hid_id);
+		fflush(stdout);
+
+		return true;
+	}
+
+	void unloadHidBpf()
+	{
+		if(g_link != nullptr)
+			bpf_link__destroy(g_link);
+
+		if(g_skel != nullptr)
+			hid_remap_bpf__destroy(g_skel);
+
+		g_link = nullptr;
+		g_skel = nullptr;
+	}
+}
+
+#else
+
+namespace slug
+{
+	bool loadHidBpf(int evdev_fd)
+	{
+		zpr::fprintln(stderr, "xkeyslug: built without HID-BPF support (build with HID_BPF=1)");
+		return false;
+	}
+
+	void unloadHidBpf()
+	{
+	}
+}
+
+#endif
@@ -0,0 +1,67 @@
+// handoff.h
+// Copyright (c) 2022, zhiayang
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include "slug.h"
+
+#include <vector>
+#include <optional>
+
+// restarting (eg. after an upgrade) without letting go of the keyboard. the running instance listens on
+// --handoff-socket=<path>, and a new one started with --takeover=<path> connects to it. the old one
+// stops its loop, shuts down everything else as usual, and then sends its grabbed evdev fd and its
+// uinput fd (SCM_RIGHTS), together with the held modifiers and remapped keys, instead of ungrabbing
+// and destroying the device. the grab belongs to the open file, so it never lapses; the virtual
+// keyboard stays the same device; and events that arrive in between wait in the evdev fd.
+//
+// the socket is only accessible to its owner, and both sides check that the other is the same user.
+//
+// kernel remaps and the HID-BPF program are not handed over; the old instance removes them and the
+// new one installs them again, as for a normal restart.
+
+namespace slug
+{
+	struct HandoffMessage
+	{
+		static constexpr uint32_t MAGIC = 0x48534b58;     // "XKSH"
+		static constexpr uint32_t VERSION = 1;
+		static constexpr size_t MAX_KEYS = 32;
+
+		uint32_t magic;
+		uint32_t version;
+
+		uint32_t num_modifiers;
+		uint32_t num_real_modifiers;
+		uint32_t num_remaps;
+
+		keycode_t modifiers[MAX_KEYS];
+		keycode_t real_modifiers[MAX_KEYS];
+		keycode_t remaps[MAX_KEYS][2];      // real keycode, what it was sent as
+	};
+
+	struct Takeover
+	{
+		int evdev_fd = -1;
+		int uinput_fd = -1;
+
+		std::vector<keycode_t> modifiers;
+		std::vector<keycode_t> real_modifiers;
+		std::vector<std::pair<keycode_t, keycode_t>> remaps;
+	};
+
+	// old instance: when a new one connects, the event loop is told to quit (and woken up).
+	bool startHandoffListener(const char* path);
+	void stopHandoffListener();
+
+	// whether a new instance has connected and is waiting for completeHandoff().
+	bool handoffRequested();
+
+	// old instance, once the loop has stopped. returns false if nothing was sent, in which case the
+	// caller still owns everything and should shut down normally.
+	bool completeHandoff(int evdev_fd, UInputSink* sink, UInputDevice* uinput);
+
+	// new instance: connects to `path` and waits for the old instance to hand over.
+	std::optional<Takeover> takeOver(const char* path);
+}
@@ -0,0 +1,347 @@
+// keynames.h
+// Copyright (c) 2022, zhiayang
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include "slug.h"
+
+#include <bit>
+#include <array>
+#include <optional>
+#include <algorithm>
+#include <linux/input.h>
+
+// names for KEY_* and BTN_* codes, both ways, built at compile time. keynames.inc is generated by the
+// makefile from linux/input-event-codes.h, with one SLUG_KEYNAME(name, canonical) per #define; aliases
+// that are defined as another name (eg. KEY_HANGUEL) have canonical = false.
+//
+// code -> name is a plain array. name -> code is a perfect hash (hash-and-displace): the name's hash
+// picks a bucket, each bucket has a seed chosen so that its names land in distinct slots, and a lookup
+// is two hashes and one string compare.
+
+namespace slug
+{
+	namespace keynames
+	{
+		struct Entry
+		{
+			keycode_t code;
+			std::string_view name;
+			bool canonical;
+		};
+
+		constexpr Entry ALL[] = {
+			#define SLUG_KEYNAME(name, canonical) { name, #name, canonical },
+			#include "keynames.inc"
+			#undef SLUG_KEYNAME
+		};
+
+		constexpr size_t NUM_NAMES = std::size(ALL);
+		constexpr size_t NUM_SLOTS = std::bit_ceil(NUM_NAMES + NUM_NAMES / 4);
+		constexpr size_t NUM_BUCKETS = std::bit_ceil(NUM_NAMES / 4);
+		constexpr uint16_t EMPTY = UINT16_MAX;
+
+		static_assert(NUM_NAMES < EMPTY);
+
+		// if a code has several names, the last one that isn't an alias wins; that skips the range
+		// markers (BTN_MISC, BTN_MOUSE, ...), which come before the first real key at the same code.
+		constexpr auto BY_CODE = []() {
+			std::array<std::string_view, KEY_CNT> names {};
+			for(auto& e : ALL)
+			{
+				if(e.code < KEY_CNT && (e.canonical || names[e.code].empty()))
+					names[e.code] = e.name;
+			}
+			return names;
+		}();
+
+		constexpr uint64_t hash(std::string_view name)
+		{
+			uint64_t h = 0xcbf29ce484222325;
+			for(char c : name)
+				h = (h ^ static_cast<uint8_t>(c)) * 0x100000001b3;
+
+			return h;
+		}
+
+		constexpr size_t bucket_of(uint64_t h)
+		{
+			return (h >> 32) & (NUM_BUCKETS - 1);
+		}
+
+		constexpr size_t slot_of(uint64_t h, uint16_t seed)
+		{
+			h += seed * 0x9e3779b97f4a7c15;
+			h = (h ^ (h >> 33)) * 0xff51afd7ed558ccd;
+			h = (h ^ (h >> 33)) * 0xc4ceb9fe1a85ec53;
+			return (h ^ (h >> 33)) & (NUM_SLOTS - 1);
+		}
+
+		struct PerfectHash
+		{
+			std::array<uint16_t, NUM_BUCKETS> seeds;
+			std::array<uint16_t, NUM_SLOTS> slots;     // index into ALL
+		};
+
+		// buckets are placed biggest first, while the table is still mostly empty.
+		constexpr PerfectHash BY_NAME = []() {
+			PerfectHash ph {};
+			ph.slots.fill(EMPTY);
+
+			std::array<uint64_t, NUM_NAMES> hashes {};
+			std::array<uint16_t, NUM_BUCKETS + 1> starts {};
+			std::array<uint16_t, NUM_NAMES> members {};
+
+			for(size_t i = 0; i < NUM_NAMES; i++)
+			{
+				hashes[i] = hash(ALL[i].name);
+				starts[bucket_of(hashes[i]) + 1]++;
+			}
+
+			for(size_t b = 0; b < NUM_BUCKETS; b++)
+				starts[b + 1] += starts[b];
+
+			auto fill = starts;
+			for(size_t i = 0; i < NUM_NAMES; i++)
+				members[fill[bucket_of(hashes[i])]++] = static_cast<uint16_t>(i);
+
+			size_t biggest = 0;
+			for(size_t b = 0; b < NUM_BUCKETS; b++)
+				biggest = std::max<size_t>(biggest, starts[b + 1] - starts[b]);
+
+			for(size_t size = biggest; size > 0; size--)
+			{
+				for(size_t b = 0; b < NUM_BUCKETS; b++)
+				{
+					if(static_cast<size_t>(starts[b + 1] - starts[b]) != size)
+						continue;
+
+					for(uint16_t seed = 0; ; seed++)
+					{
+						bool ok = true;
+						for(size_t i = starts[b]; ok && i < starts[b + 1]; i++)
+						{
+							auto slot = slot_of(hashes[members[i]], seed);
+							ok = (ph.slots[slot] == EMPTY);
+
+							// and not on top of an earlier name in the same bucket
+							for(size_t k = starts[b]; ok && k < i; k++)
+								ok = (slot_of(hashes[members[k]], seed) != slot);
+						}
+
+						if(not ok)
+							continue;
+
+						for(size_t i = starts[b]; i < starts[b + 1]; i++)
+							ph.slots[slot_of(hashes[members[i]], seed)] = members[i];
+
+						ph.seeds[b] = seed;
+						break;
+					}
+				}
+			}
+
+			return ph;
+		}();
+	}
+
+	// eg. "KEY_CAPSLOCK"; empty if the code has no name.
+	constexpr std::string_view keyName(keycode_t code)
+	{
+		return code < KEY_CNT ? keynames::BY_CODE[code] : std::string_view();
+	}
+
+	// the other way around; aliases (eg. "KEY_HANGUEL") are accepted too.
+	constexpr std::optional<keycode_t> keycodeFromName(std::string_view name)
+	{
+		auto h = keynames::hash(name);
+		auto idx = keynames::BY_NAME.slots[keynames::slot_of(h, keynames::BY_NAME.seeds[keynames::bucket_of(h)])];
+		if(idx == keynames::EMPTY || keynames::ALL[idx].name != name)
+			return std::nullopt;
+
+		return keynames::ALL[idx].code;
+	}
+
+	static_assert(keyName(KEY_CAPSLOCK) == "KEY_CAPSLOCK");
+	static_assert(keyName(BTN_LEFT) == "BTN_LEFT");
+	static_assert(keycodeFromName("KEY_MACRO1") == KEY_MACRO1);
+	static_assert(keycodeFromName("KEY_HANGUEL") == KEY_HANGEUL);
+	static_assert(not keycodeFromName("KEY_CAPSLOCKX").has_value());
+
+	// prints a keycode by name, or as a number if it doesn't have one.
+	struct KeyName
+	{
+		keycode_t code;
+	};
+
+	// the modifier keys that are held, as bits in the order of KEYS.
+	struct ModifierMask
+	{
+		static constexpr keycode_t KEYS[] = {
+			KEY_LEFTCTRL, KEY_RIGHTCTRL, KEY_LEFTSHIFT, KEY_RIGHTSHIFT,
+			KEY_LEFTALT, KEY_RIGHTALT, KEY_LEFTMETA, KEY_RIGHTMETA,
+		};
+
+		static ModifierMask of(const std::unordered_set<keycode_t>& keys)
+		{
+			uint8_t bits = 0;
+			for(size_t i = 0; i < std::size(KEYS); i++)
+			{
+				if(keys.contains(KEYS[i]))
+					bits |= static_cast<uint8_t>(1 << i);
+			}
+
+			return { bits };
+		}
+
+		uint8_t bits;
+	};
+}
+
+template <>
+struct zpr::print_formatter<slug::KeyAction>
+{
+	template <typename _Cb>
+	void print(slug::KeyAction action, _Cb&& cb, format_args args)
+	{
+		constexpr tt::str_view names[] = { "release", "press", "repeat" };
+
+		auto idx = static_cast<size_t>(action);
+		if(idx < std::size(names))
+			detail::print_string(static_cast<_Cb&&>(cb), names[idx].data(), names[idx].size(), static_cast<format_args&&>(args));
+		else
+			detail::print_one(static_cast<_Cb&&>(cb), static_cast<format_args&&>(args), static_cast<int>(idx));
+	}
+};
+
+template <>
+struct zpr::print_formatter<slug::KeyName>
+{
+	template <typename _Cb>
+	void print(slug::KeyName key, _Cb&& cb, format_args args)
+	{
+		auto name = slug::keyName(key.code);
+		if(not name.empty())
+			detail::print_string(static_cast<_Cb&&>(cb), name.data(), name.size(), static_cast<format_args&&>(args));
+		else
+			detail::print_one(static_cast<_Cb&&>(cb), static_cast<format_args&&>(args), key.code);
+	}
+};
+
+// eg. "KEY_LEFTCTRL+KEY_LEFTSHIFT", or "none".
+template <>
+struct zpr::print_formatter<slug::ModifierMask>
+{
+	template <typename _Cb>
+	void print(slug::ModifierMask mods, _Cb&& cb, format_args args)
+	{
+		if(mods.bits == 0)
+		{
+			cb("none");
+			return;
+		}
+
+		bool first = true;
+		for(size_t i = 0; i < std::size(slug::ModifierMask::KEYS); i++)
+		{
+			if(not (mods.bits & (1 << i)))
+				continue;
+
+			if(not first)
+				cb('+');
+
+			auto name = slug::keyName(slug::ModifierMask::KEYS[i]);
+			cb(tt::str_view(name.data(), name.size()));
+			first = false;
+		}
+	}
+};
+
+// eg. "EV_KEY KEY_A press", "EV_SYN SYN_REPORT 0", "EV_MSC MSC_SCAN 458756".
+template <>
+struct zpr::print_formatter<struct input_event>
+{
+	template <typename _Cb>
+	void print(const struct input_event& ev, _Cb&& cb, format_args args)
+	{
+		using namespace zpr::literals;
+
+		auto type = event_type_name(ev.type);
+		if(type == nullptr)
+		{
+			detail::print(cb, "type {} code {} value {}"_fmt, ev.type, ev.code, ev.value);
+			return;
+		}
+
+		cb(type);
+		cb(' ');
+
+		if(ev.type == EV_KEY)
+		{
+			if(ev.value >= 0 && ev.value <= 2)
+				detail::print(cb, "{} {}"_fmt, slug::KeyName { ev.code }, static_cast<slug::KeyAction>(ev.value));
+			else
+				detail::print(cb, "{} {}"_fmt, slug::KeyName { ev.code }, ev.value);
+		}
+		else if(auto code = event_code_name(ev.type, ev.code); code != nullptr)
+		{
+			detail::print(cb, "{} {}"_fmt, code, ev.value);
+		}
+		else
+		{
+			detail::print(cb, "{} {}"_fmt, ev.code, ev.value);
+		}
+	}
+
+private:
+	static constexpr const char* event_type_name(uint16_t type)
+	{
+		switch(type)
+		{
+			case EV_SYN: return "EV_SYN";
+			case EV_KEY: return "EV_KEY";
+			case EV_REL: return "EV_REL";
+			case EV_ABS: return "EV_ABS";
+			case EV_MSC: return "EV_MSC";
+			case EV_SW:  return "EV_SW";
+			case EV_LED: return "EV_LED";
+			case EV_SND: return "EV_SND";
+			case EV_REP: return "EV_REP";
+			case EV_FF:  return "EV_FF";
+			case EV_PWR: return "EV_PWR";
+			case EV_FF_STATUS: return "EV_FF_STATUS";
+			default: return nullptr;
+		}
+	}
+
+	static constexpr const char* event_code_name(uint16_t type, uint16_t code)
+	{
+		if(type == EV_SYN)
+		{
+			switch(code)
+			{
+				case SYN_REPORT:    return "SYN_REPORT";
+				case SYN_CONFIG:    return "SYN_CONFIG";
+				case SYN_MT_REPORT: return "SYN_MT_REPORT";
+				case SYN_DROPPED:   return "SYN_DROPPED";
+				default: return nullptr;
+			}
+		}
+		else if(type == EV_MSC)
+		{
+			switch(code)
+			{
+				case MSC_SERIAL:    return "MSC_SERIAL";
+				case MSC_PULSELED:  return "MSC_PULSELED";
+				case MSC_GESTURE:   return "MSC_GESTURE";
+				case MSC_RAW:       return "MSC_RAW";
+				case MSC_SCAN:      return "MSC_SCAN";
+				case MSC_TIMESTAMP: return "MSC_TIMESTAMP";
+				default: return nullptr;
+			}
+		}
+
+		return nullptr;
+	}
+};
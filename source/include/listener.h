@@ -0,0 +1,43 @@
+// listener.h
+// Copyright (c) 2022, zhiayang
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include "slug.h"
+
+#include <sys/un.h>
+
+#include <string>
+#include <thread>
+
+// a unix socket with a background thread that accepts connections on it, used by the stats server
+// and the handoff listener. the socket file is only accessible to its owner. a dead socket left
+// behind by a crashed instance is replaced; anything else at the path (including a socket that
+// something is still listening on) is an error.
+
+namespace slug
+{
+	// false (with a message) if `path` doesn't fit.
+	bool makeUnixAddress(sockaddr_un* addr, const char* path);
+
+	struct UnixListener
+	{
+		// called on the listener's thread with each accepted connection, which it then owns. returning
+		// false stops accepting.
+		using Callback = bool (*)(int client);
+
+		// `what` is only for messages, eg. "stats socket".
+		bool start(const char* path, const char* what, int backlog, Callback on_client);
+		void stop();
+
+	private:
+		void run();
+
+		int m_listen_fd = -1;
+		int m_wake_fds[2] = { -1, -1 };
+		Callback m_on_client = nullptr;
+		std::string m_path;
+		std::thread m_thread;
+	};
+}
@@ -0,0 +1,125 @@
+// log.h
+// Copyright (c) 2022, zhiayang
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include "slug.h"
+
+#include <atomic>
+#include <algorithm>
+
+// messages printed from the event loop go through here instead of straight to stdio. each thread
+// formats into its own ring buffer (with zpr::cprintln and a ring appender), and a background thread
+// writes them out in batches with writev(). if a ring is full the message is dropped and counted, so
+// logging never holds up a key. outside startLogger/stopLogger, messages are printed synchronously,
+// with one write() each.
+
+namespace slug
+{
+	extern std::atomic<bool> g_logging;
+
+	// single producer (the owning thread), single consumer (the flusher). records are a header and
+	// then the text, padded to 8 bytes so a header never wraps around the end.
+	struct LogRing
+	{
+		static constexpr size_t CAPACITY = 64 * 1024;
+
+		struct Header
+		{
+			int32_t fd;
+			uint32_t len;
+		};
+
+		std::atomic<size_t> head = 0;      // written by the producer
+		std::atomic<size_t> tail = 0;      // written by the consumer
+		std::atomic<uint64_t> dropped = 0;
+
+		alignas(8) char data[CAPACITY];
+	};
+
+	static_assert((LogRing::CAPACITY & (LogRing::CAPACITY - 1)) == 0);
+	static_assert(sizeof(LogRing::Header) == 8);
+
+	// appends to the record being written; once something doesn't fit, the rest is ignored and the
+	// whole record gets dropped.
+	struct LogRingAppender
+	{
+		void operator() (const char* str, size_t len)
+		{
+			if(this->overflow || this->pos + len > this->limit)
+			{
+				this->overflow = true;
+				return;
+			}
+
+			auto ofs = this->pos % LogRing::CAPACITY;
+			auto first = std::min(len, LogRing::CAPACITY - ofs);
+			memcpy(this->ring->data + ofs, str, first);
+			memcpy(this->ring->data, str + first, len - first);
+
+			this->pos += len;
+		}
+
+		LogRing* ring;
+		size_t pos;
+		size_t limit;
+		bool overflow;
+	};
+
+	LogRing* getLogRing();
+	uint64_t getLogDropped();
+
+	// `fmt` is either a normal format string or a compiled one ("..."_fmt).
+	template <typename Fmt, typename... Args>
+	void logMessage(int fd, const Fmt& fmt, Args&&... args)
+	{
+		if(not g_logging.load(std::memory_order_relaxed))
+		{
+			// earlier zpr::println()s may still be sitting in stdio's buffer; if not, this costs nothing.
+			fflush(fd == STDERR_FILENO ? stderr : stdout);
+			zpr::dprintln(fd, fmt, static_cast<Args&&>(args)...);
+			return;
+		}
+
+		auto ring = getLogRing();
+		auto head = ring->head.load(std::memory_order_relaxed);
+		auto appender = LogRingAppender {
+			.ring = ring,
+			.pos = head + sizeof(LogRing::Header),
+			.limit = ring->tail.load(std::memory_order_acquire) + LogRing::CAPACITY,
+			.overflow = false,
+		};
+
+		zpr::cprintln(appender, fmt, static_cast<Args&&>(args)...);
+
+		auto next = (appender.pos + 7) & ~size_t(7);
+		if(appender.overflow || next > appender.limit)
+		{
+			ring->dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		auto header = reinterpret_cast<LogRing::Header*>(ring->data + head % LogRing::CAPACITY);
+		header->fd = fd;
+		header->len = static_cast<uint32_t>(appender.pos - head - sizeof(LogRing::Header));
+
+		ring->head.store(next, std::memory_order_release);
+	}
+
+	template <typename Fmt, typename... Args>
+	void logPrintln(const Fmt& fmt, Args&&... args)
+	{
+		logMessage(STDOUT_FILENO, fmt, static_cast<Args&&>(args)...);
+	}
+
+	template <typename Fmt, typename... Args>
+	void logErrorln(const Fmt& fmt, Args&&... args)
+	{
+		logMessage(STDERR_FILENO, fmt, static_cast<Args&&>(args)...);
+	}
+
+	// must be called on the thread that runs the event loop, since that's the one whose ring it sets up.
+	void startLogger();
+	void stopLogger();
+}
@@ -0,0 +1,23 @@
+// probes.h
+// Copyright (c) 2022, zhiayang
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// USDT probes (provider "xkeyslug") for bpftrace/perf; see the README for the list and tools/bpftrace
+// for examples. a probe is a single nop until something attaches to it. builds without <sys/sdt.h>
+// (systemtap-sdt-dev), or with -DSLUG_NO_USDT=1, get no probes at all.
+
+#if !defined(SLUG_NO_USDT) && __has_include(<sys/sdt.h>)
+	#include <sys/sdt.h>
+
+	#define SLUG_PROBE0(name)                   DTRACE_PROBE(xkeyslug, name)
+	#define SLUG_PROBE1(name, a)                DTRACE_PROBE1(xkeyslug, name, a)
+	#define SLUG_PROBE2(name, a, b)             DTRACE_PROBE2(xkeyslug, name, a, b)
+	#define SLUG_PROBE3(name, a, b, c)          DTRACE_PROBE3(xkeyslug, name, a, b, c)
+#else
+	#define SLUG_PROBE0(name)                   do { } while(0)
+	#define SLUG_PROBE1(name, a)                do { } while(0)
+	#define SLUG_PROBE2(name, a, b)             do { } while(0)
+	#define SLUG_PROBE3(name, a, b, c)          do { } while(0)
+#endif
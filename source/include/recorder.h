@@ -0,0 +1,105 @@
+// recorder.h
+// Copyright (c) 2022, zhiayang
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include "slug.h"
+
+#include <vector>
+#include <string>
+
+// the flight recorder (--flight-recorder=<path>) keeps the last few MB of input events, remap
+// decisions, focus changes and output events in a memory-mapped ring file, so there's something to
+// look at after "that key got stuck". tools/flightrec.cpp decodes it.
+//
+// the file is a header page followed by fixed-size blocks. each block starts with a sequence number
+// and an absolute timestamp, and records never span blocks, so the decoder can start from any block
+// no matter what was overwritten. a record is a kind byte, a varint delta (in ns) from the previous
+// record in the block, and then varints specific to the kind.
+
+namespace slug
+{
+	enum class RecordKind : uint8_t
+	{
+		Input   = 1,    // type, code, zigzag(value)
+		Output  = 2,    // type, code, zigzag(value)
+		Remap   = 3,    // from, to
+		Combo   = 4,    // code
+		Focus   = 5,    // length, wm_class, length, title
+	};
+
+	struct RecorderFileHeader
+	{
+		static constexpr char MAGIC[8] = { 'x', 'k', 's', 'l', 'u', 'g', 'f', 'r' };
+		static constexpr uint32_t VERSION = 1;
+
+		char magic[8];
+		uint32_t version;
+		uint32_t block_size;
+		uint64_t num_blocks;
+	};
+
+	struct RecorderBlockHeader
+	{
+		uint64_t seq;               // 0 if never written
+		uint64_t base_mono_ns;
+		uint64_t base_real_ns;
+		uint32_t used;              // bytes of records after this header
+		uint32_t reserved;
+	};
+
+	struct FlightRecorder
+	{
+		static constexpr size_t HEADER_SIZE = 4096;
+		static constexpr size_t BLOCK_SIZE = 4096;
+		static constexpr size_t DEFAULT_BLOCKS = 1024;
+
+		static constexpr size_t MAX_STRING = 96;
+
+		// reopens (and continues) an existing recording if the geometry matches.
+		static FlightRecorder* open(const char* path, size_t num_blocks = DEFAULT_BLOCKS);
+		~FlightRecorder();
+
+		void input(unsigned int type, unsigned int code, int value);
+		void output(unsigned int type, unsigned int code, int value);
+		void remap(keycode_t from, keycode_t to);
+		void combo(keycode_t code);
+		void focus(std::string_view wm_class, std::string_view title);
+
+	private:
+		FlightRecorder() = default;
+
+		void append(RecordKind kind, const uint8_t* payload, size_t len);
+		void start_block(uint64_t now);
+		RecorderBlockHeader* block(uint64_t seq);
+
+		uint8_t* m_map = nullptr;
+		size_t m_map_size = 0;
+		size_t m_num_blocks = 0;
+
+		uint64_t m_seq = 0;
+		uint64_t m_last_ns = 0;
+	};
+
+	// null if not recording.
+	extern FlightRecorder* g_flightRecorder;
+
+	struct DecodedRecord
+	{
+		RecordKind kind;
+		uint64_t mono_ns;
+		uint64_t real_ns;
+
+		// Input/Output: type, code, value; Remap: code -> value; Combo: code
+		unsigned int type;
+		unsigned int code;
+		int value;
+
+		std::string wm_class;
+		std::string title;
+	};
+
+	// in order, oldest first.
+	bool decodeFlightRecording(const char* path, std::vector<DecodedRecord>* out);
+}
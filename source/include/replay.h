@@ -0,0 +1,61 @@
+// replay.h
+// Copyright (c) 2022, zhiayang
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include "slug.h"
+
+#include <vector>
+
+#include <linux/input.h>
+
+// running the remapping logic without a keyboard, uinput or an X server: recorded input events go
+// through handleInputEvent, the focused window comes from a recorded timeline, and the output is
+// collected in memory. used by tools/replay.cpp.
+
+namespace slug
+{
+	struct MemorySink : EventSink
+	{
+		virtual void write(const struct input_event* events, size_t count) override;
+
+		// stamped onto every event that gets written (the kernel would do this for uinput).
+		struct timeval now {};
+		std::vector<struct input_event> events;
+	};
+
+	// the focused window over time. the file has one line per focus (or title) change:
+	//   <seconds>.<microseconds> <wm_class> <title...>
+	// where a wm_class of "-" means none. before the first line, no window is focused.
+	struct TimelineFocus : FocusProvider
+	{
+		bool load(const char* path);
+		void setTime(const struct timeval& time);
+
+		virtual const WindowInfo& getCurrentWindowInfo() override;
+
+	private:
+		struct Entry
+		{
+			uint64_t time_us;
+			WindowInfo info;
+		};
+
+		std::vector<Entry> m_timeline;
+		size_t m_current = 0;
+		bool m_started = false;
+		WindowInfo m_none {};
+	};
+
+	// a file of raw input_events, as read from /dev/input/eventN.
+	std::vector<struct input_event> readEventFile(const char* path);
+
+	// the same events as text, one "<sec>.<usec> <type> <code> <value>" line each (which is also what
+	// xkeyslug-replay prints); blank lines and lines starting with '#' are skipped. returns false if
+	// the file can't be read or a line doesn't parse.
+	bool readEventText(const char* path, std::vector<struct input_event>* out);
+
+	// each output event gets the timestamp of the input event that caused it.
+	void replayEvents(std::span<const struct input_event> input, TimelineFocus* focus, MemorySink* sink);
+}
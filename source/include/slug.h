@@ -15,6 +15,10 @@
 #include <unistd.h>
 #include <sys/stat.h>
 
+#include <span>
+#include <atomic>
+#include <thread>
+#include <vector>
 #include <utility>
 #include <string_view>
 #include <unordered_set>
@@ -23,11 +27,15 @@
 
 #include <X11/Xlib.h>
 
+struct input_event;
 struct libevdev;
 struct libevdev_uinput;
 
 namespace slug
 {
+	// "..."_fmt, for format strings parsed at compile time.
+	using namespace zpr::literals;
+
 	using keycode_t = unsigned int;
 
 	enum class KeyAction
@@ -38,11 +46,52 @@ namespace slug
 	};
 
 
+	// where a UInputDevice's events end up: normally a uinput device, but the replay tool and
+	// the benchmarks use files or memory instead (see replay.h).
+	struct EventSink
+	{
+		virtual ~EventSink() = default;
+		virtual void write(const struct input_event* events, size_t count) = 0;
+
+		// the underlying fd, if there is one.
+		virtual int fd() const { return -1; }
+	};
+
+	struct UInputSink : EventSink
+	{
+		UInputSink(struct libevdev* based_on);
+
+		// a device that another instance created and handed over (see handoff.h).
+		explicit UInputSink(int uinput_fd);
+		~UInputSink();
+
+		virtual void write(const struct input_event* events, size_t count) override;
+		virtual int fd() const override;
+
+		// after this, the device outlives us; it's someone else's to destroy.
+		void release();
+
+	private:
+		struct libevdev_uinput* m_uinput = nullptr;
+		int m_fd = -1;
+		bool m_released = false;
+	};
+
+	// the sysfs fnmode control for the keyboard behind `evdev_fd`; returns -1 if there isn't one
+	// (eg. not a macbook). if it has to be searched for, the result (even "none") is cached per keyboard.
+	int openFnModeControl(int evdev_fd);
+
 	struct UInputDevice
 	{
-		UInputDevice(struct libevdev* based_on);
+		UInputDevice(EventSink* sink, int fn_control_fd = -1);
 		~UInputDevice();
 
+		// if `batch` is set, events are collected and only handed to the sink on flush();
+		// otherwise each one is written as soon as it is sent.
+		void setSink(EventSink* sink, bool batch = false);
+		EventSink* getSink() const;
+		void flush();
+
 		void changeFnKeyState(KeyAction action);
 
 		// note: syncs by default. always returns true (kek)
@@ -61,24 +110,183 @@ namespace slug
 		void unpress(keycode_t key);
 		bool isPressed(keycode_t key) const;
 
+		// for handing over to (or taking over from) another instance; see handoff.h.
+		const std::unordered_set<keycode_t>& getModifiers() const;
+		const std::unordered_set<keycode_t>& getRealModifiers() const;
+		void restoreModifiers(std::span<const keycode_t> modifiers, std::span<const keycode_t> real_modifiers);
+
+		// the most events a batching sink is given in one write().
+		static constexpr size_t MAX_BATCH = 64;
+
 	private:
+		void write_event(unsigned int type, unsigned int code, int value);
+
 		int m_fn_control_fd;
-		struct libevdev_uinput* m_uinput;
+		EventSink* m_sink;
+
+		// sysfs writes into hid-apple can be slow, so they happen on m_fn_thread. m_fn_mode is the
+		// last mode asked for (0 if none yet), and m_fn_wanted is what the thread should write next.
+		int m_fn_mode = 0;
+		bool m_fn_warned = false;
+		std::atomic<int> m_fn_wanted = 0;
+		std::thread m_fn_thread;
+
+		bool m_batching = false;
+		size_t m_batch_len = 0;
+		struct input_event* m_batch = nullptr;
+
 		std::unordered_set<keycode_t> m_modifiers;
 		std::unordered_set<keycode_t> m_real_modifiers;
 	};
 
-	void loop(struct libevdev* device_ev);
-
-	bool matchWindowClass(Display* x_display, std::string_view window_class);
+	// bits in WindowInfo::title_profiles; see g_titlePatterns in mapping.cpp.
+	enum TitleProfile : uint32_t
+	{
+		TITLE_VIM       = (1 << 0),
+	};
 
 	struct WindowInfo
 	{
 		std::string wm_name;
 		std::string wm_class;
+
+		// which of the title patterns matched wm_name; only recomputed when the title changes.
+		uint32_t title_profiles = 0;
+	};
+
+	// where processKeyEvent finds out which window is focused; normally X11, but the replay
+	// tool plays back a recorded timeline instead (see replay.h).
+	struct FocusProvider
+	{
+		virtual ~FocusProvider() = default;
+
+		// the returned reference is valid until the next call.
+		virtual const WindowInfo& getCurrentWindowInfo() = 0;
 	};
 
-	WindowInfo getCurrentWindowInfo(Display* x_display);
+	struct X11Focus : FocusProvider
+	{
+		X11Focus(Display* x_display);
+
+		virtual const WindowInfo& getCurrentWindowInfo() override;
+
+	private:
+		const WindowInfo& query_focus();
+		void drain_property_events();
+		void refresh_title();
+
+		Display* m_display;
+
+		Atom m_net_wm_name = None;
+		Atom m_utf8_string = None;
+
+		// the class and title of the focused window are cached, and only refetched when focus moves
+		// to a different window or we get a PropertyNotify for its title.
+		Window m_focus = None;          // what XGetInputFocus gave us
+		Window m_window = None;         // the window we actually took the class and title from
+		bool m_title_dirty = false;
+		bool m_changed = false;         // since the last query, for the flight recorder
+		WindowInfo m_info {};
+	};
+
+	bool matchWindowClass(FocusProvider* focus, std::string_view window_class);
+	uint32_t matchWindowTitle(std::string_view title);
+
+	struct Options
+	{
+		// install the unconditional remaps into the device's keymap (see keymap.cpp)
+		bool kernel_remap = false;
+
+		// run the capslock layer in the kernel as a HID-BPF program (see hidbpf.cpp)
+		bool hid_bpf = false;
+
+		// use io_uring for reading and writing events (see iouring.cpp)
+		bool io_uring = false;
+		bool sqpoll = false;
+
+		// after each event, spin for this long before going back to sleep (see busypoll.cpp)
+		uint32_t busy_poll_us = 0;
+
+		// serve latency histograms and counters on this unix socket (see stats.cpp)
+		const char* stats_socket = nullptr;
+
+		// keep a ring of recent events in this file (see recorder.h)
+		const char* flight_recorder = nullptr;
+
+		// write a chrome trace-event json file of the pipeline's spans (see trace.h)
+		const char* trace = nullptr;
+
+		// let a newer instance take over the grabbed device through this socket (see handoff.h)
+		const char* handoff_socket = nullptr;
+	};
+
+	struct LoopStats
+	{
+		uint64_t events = 0;
+		uint64_t ring_enters = 0;
+	};
+
+	struct Takeover;
+
+	// with `takeover`, the device is already grabbed, and the uinput device and key state come from it.
+	void loop(struct libevdev* device_ev, const Options& opts, const Takeover* takeover = nullptr);
+	bool shouldQuit();
+	void requestQuit();
+
+	// readable once requestQuit() has been called; loops wait on it alongside the input.
+	int getQuitFd();
+
+	// for the loops that read through libevdev: usually the same as shouldQuit(), but while handing
+	// over, only once libevdev has nothing buffered and the last event ended a frame, so that the new
+	// instance picks up exactly where we stopped.
+	bool shouldStopReading(struct libevdev* device_ev, bool at_frame_end);
+
+	void handleInputEvent(UInputDevice* uinput, FocusProvider* focus, const struct input_event& event);
+
+	// returns false if io_uring isn't available, in which case nothing was read.
+	bool runUringLoop(struct libevdev* device_ev, UInputDevice* uinput, FocusProvider* focus,
+		const Options& opts, LoopStats* stats);
+
+	// likewise, returns false (without reading anything) if epoll can't be set up.
+	bool runBusyPollLoop(struct libevdev* device_ev, UInputDevice* uinput, FocusProvider* focus,
+		const Options& opts, LoopStats* stats);
+
+	// remaps that depend on neither the window nor any modifiers.
+	struct StaticRemap
+	{
+		keycode_t from;
+		keycode_t to;
+	};
+
+	// remaps that apply while `key` (the physical key) is held, regardless of the window.
+	struct RemapLayer
+	{
+		keycode_t key;
+		std::span<const StaticRemap> remaps;
+	};
+
+	std::span<const StaticRemap> getStaticRemaps();
+	void setStaticRemapsInKernel(bool in_kernel);
+
+	RemapLayer getCapslockLayer();
+
+	bool installKernelRemaps(struct libevdev* device_ev);
+	void restoreKernelRemaps(struct libevdev* device_ev);
+
+	// only does anything when built with HID_BPF=1; see hidbpf.cpp.
+	bool loadHidBpf(int evdev_fd);
+	void unloadHidBpf();
+
+	// keyboard page (0x07) usage for a keycode, or 0 if there isn't one.
+	uint8_t hidUsageForKeycode(keycode_t keycode);
+
+	void processKeyEvent(UInputDevice* uinput, FocusProvider* focus, unsigned int code, KeyAction action);
+
+	// keys that are held down, and what they were remapped to when they were pressed; carried over to a
+	// new instance so that it releases the same key (see handoff.h).
+	std::vector<std::pair<keycode_t, keycode_t>> getHeldRemaps();
+	void restoreHeldRemaps(std::span<const std::pair<keycode_t, keycode_t>> remaps);
 
-	void processKeyEvent(UInputDevice* uinput, Display* x_display, unsigned int code, KeyAction action);
+	// keys that were already down when the keyboard was grabbed; modifiers among them count as held.
+	void seedHeldKeys(UInputDevice* uinput, std::span<const keycode_t> keys);
 }
@@ -0,0 +1,117 @@
+// stats.h
+// Copyright (c) 2022, zhiayang
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include "slug.h"
+
+#include <time.h>
+
+#include <atomic>
+#include <string>
+
+// latency histograms and counters for the input pipeline, served as text over a unix socket
+// (--stats-socket). everything is recorded from the event loop thread and read from the server
+// thread, so it's all relaxed atomics; nothing is recorded unless the server is running.
+
+namespace slug
+{
+	static inline uint64_t monotonicNs()
+	{
+		struct timespec ts {};
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return static_cast<uint64_t>(ts.tv_sec) * 1'000'000'000 + static_cast<uint64_t>(ts.tv_nsec);
+	}
+
+	// log-linear buckets (HDR-style): exact below 16ns, then 16 buckets per power of two, so
+	// any reported value is within ~6% of the real one.
+	struct LatencyHistogram
+	{
+		static constexpr uint64_t SUB_BITS = 4;
+		static constexpr uint64_t SUB_BUCKETS = 1 << SUB_BITS;
+		static constexpr size_t NUM_BUCKETS = (64 - SUB_BITS + 1) * SUB_BUCKETS;
+
+		void record(uint64_t ns)
+		{
+			this->buckets[bucket_for(ns)].fetch_add(1, std::memory_order_relaxed);
+			this->count.fetch_add(1, std::memory_order_relaxed);
+			this->sum_ns.fetch_add(ns, std::memory_order_relaxed);
+
+			// only one thread records, so this doesn't need to be a cas loop.
+			if(ns > this->max_ns.load(std::memory_order_relaxed))
+				this->max_ns.store(ns, std::memory_order_relaxed);
+		}
+
+		// the upper bound of the bucket containing the p-th value.
+		uint64_t percentile(double p) const;
+
+		std::atomic<uint64_t> count = 0;
+		std::atomic<uint64_t> sum_ns = 0;
+		std::atomic<uint64_t> max_ns = 0;
+		std::atomic<uint64_t> buckets[NUM_BUCKETS] {};
+
+		static size_t bucket_for(uint64_t ns)
+		{
+			if(ns < SUB_BUCKETS)
+				return ns;
+
+			auto msb = static_cast<uint64_t>(63 - __builtin_clzll(ns));
+			auto sub = (ns >> (msb - SUB_BITS)) & (SUB_BUCKETS - 1);
+			return (msb - SUB_BITS + 1) * SUB_BUCKETS + sub;
+		}
+
+		static uint64_t bucket_max(size_t idx)
+		{
+			if(idx < SUB_BUCKETS)
+				return idx;
+
+			auto msb = idx / SUB_BUCKETS + SUB_BITS - 1;
+			auto sub = idx % SUB_BUCKETS;
+			return ((SUB_BUCKETS + sub + 1) << (msb - SUB_BITS)) - 1;
+		}
+	};
+
+	struct PipelineStats
+	{
+		bool enabled = false;
+
+		LatencyHistogram kernel_to_read;    // input_event.time to handleInputEvent
+		LatencyHistogram read_to_write;     // handleInputEvent to the output being written (or queued)
+		LatencyHistogram focus_query;       // FocusProvider::getCurrentWindowInfo
+
+		std::atomic<uint64_t> events = 0;
+		std::atomic<uint64_t> remaps = 0;
+		std::atomic<uint64_t> combos = 0;
+		std::atomic<uint64_t> syn_dropped = 0;
+	};
+
+	extern PipelineStats g_stats;
+
+	static inline void countStat(std::atomic<uint64_t>& counter)
+	{
+		if(g_stats.enabled)
+			counter.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	// per-rule counters (see RuleId in mapping.cpp); each gets its own cache line. total_ns only
+	// grows while the stats server is running.
+	struct alignas(64) RuleCounter
+	{
+		std::atomic<uint64_t> hits = 0;
+		std::atomic<uint64_t> total_ns = 0;
+	};
+
+	size_t getNumRules();
+	const char* getRuleName(size_t id);
+	const RuleCounter& getRuleCounter(size_t id);
+
+	// only formats into a stack buffer and write()s, so it's safe to call from a signal handler.
+	void dumpRuleStats(int fd);
+
+	// appends the prometheus-style text to `out`.
+	void formatStats(zpr::arena_buffer& out);
+
+	bool startStatsServer(const char* path);
+	void stopStatsServer();
+}
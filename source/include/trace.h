@@ -0,0 +1,57 @@
+// trace.h
+// Copyright (c) 2022, zhiayang
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include "slug.h"
+
+#include <atomic>
+
+// --trace=<path> records begin/end spans for the main steps of the pipeline into a buffer per thread,
+// and a background thread writes them out as Chrome trace-event JSON (which ui.perfetto.dev and
+// chrome://tracing both open). span names must be string literals, since only the pointer is kept.
+
+namespace slug
+{
+	extern std::atomic<bool> g_tracing;
+
+	void traceEvent(const char* name, char phase);
+
+	static inline void traceBegin(const char* name)
+	{
+		if(g_tracing.load(std::memory_order_relaxed))
+			traceEvent(name, 'B');
+	}
+
+	static inline void traceEnd(const char* name)
+	{
+		if(g_tracing.load(std::memory_order_relaxed))
+			traceEvent(name, 'E');
+	}
+
+	struct TraceSpan
+	{
+		TraceSpan(const char* name) : m_name(name), m_active(g_tracing.load(std::memory_order_relaxed))
+		{
+			if(m_active)
+				traceEvent(m_name, 'B');
+		}
+
+		~TraceSpan()
+		{
+			if(m_active)
+				traceEvent(m_name, 'E');
+		}
+
+		TraceSpan(const TraceSpan&) = delete;
+		TraceSpan& operator= (const TraceSpan&) = delete;
+
+	private:
+		const char* m_name;
+		bool m_active;
+	};
+
+	bool startTracing(const char* path);
+	void stopTracing();
+}
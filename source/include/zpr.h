@@ -16,34 +16,14 @@
 
 
 
-	detail::print_floating and detail::print_exponent are adapted from _ftoa and _etoa
-	from https://github.com/mpaland/printf, which is licensed under the MIT license,
-	reproduced below:
-
-	Copyright Marco Paland (info@paland.com), 2014-2019, PALANDesign Hannover, Germany
-
-	Permission is hereby granted, free of charge, to any person obtaining a copy
-	of this software and associated documentation files (the "Software"), to deal
-	in the Software without restriction, including without limitation the rights
-	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
-	copies of the Software, and to permit persons to whom the Software is
-	furnished to do so, subject to the following conditions:
-
-	The above copyright notice and this permission notice shall be included in
-	all copies or substantial portions of the Software.
-
-	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
-	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
-	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
-	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
-	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
-	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
-	THE SOFTWARE.
+	The shortest floating-point representation (detail::fp::shortest) is adapted from Ryu
+	(https://github.com/ulfjack/ryu), by Ulf Adams, which is licensed under the Apache License,
+	Version 2.0 (same as above).
 */
 
 
 /*
-	Version 2.5.7
+	Version 2.9.1
 	=============
 
 
@@ -64,7 +44,8 @@
 	zpr::println("{<spec>}", argument);
 
 	where `<spec>` is exactly a `printf`-style format specifier (note: there is no leading colon unlike the fmtlib/python style),
-	and where the final type specifier (eg. `s`, `d`) is optional. Floating point values will print as if `g` was used. Size
+	and where the final type specifier (eg. `s`, `d`) is optional. Floating point values without a specifier or precision print
+	the shortest string that round-trips (like std::to_chars); with only a precision they print as if `g` was used. Size
 	specifiers (eg. `lld`) are not supported. Variable width and precision specifiers (eg. `%.*s`) are not supported.
 
 	The currently supported builtin formatters are:
@@ -105,10 +86,26 @@
 		this is *TRUE* by default. controls whether we use a lookup table to increase the speed of
 		decimal printing. this uses 201 bytes.
 
+	- ZPR_DECIMAL_LOOKUP_TABLE_LARGE
+		this is *FALSE* by default. if enabled, decimal printing uses a table of 4-digit groups
+		instead, which takes the number of divisions down by half again, but uses 40000 bytes. this
+		takes precedence over ZPR_DECIMAL_LOOKUP_TABLE.
+
 	- ZPR_HEXADECIMAL_LOOKUP_TABLE
 		this is *TRUE* by default. controls whether we use a lookup table to increase the speed of
 		hex printing. this uses 1025 bytes.
 
+	- ZPR_COMPILED_FORMAT
+		this is *TRUE* by default if the compiler supports consteval and class-type template parameters
+		(ie. C++20). controls whether the "..."_fmt literal (see below) is available.
+
+	- ZPR_FD_OUTPUT
+		this is *TRUE* by default if ZPR_FREESTANDING is off and <unistd.h> and <sys/uio.h> exist.
+		controls whether dprint() and dprintln() are available. fprint() copies into a buffer, then
+		into the FILE's own buffer (under its lock), and a following fflush() makes the syscall;
+		dprint() skips the second copy and the lock, and always makes exactly one syscall per call,
+		where a long line through fprint() costs one write() per 4096 bytes.
+
 	- ZPR_FREESTANDING
 		this is *FALSE by default; controls whether or not a standard library implementation is
 		available. if not, then the following changes are made:
@@ -170,6 +167,23 @@
 	* only available if ZPR_FREESTANDING != 0: print to the specified FILE*, followed by a newline '\n'.
 	size_t fprintln(FILE* file, tt::str_view fmt, Args&&... args);
 
+	* only available if ZPR_FREESTANDING == 0: append to an arena_buffer, which grows as needed and
+	* keeps its memory across reset(), so reusing one doesn't allocate once it is big enough.
+	size_t sprint(arena_buffer& buf, tt::str_view fmt, Args&&... args);
+
+	* only available if ZPR_FD_OUTPUT != 0: print straight to a file descriptor, without going
+	* through stdio. the output is collected on the stack and written with a single write(), or
+	* one writev() when a large piece (eg. a long string argument) would not fit.
+	size_t dprint(int fd, tt::str_view fmt, Args&&... args);
+
+	* only available if ZPR_FD_OUTPUT != 0: print to the file descriptor, followed by a newline '\n'.
+	size_t dprintln(int fd, tt::str_view fmt, Args&&... args);
+
+	* only available if ZPR_COMPILED_FORMAT != 0: parse a format string literal at compile time. all of
+	* the functions above accept the result in place of `fmt`; the number of arguments is checked at
+	* compile time, and only the literal text and the values are printed at runtime.
+	auto operator""_fmt();     (in namespace zpr::literals)
+
 	* similar to sprint(), but it is meant to be used as an argument to an "outer" call to another
 	* print function; the purpose is to avoid an unnecessary round-trip through a std::string.
 	auto fwd(tt::str_view fmt, Args&&... args);
@@ -211,6 +225,13 @@
 	#define ZPR_DECIMAL_LOOKUP_TABLE 1
 #endif
 
+#if !defined(ZPR_DECIMAL_LOOKUP_TABLE_LARGE)
+	#define ZPR_DECIMAL_LOOKUP_TABLE_LARGE 0
+#elif (ZPR_EXPAND(ZPR_DECIMAL_LOOKUP_TABLE_LARGE) == 1)
+	#undef ZPR_DECIMAL_LOOKUP_TABLE_LARGE
+	#define ZPR_DECIMAL_LOOKUP_TABLE_LARGE 1
+#endif
+
 #if !defined(ZPR_HEXADECIMAL_LOOKUP_TABLE)
 	#define ZPR_HEXADECIMAL_LOOKUP_TABLE 1
 #elif (ZPR_EXPAND(ZPR_HEXADECIMAL_LOOKUP_TABLE) == 1)
@@ -218,6 +239,33 @@
 	#define ZPR_HEXADECIMAL_LOOKUP_TABLE 1
 #endif
 
+#if !defined(ZPR_FD_OUTPUT)
+	#if !ZPR_FREESTANDING && defined(__has_include)
+		#if __has_include(<unistd.h>) && __has_include(<sys/uio.h>)
+			#define ZPR_FD_OUTPUT 1
+		#endif
+	#endif
+
+	#if !defined(ZPR_FD_OUTPUT)
+		#define ZPR_FD_OUTPUT 0
+	#endif
+#elif (ZPR_EXPAND(ZPR_FD_OUTPUT) == 1)
+	#undef ZPR_FD_OUTPUT
+	#define ZPR_FD_OUTPUT 1
+#endif
+
+// compiled format strings ("..."_fmt) need consteval and class-type template parameters.
+#if !defined(ZPR_COMPILED_FORMAT)
+	#if defined(__cpp_consteval) && defined(__cpp_nontype_template_args) && (__cpp_nontype_template_args >= 201911L)
+		#define ZPR_COMPILED_FORMAT 1
+	#else
+		#define ZPR_COMPILED_FORMAT 0
+	#endif
+#elif (ZPR_EXPAND(ZPR_COMPILED_FORMAT) == 1)
+	#undef ZPR_COMPILED_FORMAT
+	#define ZPR_COMPILED_FORMAT 1
+#endif
+
 #if !defined(ZPR_USE_STD)
 	#define ZPR_USE_STD 1
 #elif (ZPR_EXPAND(ZPR_USE_STD) == 1)
@@ -229,6 +277,14 @@
 #if !ZPR_FREESTANDING
 	#include <cstdio>
 	#include <cstring>
+
+	#include <cstdlib>
+
+	#if ZPR_FD_OUTPUT
+		#include <cerrno>
+		#include <unistd.h>
+		#include <sys/uio.h>
+	#endif
 #else
 	#if defined(ZPR_USE_STD)
 		#undef ZPR_USE_STD
@@ -486,19 +542,19 @@ namespace zpr::tt
 	{
 		using value_type = char;
 
-		str_view() : ptr(nullptr), len(0) { }
-		str_view(const char* p, size_t l) : ptr(p), len(l) { }
+		constexpr str_view() : ptr(nullptr), len(0) { }
+		constexpr str_view(const char* p, size_t l) : ptr(p), len(l) { }
 
 		template <size_t _Number>
-		str_view(const char (&s)[_Number]) : ptr(s), len(_Number - 1) { }
+		constexpr str_view(const char (&s)[_Number]) : ptr(s), len(_Number - 1) { }
 
 		template <typename _Type, typename = tt::enable_if_t<tt::is_same_v<const char*, _Type>>>
 		str_view(_Type s) : ptr(s), len(strlen(s)) { }
 
-		str_view(str_view&&) = default;
-		str_view(const str_view&) = default;
-		str_view& operator= (str_view&&) = default;
-		str_view& operator= (const str_view&) = default;
+		constexpr str_view(str_view&&) = default;
+		constexpr str_view(const str_view&) = default;
+		constexpr str_view& operator= (str_view&&) = default;
+		constexpr str_view& operator= (const str_view&) = default;
 
 		inline bool operator== (const str_view& other) const
 		{
@@ -511,22 +567,22 @@ namespace zpr::tt
 			return !(*this == other);
 		}
 
-		inline const char* begin() const { return this->ptr; }
-		inline const char* end() const { return this->ptr + len; }
+		constexpr const char* begin() const { return this->ptr; }
+		constexpr const char* end() const { return this->ptr + len; }
 
-		inline size_t size() const { return this->len; }
-		inline bool empty() const { return this->len == 0; }
-		inline const char* data() const { return this->ptr; }
+		constexpr size_t size() const { return this->len; }
+		constexpr bool empty() const { return this->len == 0; }
+		constexpr const char* data() const { return this->ptr; }
 
-		inline char operator[] (size_t n) { return this->ptr[n]; }
+		constexpr char operator[] (size_t n) { return this->ptr[n]; }
 
-		inline str_view drop(size_t n) const { return (this->size() >= n ? this->substr(n, this->size() - n) : ""); }
-		inline str_view take(size_t n) const { return (this->size() >= n ? this->substr(0, n) : *this); }
-		inline str_view take_last(size_t n) const { return (this->size() >= n ? this->substr(this->size() - n, n) : *this); }
-		inline str_view drop_last(size_t n) const { return (this->size() >= n ? this->substr(0, this->size() - n) : *this); }
+		constexpr str_view drop(size_t n) const { return (this->size() >= n ? this->substr(n, this->size() - n) : ""); }
+		constexpr str_view take(size_t n) const { return (this->size() >= n ? this->substr(0, n) : *this); }
+		constexpr str_view take_last(size_t n) const { return (this->size() >= n ? this->substr(this->size() - n, n) : *this); }
+		constexpr str_view drop_last(size_t n) const { return (this->size() >= n ? this->substr(0, this->size() - n) : *this); }
 
-		inline str_view& remove_prefix(size_t n) { return (*this = this->drop(n)); }
-		inline str_view& remove_suffix(size_t n) { return (*this = this->drop_last(n)); }
+		constexpr str_view& remove_prefix(size_t n) { return (*this = this->drop(n)); }
+		constexpr str_view& remove_suffix(size_t n) { return (*this = this->drop_last(n)); }
 
 		[[nodiscard]] inline str_view take_prefix(size_t n)
 		{
@@ -553,7 +609,7 @@ namespace zpr::tt
 			return -1;
 		}
 
-		inline str_view substr(size_t pos, size_t cnt) const { return str_view(this->ptr + pos, cnt); }
+		constexpr str_view substr(size_t pos, size_t cnt) const { return str_view(this->ptr + pos, cnt); }
 
 
 	#if ZPR_USE_STD
@@ -755,7 +811,8 @@ namespace zpr
 		template <>
 		struct is_iterable<tt::str_view> : tt::true_type { };
 
-		static inline format_args parse_fmt_spec(tt::str_view sv)
+		// constexpr so that compiled format strings (see operator""_fmt) can use it too.
+		constexpr format_args parse_fmt_spec(tt::str_view sv)
 		{
 			// remove the first and last (they are { and })
 			sv = sv.drop(1).drop_last(1);
@@ -777,10 +834,7 @@ namespace zpr
 					break;
 				}
 
-				if(sv.empty())
-					goto done;
-
-				if('0' <= sv[0] && sv[0] <= '9')
+				if(!sv.empty() && '0' <= sv[0] && sv[0] <= '9')
 				{
 					fmt_args.flags |= FMT_FLAG_HAVE_WIDTH;
 
@@ -793,9 +847,6 @@ namespace zpr
 					sv.remove_prefix(k);
 				}
 
-				if(sv.empty())
-					goto done;
-
 				if(sv.size() >= 2 && sv[0] == '.')
 				{
 					sv.remove_prefix(1);
@@ -826,7 +877,6 @@ namespace zpr
 					fmt_args.specifier = sv[0];
 			}
 
-		done:
 			return fmt_args;
 		}
 
@@ -861,493 +911,1130 @@ namespace zpr
 		template <typename _CallbackFn>
 		size_t print_special_floating(_CallbackFn& cb, double value, format_args args)
 		{
-			// uwu. apparently, `inf` and `nan` are never truncated.
+			// uwu. apparently, `inf` and `nan` are never truncated, or padded with zeroes.
 			args.set_precision(999);
+			args.flags &= ~FMT_FLAG_ZERO_PAD;
 
-			if(value != value)
-				return print_string(cb, "nan", 3, static_cast<format_args&&>(args));
+			uint64_t bits = 0;
+			memcpy(&bits, &value, sizeof(double));
 
-			if(value < -DBL_MAX)
-				return print_string(cb, "-inf", 4, static_cast<format_args&&>(args));
+			// like printf, nan gets a sign too.
+			char buf[4] = { };
+			size_t len = 0;
+			if(bits >> 63)                  buf[len++] = '-';
+			else if(args.prepend_plus())    buf[len++] = '+';
+			else if(args.prepend_space())   buf[len++] = ' ';
 
-			if(value > DBL_MAX)
-			{
-				return print_string(cb, args.prepend_plus()
-					? "+inf" : args.prepend_space()
-					? " inf" : "inf",
-					args.prepend_space() || args.prepend_plus() ? 4 : 3,
-					static_cast<format_args&&>(args)
-				);
-			}
+			bool upper = (args.specifier == 'F' || args.specifier == 'E' || args.specifier == 'G');
+			memcpy(buf + len, (value != value)
+				? (upper ? "NAN" : "nan")
+				: (upper ? "INF" : "inf"), 3);
 
-			return 0;
+			return print_string(cb, buf, len + 3, static_cast<format_args&&>(args));
 		}
 
 
 
 
-		// forward declare these
-		template <typename _CallbackFn>
-		size_t print_floating(_CallbackFn& cb, double value, format_args args);
-
-		template <typename _Type>
-		char* print_decimal_integer(char* buf, size_t bufsz, _Type value);
+		/*
+			Decimal integers. The number of digits is worked out first (from the bit width, see below), so the digits
+			can be written straight into place from the last one back, without a temporary buffer or a reverse. The
+			digits come from a table, two at a time (ZPR_DECIMAL_LOOKUP_TABLE), four at a time (with the 40kb table,
+			ZPR_DECIMAL_LOOKUP_TABLE_LARGE), or one at a time without either.
+		*/
+		enum class decimal_table { none, pairs, quads };
 
+		constexpr decimal_table DECIMAL_TABLE = ZPR_DECIMAL_LOOKUP_TABLE_LARGE
+			? decimal_table::quads : ZPR_DECIMAL_LOOKUP_TABLE
+			? decimal_table::pairs : decimal_table::none;
 
+		constexpr const char DECIMAL_PAIRS[] =
+			"000102030405060708091011121314151617181920212223242526272829"
+			"303132333435363738394041424344454647484950515253545556575859"
+			"606162636465666768697071727374757677787980818283848586878889"
+			"90919293949596979899";
 
-		template <typename _CallbackFn>
-		size_t print_exponent(_CallbackFn& cb, double value, format_args args)
+		// a template, so that the table only exists if something uses it.
+		template <typename _Dummy = void>
+		struct decimal_quads
 		{
-			constexpr int DEFAULT_PRECISION = 6;
-
-			// check for NaN and special values
-			if((value != value) || (value > DBL_MAX) || (value < -DBL_MAX))
-				return print_special_floating(cb, value, static_cast<format_args&&>(args));
-
-			int prec = (args.have_precision() ? static_cast<int>(args.precision) : DEFAULT_PRECISION);
-
-			bool use_precision  = args.have_precision();
-			bool use_zero_pad   = args.zero_pad() && args.positive_width();
-			bool use_right_pad  = !use_zero_pad && args.negative_width();
-			// bool use_left_pad   = !use_zero_pad && args.positive_width();
-
-			// determine the sign
-			const bool negative = (value < 0);
-			if(negative)
-				value = -value;
+			struct table_t
+			{
+				constexpr table_t() : digits()
+				{
+					for(int i = 0; i < 10000; i++)
+					{
+						digits[i * 4 + 0] = static_cast<char>('0' + i / 1000);
+						digits[i * 4 + 1] = static_cast<char>('0' + (i / 100) % 10);
+						digits[i * 4 + 2] = static_cast<char>('0' + (i / 10) % 10);
+						digits[i * 4 + 3] = static_cast<char>('0' + i % 10);
+					}
+				}
 
-			// determine the decimal exponent
-			// based on the algorithm by David Gay (https://www.ampl.com/netlib/fp/dtoa.c)
-			union {
-				uint64_t U;
-				double F;
-			} conv;
+				char digits[40000];
+			};
 
-			conv.F = value;
-			auto exp2 = static_cast<int64_t>((conv.U >> 52U) & 0x07FFU) - 1023; // effectively log2
-			conv.U = (conv.U & ((1ULL << 52U) - 1U)) | (1023ULL << 52U);        // drop the exponent so conv.F is now in [1,2)
+			static constexpr table_t table { };
+		};
 
-			// now approximate log10 from the log2 integer part and an expansion of ln around 1.5
-			auto expval = static_cast<int64_t>(0.1760912590558 + exp2 * 0.301029995663981 + (conv.F - 1.5) * 0.289529654602168);
+		constexpr uint64_t POW10_64[20] = {
+			1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull, 100000000ull, 1000000000ull,
+			10000000000ull, 100000000000ull, 1000000000000ull, 10000000000000ull, 100000000000000ull,
+			1000000000000000ull, 10000000000000000ull, 100000000000000000ull, 1000000000000000000ull,
+			10000000000000000000ull,
+		};
 
-			// now we want to compute 10^expval but we want to be sure it won't overflow
-			exp2 = static_cast<int64_t>(expval * 3.321928094887362 + 0.5);
+		// how many digits `value` has (0 has 1). 1233/4096 is just above log10(2), so the guess from the bit
+		// width is either right or one short, and one compare with a power of 10 tells which.
+		inline size_t count_decimal_digits(uint64_t value)
+		{
+			value |= 1;
 
-			const double z = expval * 2.302585092994046 - exp2 * 0.6931471805599453;
-			const double z2 = z * z;
+		#if defined(__GNUC__) || defined(__clang__)
+			auto bits = static_cast<size_t>(64 - __builtin_clzll(value));
+		#else
+			size_t bits = 0;
+			for(auto v = value; v > 0; v >>= 1)
+				bits++;
+		#endif
 
-			conv.U = static_cast<uint64_t>(exp2 + 1023) << 52U;
+			auto guess = (bits * 1233) >> 12;
+			return guess + (value >= POW10_64[guess] ? 1 : 0);
+		}
 
-			// compute exp(z) using continued fractions, see https://en.wikipedia.org/wiki/Exponential_function#Continued_fractions_for_ex
-			conv.F *= 1 + 2 * z / (2 - z + (z2 / (6 + (z2 / (10 + z2 / 14)))));
+		// writes `value` into [out, out + n), zero-padded on the left; it has to fit.
+		template <decimal_table _Table = DECIMAL_TABLE>
+		void write_decimal(char* out, uint64_t value, size_t n)
+		{
+			char* ptr = out + n;
 
-			// correct for rounding errors
-			if(value < conv.F)
+			// 8 digits at a time with one 64-bit division, and the rest with 32-bit ones.
+			while(value >= 100000000)
 			{
-				expval--;
-				conv.F /= 10;
-			}
-
-			// the exponent format is "%+02d" and largest value is "307", so set aside 4-5 characters (including the e+ part)
-			int minwidth = (-100 < expval && expval < 100) ? 4U : 5U;
+				auto low = static_cast<uint32_t>(value % 100000000);
+				value /= 100000000;
 
-			// in "%g" mode, "prec" is the number of *significant figures* not decimals
-			if(args.specifier == 'g' || args.specifier == 'G')
-			{
-				// do we want to fall-back to "%f" mode?
-				if((value >= 1e-4) && (value < 1e6))
+				if constexpr (_Table == decimal_table::quads)
 				{
-					if(static_cast<int64_t>(prec) > expval)
-						prec = static_cast<uint64_t>(static_cast<int64_t>(prec) - expval - 1);
-
-					else
-						prec = 0;
-
-					args.precision = prec;
-
-					// no characters in exponent
-					minwidth = 0;
-					expval = 0;
+					memcpy(ptr - 4, &decimal_quads<>::table.digits[(low % 10000) * 4], 4);
+					memcpy(ptr - 8, &decimal_quads<>::table.digits[(low / 10000) * 4], 4);
+				}
+				else if constexpr (_Table == decimal_table::pairs)
+				{
+					for(int i = 1; i <= 4; i++, low /= 100)
+						memcpy(ptr - 2 * i, &DECIMAL_PAIRS[(low % 100) * 2], 2);
 				}
 				else
 				{
-					// we use one sigfig for the whole part
-					if(prec > 0 && use_precision)
-						prec -= 1;
+					for(int i = 1; i <= 8; i++, low /= 10)
+						*(ptr - i) = static_cast<char>('0' + low % 10);
 				}
+
+				ptr -= 8;
 			}
 
-			// will everything fit?
-			uint64_t fwidth = args.width;
-			if(args.width > minwidth)
+			auto v = static_cast<uint32_t>(value);
+			if constexpr (_Table == decimal_table::quads)
 			{
-				// we didn't fall-back so subtract the characters required for the exponent
-				fwidth -= minwidth;
+				for(; ptr - out >= 4; v /= 10000)
+					memcpy((ptr -= 4), &decimal_quads<>::table.digits[(v % 10000) * 4], 4);
+
+				// 0 to 3 left, which are the tail of v's entry.
+				auto left = static_cast<size_t>(ptr - out);
+				memcpy(out, &decimal_quads<>::table.digits[v * 4 + (4 - left)], left);
 			}
-			else
+			else if constexpr (_Table == decimal_table::pairs)
 			{
-				// not enough characters, so go back to default sizing
-				fwidth = 0;
-			}
+				for(; ptr - out >= 2; v /= 100)
+					memcpy((ptr -= 2), &DECIMAL_PAIRS[(v % 100) * 2], 2);
 
-			if(use_right_pad && minwidth)
+				if(ptr > out)
+					*out = static_cast<char>('0' + v);
+			}
+			else
 			{
-				// if we're padding on the right, DON'T pad the floating part
-				fwidth = 0;
+				for(; ptr > out; v /= 10)
+					*(--ptr) = static_cast<char>('0' + v % 10);
 			}
+		}
 
-			// rescale the float value
-			if(expval)
-				value /= conv.F;
-
-			// output the floating part
-
-			auto args_copy = args;
-			args_copy.width = fwidth;
-			auto len = static_cast<int64_t>(print_floating(cb, negative ? -value : value, args_copy));
-
-			// output the exponent part
-			if(minwidth > 0)
+		// the magnitude of `value`, negated in unsigned so that the most negative value works too.
+		template <typename _Type>
+		uint64_t decimal_magnitude(_Type value)
+		{
+			auto mag = static_cast<uint64_t>(value);
+			if constexpr (tt::is_signed_v<_Type>)
 			{
-				len++;
-				if(args.specifier & 0x20)   cb('e');
-				else                        cb('E');
-
-				// output the exponent value
-				char digits_buf[8] = { };
-				size_t digits_len = 0;
+				if(value < 0)
+					mag = 0 - mag;
+			}
 
-				auto buf = print_decimal_integer(digits_buf, 8, static_cast<int64_t>(tt::_Absolute(expval)));
-				digits_len = 8 - (buf - digits_buf);
+			return mag;
+		}
 
-				len += digits_len + 1;
-				cb(expval < 0 ? '-' : '+');
+		// prints into the end of [buf, buf + bufsz), and returns where the digits start.
+		template <typename _Type>
+		char* print_decimal_integer(char* buf, size_t bufsz, _Type value)
+		{
+			static_assert(sizeof(_Type) <= 8);
 
-				// zero-pad to minwidth - 2
-				if(auto tmp = (minwidth - 2) - static_cast<int>(digits_len); tmp > 0)
-					len += tmp, cb('0', tmp);
+			auto mag = decimal_magnitude(value);
+			auto len = count_decimal_digits(mag);
 
-				cb(buf, digits_len);
+			char* ptr = buf + bufsz - len;
+			write_decimal(ptr, mag, len);
 
-				// might need to right-pad spaces
-				if(use_right_pad && args.width > len)
-					cb(' ', args.width - len), len = args.width;
+			if constexpr (tt::is_signed_v<_Type>)
+			{
+				if(value < 0)
+					*(--ptr) = '-';
 			}
 
-			return len;
+			return ptr;
 		}
 
 
-		template <typename _CallbackFn>
-		size_t print_floating(_CallbackFn& cb, double value, format_args args)
+
+		/*
+			Floating point printing. With a precision or a specifier ('{f}', '{.3e}', '{g}', ...), values are printed
+			from their exact binary value and rounded half-to-even, so the output matches glibc's printf. With
+			neither ('{}'), the shortest string that reads back as the same value is printed, choosing between
+			fixed and scientific notation like std::to_chars does.
+
+			The shortest representation is computed with Ryu (https://github.com/ulfjack/ryu, by Ulf Adams; Apache 2.0),
+			using the "small table" variant: the 125-bit powers of 5 are rebuilt from every 26th entry plus a 2-bit
+			correction, instead of the ~10kb of full tables. This needs a 128-bit integer type; without one, '{}' prints
+			like '{g}'.
+		*/
+		namespace fp
 		{
-			constexpr int DEFAULT_PRECISION = 6;
-			constexpr size_t MAX_BUFFER_LEN = 128;
-			constexpr long double EXPONENTIAL_CUTOFF = 1e15;
+			// value = mantissa * 10^exponent
+			struct decimal
+			{
+				uint64_t mantissa;
+				int32_t exponent;
+			};
 
-			char buf[MAX_BUFFER_LEN] = { 0 };
+			// ceil(log2(5^e)), floor(log10(2^e)) and floor(log10(5^e)), for the ranges that doubles need.
+			constexpr int32_t pow5_bits(int32_t e) { return static_cast<int32_t>((static_cast<uint32_t>(e) * 1217359) >> 19) + 1; }
+			constexpr uint32_t log10_pow2(int32_t e) { return (static_cast<uint32_t>(e) * 78913) >> 18; }
+			constexpr uint32_t log10_pow5(int32_t e) { return (static_cast<uint32_t>(e) * 732923) >> 20; }
 
-			size_t len = 0;
+			constexpr int32_t POW5_BITCOUNT = 125;
+			constexpr int32_t POW5_INV_BITCOUNT = 125;
+			constexpr uint32_t POW5_TABLE_SIZE = 26;
 
-			int prec = (args.have_precision() ? static_cast<int>(args.precision) : DEFAULT_PRECISION);
-
-			bool use_zero_pad   = args.zero_pad() && args.positive_width();
-			bool use_left_pad   = !use_zero_pad && args.positive_width();
-			bool use_right_pad  = !use_zero_pad && args.negative_width();
-
-			// powers of 10
-			constexpr double pow10[] = {
-				1,
-				10,
-				100,
-				1000,
-				10000,
-				100000,
-				1000000,
-				10000000,
-				100000000,
-				1000000000,
-				10000000000,
-				100000000000,
-				1000000000000,
-				10000000000000,
-				100000000000000,
-				1000000000000000,
-				10000000000000000,
+			constexpr uint64_t POW5_TABLE[POW5_TABLE_SIZE] = {
+				1ull, 5ull, 25ull, 125ull, 625ull, 3125ull, 15625ull, 78125ull, 390625ull, 1953125ull, 9765625ull,
+				48828125ull, 244140625ull, 1220703125ull, 6103515625ull, 30517578125ull, 152587890625ull,
+				762939453125ull, 3814697265625ull, 19073486328125ull, 95367431640625ull, 476837158203125ull,
+				2384185791015625ull, 11920928955078125ull, 59604644775390625ull, 298023223876953125ull,
 			};
 
-			// test for special values
-			if((value != value) || (value > DBL_MAX) || (value < -DBL_MAX))
-				return print_special_floating(cb, value, static_cast<format_args&&>(args));
+			// 5^(26i), truncated to 125 bits; { low, high }
+			constexpr uint64_t POW5_SPLIT[13][2] = {
+				{ 0x0000000000000000ull, 0x1000000000000000ull },
+				{ 0x0000000000000000ull, 0x14ADF4B7320334B9ull },
+				{ 0x0E549208B31ADB10ull, 0x1ABA4714957D300Dull },
+				{ 0x6DC6AD264D8F0866ull, 0x1145B7E285BF98F5ull },
+				{ 0xEB1DBD923D8596CAull, 0x1652EFDC6018A1FCull },
+				{ 0xB4C1B80B22AE923Cull, 0x1CDA62055B2D9D83ull },
+				{ 0x5BB28B4E8F7E4C30ull, 0x12A5568B9F52F416ull },
+				{ 0xF08AED437682D4FBull, 0x1819651531F9E78Full },
+				{ 0xB4EE134AD99BF150ull, 0x1F25C186A6F04C28ull },
+				{ 0x16499ECB70C25F03ull, 0x1420EB449C8842E6ull },
+				{ 0x85A56EAD360865B0ull, 0x1A03FDE214CAF085ull },
+				{ 0x093DB1D57999890Bull, 0x10CFEB353A97DAD8ull },
+				{ 0xCF38BB735E3F36ACull, 0x15BAAF44FA52673Eull },
+			};
 
-			// switch to exponential for large values.
-			if((value > EXPONENTIAL_CUTOFF) || (value < -EXPONENTIAL_CUTOFF))
-				return print_exponent(cb, value, static_cast<format_args&&>(args));
+			// floor(2^(pow5_bits(26i) - 1 + 125) / 5^(26i)); { low, high }
+			constexpr uint64_t POW5_INV_SPLIT[13][2] = {
+				{ 0x0000000000000000ull, 0x2000000000000000ull },
+				{ 0x52A6C95FC0655033ull, 0x18C240C4AECB13BBull },
+				{ 0x7CA8D50071DFC805ull, 0x1327FC58DA0F6FF5ull },
+				{ 0x6520247D3556476Dull, 0x1DA48CE468E7C702ull },
+				{ 0x6139CDD76802E6E8ull, 0x16EF5B40C2FC7779ull },
+				{ 0xF951A7FF43DE8C78ull, 0x11BEBDF578B2F391ull },
+				{ 0x7BE8BEE8D6E957E7ull, 0x1B758D848FAC54B0ull },
+				{ 0x8BD3F9E999A423E9ull, 0x153EDA614071A3B7ull },
+				{ 0x0848F973CB3EE3CDull, 0x10701BD527B4978Cull },
+				{ 0x153285EBB9EFBFA1ull, 0x196FBB9BB44DB44Dull },
+				{ 0xADEEE7F86C07B695ull, 0x13AE3591F5B4D936ull },
+				{ 0x4D686A4EAF182221ull, 0x1E74404F3DAADA91ull },
+				{ 0x98C0A106E09EBD9Eull, 0x17900EA4FDA7C257ull },
+			};
 
-			// default to g.
-			if(args.specifier == -1)
-				args.specifier = 'g';
+			// what to add to the rebuilt entries to get the exact ones, 2 bits each.
+			constexpr uint32_t POW5_OFFSETS[21] = {
+				0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x40000000, 0x59695995,
+				0x55545555, 0x56555515, 0x41150504, 0x40555410, 0x44555145, 0x44504540,
+				0x45555550, 0x40004000, 0x96440440, 0x55565565, 0x54454045, 0x40154151,
+				0x55559155, 0x51405555, 0x00000105,
+			};
 
-			// test for negative
-			const bool negative = (value < 0);
-			if(value < 0)
-				value = -value;
+			constexpr uint32_t POW5_INV_OFFSETS[19] = {
+				0xA9A99AA9, 0x595AAA9A, 0x65596555, 0x55955969, 0x95565555, 0x966AAAAA,
+				0x555559A9, 0x55565599, 0x95555555, 0x99555596, 0xA59A99A5, 0xAAAA55A9,
+				0xA6BAAAA9, 0x95559555, 0x56555556, 0x55565A55, 0xA6A6A966, 0x5AAAAAA9,
+				0x00000055,
+			};
 
-			// limit precision to 16, cause a prec >= 17 can lead to overflow errors
-			while((len < MAX_BUFFER_LEN) && (prec > 16))
+			inline uint32_t pow5_factor(uint64_t value)
 			{
-				buf[len++] = '0';
-				prec--;
+				uint32_t count = 0;
+				while(value > 0 && value % 5 == 0)
+					value /= 5, count++;
+
+				return count;
 			}
 
-			auto whole = static_cast<int64_t>(value);
-			auto tmp = (value - whole) * pow10[prec];
-			auto frac = static_cast<unsigned long>(tmp);
+			inline bool multiple_of_pow5(uint64_t value, uint32_t p) { return pow5_factor(value) >= p; }
+			inline bool multiple_of_pow2(uint64_t value, uint32_t p) { return (value & ((1ull << p) - 1)) == 0; }
 
-			double diff = tmp - frac;
+		#if defined(__SIZEOF_INT128__)
+			__extension__ typedef unsigned __int128 uint128_t;
 
-			if(diff > 0.5)
+			// 5^i, truncated to 125 bits.
+			inline void compute_pow5(uint32_t i, uint64_t* result)
 			{
-				frac += 1;
-
-				// handle rollover, e.g. case 0.99 with prec 1 is 1.0
-				if(frac >= pow10[prec])
-				{
-					frac = 0;
-					whole += 1;
-				}
+				auto base = i / POW5_TABLE_SIZE;
+				auto base2 = base * POW5_TABLE_SIZE;
+				auto mul = POW5_SPLIT[base];
+				auto m = POW5_TABLE[i - base2];
+
+				auto b0 = static_cast<uint128_t>(m) * mul[0];
+				auto b2 = static_cast<uint128_t>(m) * mul[1];
+				auto delta = static_cast<uint32_t>(pow5_bits(static_cast<int32_t>(i)) - pow5_bits(static_cast<int32_t>(base2)));
+				auto sum = (b0 >> delta) + (b2 << (64 - delta)) + ((POW5_OFFSETS[i / 16] >> ((i % 16) << 1)) & 3);
+
+				result[0] = static_cast<uint64_t>(sum);
+				result[1] = static_cast<uint64_t>(sum >> 64);
 			}
-			else if(diff < 0.5)
+
+			// 2^(pow5_bits(i) - 1 + 125) / 5^i, rounded up.
+			inline void compute_inv_pow5(uint32_t i, uint64_t* result)
 			{
-				// ?
+				auto base = (i + POW5_TABLE_SIZE - 1) / POW5_TABLE_SIZE;
+				auto base2 = base * POW5_TABLE_SIZE;
+				auto mul = POW5_INV_SPLIT[base];
+				auto m = POW5_TABLE[base2 - i];
+
+				auto b0 = static_cast<uint128_t>(m) * mul[0];
+				auto b2 = static_cast<uint128_t>(m) * mul[1];
+				auto delta = static_cast<uint32_t>(pow5_bits(static_cast<int32_t>(base2)) - pow5_bits(static_cast<int32_t>(i)));
+				auto sum = (b0 >> delta) + (b2 << (64 - delta)) + ((POW5_INV_OFFSETS[i / 16] >> ((i % 16) << 1)) & 3);
+
+				result[0] = static_cast<uint64_t>(sum);
+				result[1] = static_cast<uint64_t>(sum >> 64);
 			}
-			else if((frac == 0U) || (frac & 1U))
+
+			inline uint64_t mul_shift(uint64_t m, const uint64_t* mul, int32_t j)
 			{
-				// if halfway, round up if odd OR if last digit is 0
-				frac += 1;
+				auto b0 = static_cast<uint128_t>(m) * mul[0];
+				auto b2 = static_cast<uint128_t>(m) * mul[1];
+				return static_cast<uint64_t>(((b0 >> 64) + b2) >> (j - 64));
 			}
 
-			if(prec == 0U)
+			/*
+				The core of Ryu: finds the shortest decimal in the interval of values that round to m2 * 2^e2 (where
+				e2 already includes the extra -2 from the paper). `mm_shift` is set unless the value is a power of 2
+				with a normal exponent, where the gap to the next smaller value is half as big.
+
+				Works for both floats and doubles, since float mantissas and exponents are a subset.
+			*/
+			inline decimal shortest(uint64_t m2, int32_t e2, bool mm_shift)
 			{
-				diff = value - static_cast<double>(whole);
-				if((!(diff < 0.5) || (diff > 0.5)) && (whole & 1))
+				const bool accept_bounds = (m2 & 1) == 0;
+				const uint64_t mv = 4 * m2;
+				const uint64_t mm_offset = 1 + (mm_shift ? 1 : 0);
+
+				uint64_t vr = 0;
+				uint64_t vp = 0;
+				uint64_t vm = 0;
+				int32_t e10 = 0;
+
+				bool vm_trailing_zeros = false;
+				bool vr_trailing_zeros = false;
+
+				if(e2 >= 0)
 				{
-					// exactly 0.5 and ODD, then round up
-					// 1.5 -> 2, but 2.5 -> 2
-					whole += 1;
-				}
-			}
-			else
-			{
-				auto count = prec;
+					const uint32_t q = log10_pow2(e2) - (e2 > 3);
+					const int32_t k = POW5_INV_BITCOUNT + pow5_bits(static_cast<int32_t>(q)) - 1;
+					const int32_t i = -e2 + static_cast<int32_t>(q) + k;
+					e10 = static_cast<int32_t>(q);
 
-				bool flag = (args.specifier == 'g' || args.specifier == 'G');
-				// now do fractional part, as an unsigned number
-				while(len < MAX_BUFFER_LEN)
+					uint64_t mul[2];
+					compute_inv_pow5(q, mul);
+
+					vr = mul_shift(mv, mul, i);
+					vp = mul_shift(mv + 2, mul, i);
+					vm = mul_shift(mv - mm_offset, mul, i);
+
+					// only one of mp, mv and mm can be a multiple of 5, if any; and past 5^21 none of them are.
+					if(q <= 21)
+					{
+						if(mv % 5 == 0)         vr_trailing_zeros = multiple_of_pow5(mv, q);
+						else if(accept_bounds)  vm_trailing_zeros = multiple_of_pow5(mv - mm_offset, q);
+						else                    vp -= multiple_of_pow5(mv + 2, q);
+					}
+				}
+				else
 				{
-					if(flag && (frac % 10) == 0)
-						goto skip;
+					const uint32_t q = log10_pow5(-e2) - (-e2 > 1);
+					const int32_t i = -e2 - static_cast<int32_t>(q);
+					const int32_t k = pow5_bits(i) - POW5_BITCOUNT;
+					const int32_t j = static_cast<int32_t>(q) - k;
+					e10 = static_cast<int32_t>(q) + e2;
 
-					flag = false;
-					buf[len++] = static_cast<char>('0' + (frac % 10));
+					uint64_t mul[2];
+					compute_pow5(static_cast<uint32_t>(i), mul);
 
-				skip:
-					count -= 1;
-					if(!(frac /= 10))
-						break;
+					vr = mul_shift(mv, mul, j);
+					vp = mul_shift(mv + 2, mul, j);
+					vm = mul_shift(mv - mm_offset, mul, j);
+
+					if(q <= 1)
+					{
+						// mv = 4 * m2, so it always has at least two trailing zero bits.
+						vr_trailing_zeros = true;
+						if(accept_bounds)   vm_trailing_zeros = mm_shift;
+						else                vp--;
+					}
+					else if(q < 63)
+					{
+						vr_trailing_zeros = multiple_of_pow2(mv, q);
+					}
 				}
 
-				// add extra 0s
-				while((len < MAX_BUFFER_LEN) && (count-- > 0))
-					buf[len++] = '0';
+				int32_t removed = 0;
+				uint64_t output = 0;
 
-				// add decimal
-				if(len < MAX_BUFFER_LEN)
-					buf[len++] = '.';
-			}
+				if(vm_trailing_zeros || vr_trailing_zeros)
+				{
+					// the rare case, where an interval bound (or the value itself) is exactly representable.
+					uint64_t last_removed = 0;
+					while(vp / 10 > vm / 10)
+					{
+						vm_trailing_zeros &= (vm % 10 == 0);
+						vr_trailing_zeros &= (last_removed == 0);
+						last_removed = vr % 10;
+						vr /= 10, vp /= 10, vm /= 10;
+						removed++;
+					}
 
-			// do whole part, number is reversed
-			while(len < MAX_BUFFER_LEN)
-			{
-				buf[len++] = static_cast<char>('0' + (whole % 10));
-				if(!(whole /= 10))
-					break;
-			}
+					if(vm_trailing_zeros)
+					{
+						while(vm % 10 == 0)
+						{
+							vr_trailing_zeros &= (last_removed == 0);
+							last_removed = vr % 10;
+							vr /= 10, vp /= 10, vm /= 10;
+							removed++;
+						}
+					}
 
-			// pad leading zeros
-			if(use_zero_pad)
-			{
-				auto width = args.width;
+					// exactly halfway; round to even.
+					if(vr_trailing_zeros && last_removed == 5 && vr % 2 == 0)
+						last_removed = 4;
+
+					output = vr + ((vr == vm && (!accept_bounds || !vm_trailing_zeros)) || last_removed >= 5);
+				}
+				else
+				{
+					bool round_up = false;
+					if(vp / 100 > vm / 100)
+					{
+						round_up = (vr % 100 >= 50);
+						vr /= 100, vp /= 100, vm /= 100;
+						removed += 2;
+					}
+
+					while(vp / 10 > vm / 10)
+					{
+						round_up = (vr % 10 >= 5);
+						vr /= 10, vp /= 10, vm /= 10;
+						removed++;
+					}
 
-				if(args.have_width() != 0 && (negative || args.prepend_plus() || args.prepend_space()))
-					width--;
+					output = vr + (vr == vm || round_up);
+				}
 
-				while((len < static_cast<size_t>(width)) && (len < MAX_BUFFER_LEN))
-					buf[len++] = '0';
+				return decimal { output, e10 + removed };
 			}
 
-			if(len < MAX_BUFFER_LEN)
+			// both need to be finite and non-zero.
+			inline decimal shortest(double value)
 			{
-				if(negative)
-					buf[len++] = '-';
+				uint64_t bits = 0;
+				memcpy(&bits, &value, sizeof(double));
 
-				else if(args.prepend_plus())
-					buf[len++] = '+'; // ignore the space if the '+' exists
+				auto mantissa = bits & ((1ull << 52) - 1);
+				auto exponent = static_cast<int32_t>((bits >> 52) & 0x7FF);
 
-				else if(args.prepend_space())
-					buf[len++] = ' ';
-			}
+				auto m2 = (exponent == 0 ? mantissa : (mantissa | (1ull << 52)));
+				auto e2 = (exponent == 0 ? 1 : exponent) - 1023 - 52 - 2;
 
-			// reverse it.
-			for(size_t i = 0; i < len / 2; i++)
-				tt::swap(buf[i], buf[len - i - 1]);
+				return shortest(m2, e2, mantissa != 0 || exponent <= 1);
+			}
 
-			auto padding_width = tt::_Maximum(int64_t(0), args.width - static_cast<int64_t>(len));
+			inline decimal shortest(float value)
+			{
+				uint32_t bits = 0;
+				memcpy(&bits, &value, sizeof(float));
 
-			if(use_left_pad) cb(' ', padding_width);
-			if(use_zero_pad) cb('0', padding_width);
+				auto mantissa = bits & ((1u << 23) - 1);
+				auto exponent = static_cast<int32_t>((bits >> 23) & 0xFF);
 
-			cb(buf, len);
+				auto m2 = (exponent == 0 ? mantissa : (mantissa | (1u << 23)));
+				auto e2 = (exponent == 0 ? 1 : exponent) - 127 - 23 - 2;
 
-			if(use_right_pad)
-				cb(' ', padding_width);
+				return shortest(m2, e2, mantissa != 0 || exponent <= 1);
+			}
+		#endif
 
-			return len + ((use_left_pad || use_right_pad) ? padding_width : 0);
-		}
 
 
-		template <typename _Type>
-		char* print_hex_integer(char* buf, size_t bufsz, _Type value)
-		{
-			static_assert(sizeof(_Type) <= 8);
+			// just enough of an arbitrary-precision integer to print doubles exactly: the integer part of DBL_MAX is
+			// 1024 bits, and the fraction of the smallest denormal has 1074 bits (which we multiply by up to 10^9).
+			struct bigint
+			{
+				static constexpr size_t MAX_WORDS = 36;
 
-		#if ZPR_HEXADECIMAL_LOOKUP_TABLE
-			constexpr const char lookup_table[] =
-				"000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f"
-				"202122232425262728292a2b2c2d2e2f303132333435363738393a3b3c3d3e3f"
-				"404142434445464748494a4b4c4d4e4f505152535455565758595a5b5c5d5e5f"
-				"606162636465666768696a6b6c6d6e6f707172737475767778797a7b7c7d7e7f"
-				"808182838485868788898a8b8c8d8e8f909192939495969798999a9b9c9d9e9f"
-				"a0a1a2a3a4a5a6a7a8a9aaabacadaeafb0b1b2b3b4b5b6b7b8b9babbbcbdbebf"
-				"c0c1c2c3c4c5c6c7c8c9cacbcccdcecfd0d1d2d3d4d5d6d7d8d9dadbdcdddedf"
-				"e0e1e2e3e4e5e6e7e8e9eaebecedeeeff0f1f2f3f4f5f6f7f8f9fafbfcfdfeff";
-		#endif
+				// x << shift
+				void set(uint64_t x, size_t shift)
+				{
+					this->len = 0;
+					if(x == 0)
+						return;
 
-			constexpr auto hex_digit = [](int x) -> char {
-				if(0 <= x && x <= 9)
-					return '0' + x;
+					auto w = shift / 32;
+					auto b = shift % 32;
+					for(size_t i = 0; i < w; i++)
+						this->words[i] = 0;
 
-				return 'a' + x - 10;
-			};
+					auto lo = x << b;
+					auto hi = (b == 0 ? 0 : x >> (64 - b));
+					this->words[w + 0] = static_cast<uint32_t>(lo);
+					this->words[w + 1] = static_cast<uint32_t>(lo >> 32);
+					this->words[w + 2] = static_cast<uint32_t>(hi);
 
-			char* ptr = buf + bufsz;
+					this->len = w + 3;
+					this->trim();
+				}
 
-			// if we have the lookup table, do two digits at a time.
-		#if ZPR_HEXADECIMAL_LOOKUP_TABLE
+				void mul_small(uint32_t x)
+				{
+					uint64_t carry = 0;
+					for(size_t i = 0; i < this->len; i++)
+					{
+						carry += static_cast<uint64_t>(this->words[i]) * x;
+						this->words[i] = static_cast<uint32_t>(carry);
+						carry >>= 32;
+					}
 
-			constexpr auto copy = [](char* dst, const char* src) {
-				memcpy(dst, src, 2);
-			};
+					if(carry > 0)
+						this->words[this->len++] = static_cast<uint32_t>(carry);
+				}
 
-			if constexpr (sizeof(_Type) > 1)
-			{
-				while(value >= 0x100)
+				// divides in place, and returns the remainder.
+				uint32_t divmod_small(uint32_t x)
 				{
-					copy((ptr -= 2), &lookup_table[(value & 0xFF) * 2]);
-					value /= static_cast<_Type>(0x100);
+					uint64_t rem = 0;
+					for(size_t i = this->len; i-- > 0; )
+					{
+						rem = (rem << 32) | this->words[i];
+						this->words[i] = static_cast<uint32_t>(rem / x);
+						rem %= x;
+					}
+
+					this->trim();
+					return static_cast<uint32_t>(rem);
 				}
-			}
 
-			if(value < 0x10)
-				*(--ptr) = hex_digit(static_cast<int>(value));
+				// returns (this >> shift), which has to fit in 32 bits, and keeps only the bits below `shift`.
+				uint32_t take_high(size_t shift)
+				{
+					auto w = shift / 32;
+					auto b = shift % 32;
+					if(w >= this->len)
+						return 0;
 
-			else
-				copy((ptr -= 2), &lookup_table[value * 2]);
+					uint64_t top = this->words[w];
+					if(w + 1 < this->len)
+						top |= static_cast<uint64_t>(this->words[w + 1]) << 32;
 
-		#else
+					this->words[w] &= static_cast<uint32_t>((1ull << b) - 1);
+					this->len = w + 1;
+					this->trim();
 
-			do {
-				*(--ptr) = hex_digit(value & 0xF);
-				value /= 0x10;
+					return static_cast<uint32_t>(top >> b);
+				}
 
-			} while(value > 0);
+				bool is_zero() const { return this->len == 0; }
 
-		#endif
+				void trim()
+				{
+					while(this->len > 0 && this->words[this->len - 1] == 0)
+						this->len--;
+				}
 
-			return ptr;
-		}
+				uint32_t words[MAX_WORDS];
+				size_t len = 0;
+			};
 
-		template <typename _Type>
-		char* print_binary_integer(char* buf, size_t bufsz, _Type value)
-		{
-			char* ptr = buf + bufsz;
+			// how the digits that were cut off compare to half of the last digit that was kept.
+			enum class rest { zero, below_half, half, above_half };
 
-			do {
-				*(--ptr) = ('0' + (value & 1));
-				value >>= 1;
+			// the fraction is `num / 2^shift`.
+			inline rest classify(const bigint& num, size_t shift)
+			{
+				if(num.is_zero())
+					return rest::zero;
 
-			} while(value > 0);
+				auto w = (shift - 1) / 32;
+				auto b = (shift - 1) % 32;
+				if(w >= num.len)
+					return rest::below_half;
 
-			return ptr;
-		}
+				bool lower = (num.words[w] & ((1u << b) - 1)) != 0;
+				for(size_t i = 0; i < w && !lower; i++)
+					lower = (num.words[i] != 0);
 
-		template <typename _Type>
-		char* print_decimal_integer(char* buf, size_t bufsz, _Type value)
-		{
-			static_assert(sizeof(_Type) <= 8);
+				if((num.words[w] >> b) & 1)
+					return lower ? rest::above_half : rest::half;
 
-		#if ZPR_DECIMAL_LOOKUP_TABLE
-			constexpr const char lookup_table[] =
-				"000102030405060708091011121314151617181920212223242526272829"
-				"303132333435363738394041424344454647484950515253545556575859"
-				"606162636465666768697071727374757677787980818283848586878889"
-				"90919293949596979899";
-		#endif
+				return rest::below_half;
+			}
 
-			bool neg = false;
-			if constexpr (tt::is_signed_v<_Type>)
+			// same, but the cut-off part is the digits in [digits, digits + n), followed by a fraction; n > 0.
+			inline rest classify(const char* digits, size_t n, bool fraction_nonzero)
 			{
-				neg = (value < 0);
-				if(neg)
-					value = -value;
+				bool lower = fraction_nonzero;
+				for(size_t i = 1; i < n && !lower; i++)
+					lower = (digits[i] != '0');
+
+				if(digits[0] > '5')         return rest::above_half;
+				else if(digits[0] == '5')   return lower ? rest::above_half : rest::half;
+				else if(digits[0] > '0')    return rest::below_half;
+				else                        return lower ? rest::below_half : rest::zero;
 			}
 
-			char* ptr = buf + bufsz;
-
-			// if we have the lookup table, do two digits at a time.
-		#if ZPR_DECIMAL_LOOKUP_TABLE
-
-			constexpr auto copy = [](char* dst, const char* src) {
-				memcpy(dst, src, 2);
+			constexpr uint32_t POW10_32[10] = {
+				1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
 			};
 
-			while(value >= 100)
+			// writes `count` digits of the fraction `num / 2^shift`, consuming them.
+			inline void fraction_digits(bigint& num, size_t shift, char* out, size_t count)
 			{
-				copy((ptr -= 2), &lookup_table[(value % 100) * 2]);
-				value /= 100;
-			}
+				while(count > 0)
+				{
+					if(num.is_zero())
+					{
+						memset(out, '0', count);
+						return;
+					}
 
-			if(value < 10)
-				*(--ptr) = static_cast<char>(value + '0');
+					auto n = tt::_Minimum(count, size_t(9));
+					num.mul_small(POW10_32[n]);
 
-			else
-				copy((ptr -= 2), &lookup_table[value * 2]);
+					write_decimal(out, num.take_high(shift), n);
 
-		#else
+					out += n;
+					count -= n;
+				}
+			}
 
-			do {
-				*(--ptr) = ('0' + (value % 10));
-				value /= 10;
+			// the integer part of m * 2^e, and the fraction left over (as num / 2^*shift).
+			inline size_t integer_digits(char* out, uint64_t m, int32_t e, bigint* frac, size_t* shift)
+			{
+				uint64_t small = 0;
+				frac->set(0, 0);
+				*shift = 0;
 
-			} while(value > 0);
+				if(e >= 0 && e <= 11)
+				{
+					small = m << e;
+				}
+				else if(e > 11)
+				{
+					// up to 309 digits; 9 at a time, from the bottom.
+					bigint big;
+					big.set(m, static_cast<size_t>(e));
 
-		#endif
+					uint32_t chunks[40];
+					size_t num_chunks = 0;
+					while(!big.is_zero())
+						chunks[num_chunks++] = big.divmod_small(1000000000);
 
-			if(neg)
-				*(--ptr) = '-';
+					auto len = count_decimal_digits(chunks[num_chunks - 1]);
+					write_decimal(out, chunks[num_chunks - 1], len);
+
+					for(size_t i = num_chunks - 1; i-- > 0; len += 9)
+						write_decimal(out + len, chunks[i], 9);
+
+					return len;
+				}
+				else if(-e < 64)
+				{
+					small = m >> -e;
+					frac->set(m & ((1ull << -e) - 1), 0);
+					*shift = static_cast<size_t>(-e);
+				}
+				else
+				{
+					frac->set(m, 0);
+					*shift = static_cast<size_t>(-e);
+				}
+
+				if(small == 0)
+					return 0;
+
+				auto len = count_decimal_digits(small);
+				write_decimal(out, small, len);
+
+				return len;
+			}
+
+			// adds one to the last digit; returns true if it carried out of the first one (which leaves all zeroes).
+			inline bool increment(char* digits, size_t n)
+			{
+				for(size_t i = n; i-- > 0; )
+				{
+					if(digits[i] != '9')
+					{
+						digits[i]++;
+						return false;
+					}
+
+					digits[i] = '0';
+				}
+
+				return true;
+			}
+
+			inline bool should_round_up(rest r, char last_digit)
+			{
+				return r == rest::above_half || (r == rest::half && ((last_digit - '0') & 1));
+			}
+
+			// the exact value has at most 767 significant digits and 1074 fraction digits, so anything past this
+			// is zeroes, and doesn't need to be generated.
+			constexpr size_t MAX_EXACT_DIGITS = 1100;
+			constexpr size_t EXACT_BUFFER_SIZE = 1 + 309 + MAX_EXACT_DIGITS + 16;
+
+			struct exact_digits
+			{
+				char* digits;           // no sign and no point
+				size_t len;
+				size_t int_len;         // fixed: how many of `digits` come before the point
+				int32_t exp10;          // scientific: the exponent of the first digit
+				size_t zeros;           // trailing zeroes after `digits`
+			};
+
+			inline void decompose(double value, uint64_t* m, int32_t* e)
+			{
+				uint64_t bits = 0;
+				memcpy(&bits, &value, sizeof(double));
+
+				auto mantissa = bits & ((1ull << 52) - 1);
+				auto exponent = static_cast<int32_t>((bits >> 52) & 0x7FF);
+
+				*m = (exponent == 0 ? mantissa : (mantissa | (1ull << 52)));
+				*e = (exponent == 0 ? 1 : exponent) - 1023 - 52;
+			}
+
+			// `prec` digits after the point. `buf` needs EXACT_BUFFER_SIZE bytes; the first is kept free for a carry.
+			inline exact_digits fixed(char* buf, double value, size_t prec)
+			{
+				uint64_t m = 0;
+				int32_t e = 0;
+				decompose(value, &m, &e);
+
+				bigint frac;
+				size_t shift = 0;
+
+				auto out = buf + 1;
+				auto int_len = integer_digits(out, m, e, &frac, &shift);
+
+				auto num_frac = tt::_Minimum(prec, MAX_EXACT_DIGITS);
+				fraction_digits(frac, shift, out + int_len, num_frac);
+
+				auto len = int_len + num_frac;
+				if(should_round_up(classify(frac, shift), len > 0 ? out[len - 1] : '0'))
+				{
+					if(len == 0 || increment(out, len))
+						*(--out) = '1', len++, int_len++;
+				}
+
+				return exact_digits { out, len, int_len, 0, prec - num_frac };
+			}
+
+			// `prec + 1` significant digits.
+			inline exact_digits scientific(char* buf, double value, size_t prec)
+			{
+				auto out = buf + 1;
+				auto want = tt::_Minimum(prec + 1, MAX_EXACT_DIGITS);
+
+				uint64_t m = 0;
+				int32_t e = 0;
+				decompose(value, &m, &e);
+
+				if(m == 0)
+				{
+					memset(out, '0', want);
+					return exact_digits { out, want, 1, 0, prec + 1 - want };
+				}
+
+				bigint frac;
+				size_t shift = 0;
+				int32_t exp10 = 0;
+				rest r = rest::zero;
+
+				auto have = integer_digits(out, m, e, &frac, &shift);
+				if(have > 0)
+				{
+					exp10 = static_cast<int32_t>(have) - 1;
+				}
+				else
+				{
+					// skip the leading zeroes of the fraction, 9 at a time.
+					exp10 = -1;
+					while(true)
+					{
+						fraction_digits(frac, shift, out, 9);
+
+						size_t z = 0;
+						while(z < 9 && out[z] == '0')
+							z++;
+
+						if(z < 9)
+						{
+							memmove(out, out + z, 9 - z);
+							exp10 -= static_cast<int32_t>(z);
+							have = 9 - z;
+							break;
+						}
+
+						exp10 -= 9;
+					}
+				}
+
+				if(have > want)
+				{
+					r = classify(out + want, have - want, !frac.is_zero());
+				}
+				else
+				{
+					fraction_digits(frac, shift, out + have, want - have);
+					r = classify(frac, shift);
+				}
+
+				if(should_round_up(r, out[want - 1]) && increment(out, want))
+					out[0] = '1', exp10++;
+
+				return exact_digits { out, want, 1, exp10, prec + 1 - want };
+			}
+
+
+		#if defined(__SIZEOF_INT128__)
+			// writes `dec` (the shortest form of `value`) as std::to_chars does without a format: fixed or scientific,
+			// whichever is shorter (fixed if it's a tie). like to_chars, large integers print their exact value in fixed
+			// notation, not the shortest digits padded with zeroes. needs at most 32 bytes.
+			inline size_t format_shortest(char* buf, decimal dec, double value)
+			{
+				auto num_digits = static_cast<int32_t>(count_decimal_digits(dec.mantissa));
+
+				auto sci_exp = dec.exponent + num_digits - 1;
+				auto abs_exp = (sci_exp < 0 ? -sci_exp : sci_exp);
+
+				int32_t fixed_len = 0;
+				if(sci_exp >= num_digits - 1)   fixed_len = sci_exp + 1;
+				else if(sci_exp >= 0)           fixed_len = num_digits + 1;
+				else                            fixed_len = num_digits + 1 - sci_exp;
+
+				auto sci_len = num_digits + (num_digits > 1 ? 1 : 0) + 2 + (abs_exp >= 100 ? 3 : 2);
+
+				size_t len = 0;
+				if(fixed_len <= sci_len)
+				{
+					if(sci_exp >= num_digits - 1)
+					{
+						uint64_t m = 0;
+						int32_t e = 0;
+						decompose(value, &m, &e);
+
+						bigint frac;
+						size_t shift = 0;
+						len = integer_digits(buf, m, e, &frac, &shift);
+					}
+					else if(sci_exp >= 0)
+					{
+						// write the digits one place over, then move the integer part back in front of the point.
+						write_decimal(buf + 1, dec.mantissa, num_digits);
+						memmove(buf, buf + 1, sci_exp + 1);
+						buf[sci_exp + 1] = '.';
+						len = num_digits + 1;
+					}
+					else
+					{
+						buf[len++] = '0';
+						buf[len++] = '.';
+						memset(buf + len, '0', -sci_exp - 1), len += -sci_exp - 1;
+						write_decimal(buf + len, dec.mantissa, num_digits), len += num_digits;
+					}
+				}
+				else
+				{
+					write_decimal(buf + 1, dec.mantissa, num_digits);
+					buf[0] = buf[1];
+					len = 1;
+
+					if(num_digits > 1)
+					{
+						buf[1] = '.';
+						len = num_digits + 1;
+					}
+
+					buf[len++] = 'e';
+					buf[len++] = (sci_exp < 0 ? '-' : '+');
+					if(abs_exp >= 100)
+						buf[len++] = static_cast<char>('0' + abs_exp / 100);
+
+					buf[len++] = static_cast<char>('0' + (abs_exp / 10) % 10);
+					buf[len++] = static_cast<char>('0' + abs_exp % 10);
+				}
+
+				return len;
+			}
+		#endif
+		}
+
+		template <typename _CallbackFn>
+		size_t print_float_parts(_CallbackFn& cb, char sign, const char* body, size_t body_len, bool point, const char* frac,
+			size_t frac_len, size_t zeros, const char* tail, size_t tail_len, format_args args)
+		{
+			auto len = static_cast<int64_t>((sign ? 1 : 0) + body_len + (point ? 1 : 0) + frac_len + zeros + tail_len);
+			auto padding = tt::_Maximum(int64_t(0), args.width - len);
+
+			bool zero_pad = args.zero_pad() && args.positive_width();
+
+			if(args.positive_width() && !zero_pad && padding > 0)
+				cb(' ', static_cast<size_t>(padding));
+
+			if(sign)
+				cb(sign);
+
+			if(zero_pad && padding > 0)
+				cb('0', static_cast<size_t>(padding));
+
+			cb(body, body_len);
+			if(point)
+				cb('.');
+
+			if(frac_len > 0)
+				cb(frac, frac_len);
+
+			if(zeros > 0)
+				cb('0', zeros);
+
+			if(tail_len > 0)
+				cb(tail, tail_len);
+
+			if(args.negative_width() && padding > 0)
+				cb(' ', static_cast<size_t>(padding));
+
+			return static_cast<size_t>(len + padding);
+		}
+
+		/*
+			Print a floating-point value according to `args` (see above). `single` says that the value came from a
+			float, which only matters for the shortest representation.
+		*/
+		template <typename _CallbackFn>
+		size_t print_floating(_CallbackFn& cb, double value, format_args args, bool single = false)
+		{
+			constexpr int64_t DEFAULT_PRECISION = 6;
+
+			if((value != value) || (value > DBL_MAX) || (value < -DBL_MAX))
+				return print_special_floating(cb, value, static_cast<format_args&&>(args));
+
+			uint64_t bits = 0;
+			memcpy(&bits, &value, sizeof(double));
+
+			char sign = 0;
+			if(bits >> 63)                  sign = '-', value = -value;
+			else if(args.prepend_plus())    sign = '+';
+			else if(args.prepend_space())   sign = ' ';
+
+			char spec = args.specifier;
+			if(spec != 'f' && spec != 'F' && spec != 'e' && spec != 'E' && spec != 'g' && spec != 'G')
+			{
+			#if defined(__SIZEOF_INT128__)
+				if(!args.have_precision())
+				{
+					char buf[32];
+					size_t len = 1;
+					if(value == 0)  buf[0] = '0';
+					else            len = fp::format_shortest(buf, single ? fp::shortest(static_cast<float>(value)) : fp::shortest(value), value);
+
+					return print_float_parts(cb, sign, buf, len, false, nullptr, 0, 0, nullptr, 0, static_cast<format_args&&>(args));
+				}
+			#else
+				(void) single;
+			#endif
+
+				spec = 'g';
+			}
+
+			auto prec = static_cast<size_t>(args.have_precision() ? tt::_Maximum(int64_t(0), args.precision) : DEFAULT_PRECISION);
+			bool upper = (spec == 'E' || spec == 'G');
+			bool strip_zeros = false;
+
+			char buf[fp::EXACT_BUFFER_SIZE];
+			fp::exact_digits digits { };
+
+			if(spec == 'g' || spec == 'G')
+			{
+				// P significant digits, in fixed notation if the exponent X is in [-4, P), and scientific otherwise.
+				auto p = tt::_Maximum(prec, size_t(1));
+				digits = fp::scientific(buf, value, p - 1);
+
+				auto x = static_cast<int64_t>(digits.exp10);
+				if(x >= -4 && x < static_cast<int64_t>(p))
+				{
+					spec = 'f';
+					digits = fp::fixed(buf, value, static_cast<size_t>(static_cast<int64_t>(p) - 1 - x));
+				}
+				else
+				{
+					spec = 'e';
+				}
+
+				strip_zeros = !args.alternate();
+			}
+			else if(spec == 'f' || spec == 'F')
+			{
+				digits = fp::fixed(buf, value, prec);
+			}
+			else
+			{
+				digits = fp::scientific(buf, value, prec);
+			}
+
+			// everything after the point: [frac, frac + frac_len) and then `zeros` zeroes.
+			const char* body = digits.digits;
+			size_t body_len = (spec == 'f' || spec == 'F') ? digits.int_len : 1;
+
+			const char* frac = digits.digits + body_len;
+			size_t frac_len = digits.len - body_len;
+			size_t zeros = digits.zeros;
+
+			if(strip_zeros)
+			{
+				zeros = 0;
+				while(frac_len > 0 && frac[frac_len - 1] == '0')
+					frac_len--;
+			}
+
+			bool point = (frac_len > 0 || zeros > 0 || args.alternate());
+			if(body_len == 0)
+				body = "0", body_len = 1;
+
+			char tail[8];
+			size_t tail_len = 0;
+			if(spec == 'e' || spec == 'E')
+			{
+				auto x = digits.exp10;
+				tail[tail_len++] = upper ? 'E' : 'e';
+				tail[tail_len++] = (x < 0 ? '-' : '+');
+
+				x = (x < 0 ? -x : x);
+				if(x >= 100)
+					tail[tail_len++] = static_cast<char>('0' + x / 100);
+
+				tail[tail_len++] = static_cast<char>('0' + (x / 10) % 10);
+				tail[tail_len++] = static_cast<char>('0' + x % 10);
+			}
+
+			return print_float_parts(cb, sign, body, body_len, point, frac, frac_len, zeros, tail, tail_len, static_cast<format_args&&>(args));
+		}
 
-			return ptr;
-		}
+
+		template <typename _Type>
+		char* print_hex_integer(char* buf, size_t bufsz, _Type value)
+		{
+			static_assert(sizeof(_Type) <= 8);
+
+		#if ZPR_HEXADECIMAL_LOOKUP_TABLE
+			constexpr const char lookup_table[] =
+				"000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f"
+				"202122232425262728292a2b2c2d2e2f303132333435363738393a3b3c3d3e3f"
+				"404142434445464748494a4b4c4d4e4f505152535455565758595a5b5c5d5e5f"
+				"606162636465666768696a6b6c6d6e6f707172737475767778797a7b7c7d7e7f"
+				"808182838485868788898a8b8c8d8e8f909192939495969798999a9b9c9d9e9f"
+				"a0a1a2a3a4a5a6a7a8a9aaabacadaeafb0b1b2b3b4b5b6b7b8b9babbbcbdbebf"
+				"c0c1c2c3c4c5c6c7c8c9cacbcccdcecfd0d1d2d3d4d5d6d7d8d9dadbdcdddedf"
+				"e0e1e2e3e4e5e6e7e8e9eaebecedeeeff0f1f2f3f4f5f6f7f8f9fafbfcfdfeff";
+		#endif
+
+			constexpr auto hex_digit = [](int x) -> char {
+				if(0 <= x && x <= 9)
+					return '0' + x;
+
+				return 'a' + x - 10;
+			};
+
+			char* ptr = buf + bufsz;
+
+			// if we have the lookup table, do two digits at a time.
+		#if ZPR_HEXADECIMAL_LOOKUP_TABLE
+
+			constexpr auto copy = [](char* dst, const char* src) {
+				memcpy(dst, src, 2);
+			};
+
+			if constexpr (sizeof(_Type) > 1)
+			{
+				while(value >= 0x100)
+				{
+					copy((ptr -= 2), &lookup_table[(value & 0xFF) * 2]);
+					value /= static_cast<_Type>(0x100);
+				}
+			}
+
+			if(value < 0x10)
+				*(--ptr) = hex_digit(static_cast<int>(value));
+
+			else
+				copy((ptr -= 2), &lookup_table[value * 2]);
+
+		#else
+
+			do {
+				*(--ptr) = hex_digit(value & 0xF);
+				value /= 0x10;
+
+			} while(value > 0);
+
+		#endif
+
+			return ptr;
+		}
+
+		template <typename _Type>
+		char* print_binary_integer(char* buf, size_t bufsz, _Type value)
+		{
+			char* ptr = buf + bufsz;
+
+			do {
+				*(--ptr) = ('0' + (value & 1));
+				value >>= 1;
+
+			} while(value > 0);
+
+			return ptr;
+		}
 
 		template <typename _Type>
 		char* print_integer(char* buf, size_t bufsz, _Type value, int base)
@@ -1515,6 +2202,146 @@ namespace zpr
 		}
 
 
+	#if ZPR_COMPILED_FORMAT
+		template <size_t _Number>
+		struct fixed_string
+		{
+			consteval fixed_string(const char (&s)[_Number])
+			{
+				for(size_t i = 0; i < _Number; i++)
+					this->chars[i] = s[i];
+			}
+
+			constexpr size_t size() const { return _Number - 1; }
+
+			char chars[_Number] { };
+		};
+
+		// one of these per argument, plus one for the text after the last argument. the literal text has
+		// already been unescaped, so '{{' and '}}' are just '{' and '}' in `text` -- except after the last
+		// argument, where (as with runtime format strings) the text is printed exactly as written.
+		struct compiled_segment
+		{
+			size_t text_begin = 0;
+			size_t text_len = 0;
+			format_args args { };
+		};
+
+		template <size_t _TextLen, size_t _NumArgs>
+		struct compiled_format_data
+		{
+			char text[_TextLen] { };
+			compiled_segment segments[_NumArgs + 1] { };
+		};
+
+		// never defined; calling these from a consteval function is what makes a bad format string
+		// fail to compile (and the name shows up in the error).
+		void zpr_format_string_has_unterminated_brace();
+
+		template <size_t _Number>
+		consteval size_t count_format_args(const fixed_string<_Number>& str)
+		{
+			size_t count = 0;
+			for(size_t i = 0; i < str.size(); i++)
+			{
+				if(str.chars[i] != '{')
+					continue;
+
+				if(i + 1 < str.size() && str.chars[i + 1] == '{')
+				{
+					i++;
+					continue;
+				}
+
+				while(i < str.size() && str.chars[i] != '}')
+					i++;
+
+				if(i == str.size())
+					zpr_format_string_has_unterminated_brace();
+
+				count++;
+			}
+
+			return count;
+		}
+
+		template <size_t _Number, size_t _NumArgs>
+		consteval compiled_format_data<_Number, _NumArgs> compile_format(const fixed_string<_Number>& str)
+		{
+			compiled_format_data<_Number, _NumArgs> ret { };
+
+			size_t len = 0;
+			size_t seg = 0;
+			for(size_t i = 0; i < str.size(); )
+			{
+				auto c = str.chars[i];
+				if(seg == _NumArgs)
+				{
+					ret.text[len++] = c;
+					i++;
+				}
+				else if((c == '{' || c == '}') && i + 1 < str.size() && str.chars[i + 1] == c)
+				{
+					ret.text[len++] = c;
+					i += 2;
+				}
+				else if(c == '{')
+				{
+					auto k = i;
+					while(str.chars[k] != '}')
+						k++;
+
+					ret.segments[seg].text_len = len - ret.segments[seg].text_begin;
+					ret.segments[seg].args = parse_fmt_spec(tt::str_view(&str.chars[i], k + 1 - i));
+
+					seg++;
+					ret.segments[seg].text_begin = len;
+					i = k + 1;
+				}
+				else
+				{
+					ret.text[len++] = c;
+					i++;
+				}
+			}
+
+			ret.segments[seg].text_len = len - ret.segments[seg].text_begin;
+			return ret;
+		}
+
+		template <fixed_string _Str>
+		struct compiled_format
+		{
+			static constexpr size_t num_args = count_format_args(_Str);
+			static constexpr auto data = compile_format<sizeof(_Str.chars), num_args>(_Str);
+		};
+
+		template <typename _CallbackFn>
+		inline void print_compiled_text(_CallbackFn& cb, const char* text, const compiled_segment& seg)
+		{
+			if(seg.text_len > 0)
+				cb(text + seg.text_begin, seg.text_len);
+		}
+
+		/*
+			Same as `print` above, but the format string was parsed at compile time (see operator""_fmt), so
+			all that's left is to print the literal text between the arguments, and the arguments themselves.
+		*/
+		template <typename _CallbackFn, fixed_string _Str, typename... _Types>
+		void print(_CallbackFn& cb, compiled_format<_Str>, _Types&&... args)
+		{
+			using _Format = compiled_format<_Str>;
+			static_assert(sizeof...(_Types) == _Format::num_args, "number of arguments does not match the format string");
+
+			size_t idx = 0;
+			((print_compiled_text(cb, _Format::data.text, _Format::data.segments[idx]),
+				print_one(cb, _Format::data.segments[idx].args, static_cast<_Types&&>(args)),
+				idx++), ...);
+
+			print_compiled_text(cb, _Format::data.text, _Format::data.segments[idx]);
+		}
+	#endif
+
 		// str_view has a constructor that takes the lvalue-ref-to-array, so this overload should
 		// be strictly unnecessary.
 		#if 0
@@ -1631,6 +2458,142 @@ namespace zpr
 		};
 	#endif
 
+	#if ZPR_FD_OUTPUT
+		// everything goes into `buf`, which is written once at the end. if a piece of at least
+		// Limit / 4 bytes doesn't fit, it is sent together with the buffer in one writev() instead of
+		// being copied; only output that doesn't fit the buffer at all needs more than one syscall.
+		template <size_t Limit, bool Newline>
+		struct fd_appender
+		{
+			fd_appender(int fd, size_t& written) : fd(fd), written(written) { }
+			~fd_appender()
+			{
+				if constexpr (Newline)
+					*ptr++ = '\n';
+
+				flush(nullptr, 0);
+			}
+
+			fd_appender(fd_appender&&) = delete;
+			fd_appender(const fd_appender&) = delete;
+			fd_appender& operator= (fd_appender&&) = delete;
+			fd_appender& operator= (const fd_appender&) = delete;
+
+			inline void operator() (char c)
+			{
+				if(ptr == buf + Limit)
+					flush(nullptr, 0);
+
+				*ptr++ = c;
+			}
+
+			inline void operator() (tt::str_view sv) { (*this)(sv.data(), sv.size()); }
+			inline void operator() (const char* begin, const char* end) { (*this)(begin, static_cast<size_t>(end - begin)); }
+
+			inline void operator() (char c, size_t n)
+			{
+				while(n > 0)
+				{
+					if(ptr == buf + Limit)
+						flush(nullptr, 0);
+
+					auto x = tt::_Minimum(n, remaining());
+					memset(ptr, c, x);
+					ptr += x;
+					n -= x;
+				}
+			}
+
+			inline void operator() (const char* begin, size_t len)
+			{
+				if(len <= remaining())
+				{
+					memcpy(ptr, begin, len);
+					ptr += len;
+					return;
+				}
+				else if(len >= Limit / 4)
+				{
+					flush(begin, len);
+					return;
+				}
+
+				while(len > 0)
+				{
+					if(ptr == buf + Limit)
+						flush(nullptr, 0);
+
+					auto x = tt::_Minimum(len, remaining());
+					memcpy(ptr, begin, x);
+					ptr += x;
+					begin += x;
+					len -= x;
+				}
+			}
+
+		private:
+			inline size_t remaining()
+			{
+				return Limit - static_cast<size_t>(ptr - buf);
+			}
+
+			// writes the buffer and then `extra`, retrying short writes. on an error the rest is
+			// dropped, and only what was actually written is counted.
+			inline void flush(const char* extra, size_t extra_len)
+			{
+				struct iovec iov[2];
+				iov[0].iov_base = buf;
+				iov[0].iov_len = static_cast<size_t>(ptr - buf);
+				iov[1].iov_base = const_cast<char*>(extra);
+				iov[1].iov_len = extra_len;
+
+				auto* cur = &iov[0];
+				int count = (extra_len > 0 ? 2 : 1);
+
+				while(count > 0)
+				{
+					if(cur->iov_len == 0)
+					{
+						cur++;
+						count--;
+						continue;
+					}
+
+					auto n = (count == 1 ? ::write(fd, cur->iov_base, cur->iov_len) : ::writev(fd, cur, count));
+					if(n < 0 && errno == EINTR)
+						continue;
+					else if(n <= 0)
+						break;
+
+					auto done = static_cast<size_t>(n);
+					written += done;
+
+					while(count > 0 && done >= cur->iov_len)
+					{
+						done -= cur->iov_len;
+						cur++;
+						count--;
+					}
+
+					if(count > 0)
+					{
+						cur->iov_base = static_cast<char*>(cur->iov_base) + done;
+						cur->iov_len -= done;
+					}
+				}
+
+				ptr = buf;
+			}
+
+			int fd = -1;
+
+			// one extra for the newline.
+			char buf[Limit + 1];
+			char* ptr = &buf[0];
+			size_t& written;
+		};
+	#endif
+
 		template <typename _Fn>
 		struct callback_appender
 		{
@@ -1744,6 +2707,21 @@ namespace zpr
 		return n;
 	}
 
+#if ZPR_COMPILED_FORMAT
+	// same as above, with a compiled format string.
+	template <detail::fixed_string _Str, typename _CallbackFn, typename... _Types>
+	size_t cprint(_CallbackFn&& callback, detail::compiled_format<_Str> fmt, _Types&&... args)
+	{
+		size_t n = 0;
+		{
+			auto appender = detail::callback_appender(&callback, /* newline: */ false);
+			detail::print(appender, fmt, static_cast<_Types&&>(args)...);
+			n = appender.size();
+		}
+		return n;
+	}
+#endif
+
 	/*
 		Print with a user-specified callback function, appending a newline at the end.
 
@@ -1769,6 +2747,21 @@ namespace zpr
 		return n;
 	}
 
+#if ZPR_COMPILED_FORMAT
+	// same as above, with a compiled format string.
+	template <detail::fixed_string _Str, typename _CallbackFn, typename... _Types>
+	size_t cprintln(_CallbackFn&& callback, detail::compiled_format<_Str> fmt, _Types&&... args)
+	{
+		size_t n = 0;
+		{
+			auto appender = detail::callback_appender(&callback, /* newline: */ true);
+			detail::print(appender, fmt, static_cast<_Types&&>(args)...);
+			n = appender.size();
+		}
+		return n;
+	}
+#endif
+
 	/*
 		Print to a user-specified buffer `buf`, with size `len`. A NULL-terminator is *NOT* inserted.
 		If the number of bytes to print exceeds the size of the buffer, the output is truncated. Again,
@@ -1794,6 +2787,21 @@ namespace zpr
 		return n;
 	}
 
+#if ZPR_COMPILED_FORMAT
+	// same as above, with a compiled format string.
+	template <detail::fixed_string _Str, typename... _Types>
+	size_t sprint(size_t len, char* buf, detail::compiled_format<_Str> fmt, _Types&&... args)
+	{
+		size_t n = 0;
+		{
+			auto appender = detail::buffer_appender(buf, len);
+			detail::print(appender, fmt, static_cast<_Types&&>(args)...);
+			n = appender.size();
+		}
+		return n;
+	}
+#endif
+
 	/*
 		Forward the provided format-string and arguments to another zpr printing function. The implementation
 		of this mechanism creates and stores pointers to the argument values, so you should *NOT* store the
@@ -1805,107 +2813,501 @@ namespace zpr
 		Example usage:
 		zpr::fprintln(stderr, "foo: {}", zpr::fwd("this is: {}", 69));
 
-		In this case, no additional allocation is incurred in creating a temporary buffer to store the result of
-		the inner print, and everything goes straight to the stderr FILE.
+		In this case, no additional allocation is incurred in creating a temporary buffer to store the result of
+		the inner print, and everything goes straight to the stderr FILE.
+
+		Arguments:
+		`fmt`       -- the format string
+		`args`      -- the values to print
+
+		Again, do not store the return value of this function.
+	*/
+	template <typename... _Types>
+	auto fwd(tt::str_view fmt, _Types&&... args)
+	{
+		return detail::__forward_helper<_Types&&...>(static_cast<tt::str_view&&>(fmt), static_cast<_Types&&>(args)...);
+	}
+
+
+
+#if ZPR_COMPILED_FORMAT
+	inline namespace literals
+	{
+		/*
+			Parse the format string at compile time. The result can be passed to any of the print functions in
+			place of a normal format string; at runtime, only the literal text and the arguments are printed.
+			Unlike normal format strings, passing the wrong number of arguments (or leaving a '{' unclosed) is
+			a compile error.
+
+			Example usage:
+			zpr::println("foo: {} {x}"_fmt, 69, 420);
+
+			As with runtime format strings, '{{' and '}}' are only unescaped up to the last argument; the text
+			after it (or all of it, if there are no arguments) is printed as written.
+		*/
+		template <detail::fixed_string _Str>
+		constexpr detail::compiled_format<_Str> operator""_fmt()
+		{
+			return { };
+		}
+	}
+#endif
+
+
+
+// if we are freestanding, we don't have stdio, so we can't print to "stdout".
+#if !ZPR_FREESTANDING
+
+	/*
+		Print to the standard output stream.
+
+		Arguments:
+		`fmt`       -- the format string
+		`args`      -- the values to print
+
+		Returns the number of bytes printed.
+	*/
+	template <typename... _Types>
+	size_t print(tt::str_view fmt, _Types&&... args)
+	{
+		size_t ret = 0;
+		{
+			auto appender = detail::file_appender<detail::STDIO_BUFFER_SIZE, false>(stdout, ret);
+			detail::print(appender, fmt, static_cast<_Types&&>(args)...);
+		}
+		return ret;
+	}
+
+#if ZPR_COMPILED_FORMAT
+	// same as above, with a compiled format string.
+	template <detail::fixed_string _Str, typename... _Types>
+	size_t print(detail::compiled_format<_Str> fmt, _Types&&... args)
+	{
+		size_t ret = 0;
+		{
+			auto appender = detail::file_appender<detail::STDIO_BUFFER_SIZE, false>(stdout, ret);
+			detail::print(appender, fmt, static_cast<_Types&&>(args)...);
+		}
+		return ret;
+	}
+#endif
+
+	/*
+		Print to the standard output stream, appending a newline at the end.
+
+		Arguments:
+		`fmt`       -- the format string
+		`args`      -- the values to print
+
+		Returns the number of bytes printed.
+	*/
+	template <typename... _Types>
+	size_t println(tt::str_view fmt, _Types&&... args)
+	{
+		size_t ret = 0;
+		{
+			auto appender = detail::file_appender<detail::STDIO_BUFFER_SIZE, true>(stdout, ret);
+			detail::print(appender, fmt, static_cast<_Types&&>(args)...);
+		}
+		return ret;
+	}
+
+#if ZPR_COMPILED_FORMAT
+	// same as above, with a compiled format string.
+	template <detail::fixed_string _Str, typename... _Types>
+	size_t println(detail::compiled_format<_Str> fmt, _Types&&... args)
+	{
+		size_t ret = 0;
+		{
+			auto appender = detail::file_appender<detail::STDIO_BUFFER_SIZE, true>(stdout, ret);
+			detail::print(appender, fmt, static_cast<_Types&&>(args)...);
+		}
+		return ret;
+	}
+#endif
+
+	/*
+		Prints to the specified FILE stream.
 
 		Arguments:
+		`file`      -- the stream to print to
 		`fmt`       -- the format string
 		`args`      -- the values to print
 
-		Again, do not store the return value of this function.
+		Returns the number of bytes printed.
 	*/
 	template <typename... _Types>
-	auto fwd(tt::str_view fmt, _Types&&... args)
+	size_t fprint(FILE* file, tt::str_view fmt, _Types&&... args)
 	{
-		return detail::__forward_helper<_Types&&...>(static_cast<tt::str_view&&>(fmt), static_cast<_Types&&>(args)...);
+		size_t ret = 0;
+		{
+			auto appender = detail::file_appender<detail::STDIO_BUFFER_SIZE, false>(file, ret);
+			detail::print(appender, fmt, static_cast<_Types&&>(args)...);
+		}
+		return ret;
 	}
 
-
-
-// if we are freestanding, we don't have stdio, so we can't print to "stdout".
-#if !ZPR_FREESTANDING
+#if ZPR_COMPILED_FORMAT
+	// same as above, with a compiled format string.
+	template <detail::fixed_string _Str, typename... _Types>
+	size_t fprint(FILE* file, detail::compiled_format<_Str> fmt, _Types&&... args)
+	{
+		size_t ret = 0;
+		{
+			auto appender = detail::file_appender<detail::STDIO_BUFFER_SIZE, false>(file, ret);
+			detail::print(appender, fmt, static_cast<_Types&&>(args)...);
+		}
+		return ret;
+	}
+#endif
 
 	/*
-		Print to the standard output stream.
+		Prints to the specified FILE stream, appending a newline at the end.
 
 		Arguments:
+		`file`      -- the stream to print to
 		`fmt`       -- the format string
 		`args`      -- the values to print
 
 		Returns the number of bytes printed.
 	*/
 	template <typename... _Types>
-	size_t print(tt::str_view fmt, _Types&&... args)
+	size_t fprintln(FILE* file, tt::str_view fmt, _Types&&... args)
 	{
 		size_t ret = 0;
 		{
-			auto appender = detail::file_appender<detail::STDIO_BUFFER_SIZE, false>(stdout, ret);
+			auto appender = detail::file_appender<detail::STDIO_BUFFER_SIZE, true>(file, ret);
+			detail::print(appender, fmt, static_cast<_Types&&>(args)...);
+		}
+		return ret;
+	}
+
+#if ZPR_COMPILED_FORMAT
+	// same as above, with a compiled format string.
+	template <detail::fixed_string _Str, typename... _Types>
+	size_t fprintln(FILE* file, detail::compiled_format<_Str> fmt, _Types&&... args)
+	{
+		size_t ret = 0;
+		{
+			auto appender = detail::file_appender<detail::STDIO_BUFFER_SIZE, true>(file, ret);
 			detail::print(appender, fmt, static_cast<_Types&&>(args)...);
 		}
 		return ret;
 	}
+#endif
+#endif
+
+#if ZPR_FD_OUTPUT
 
 	/*
-		Print to the standard output stream, appending a newline at the end.
+		Prints to the specified file descriptor, bypassing stdio; there is no FILE buffer to fflush()
+		afterwards, and the whole output is written with one syscall (unless it is bigger than the buffer).
+		It isn't ordered with respect to anything still sitting in a FILE's buffer for the same fd.
 
 		Arguments:
+		`fd`        -- the file descriptor to write to
 		`fmt`       -- the format string
 		`args`      -- the values to print
 
-		Returns the number of bytes printed.
+		Returns the number of bytes written.
 	*/
 	template <typename... _Types>
-	size_t println(tt::str_view fmt, _Types&&... args)
+	size_t dprint(int fd, tt::str_view fmt, _Types&&... args)
 	{
 		size_t ret = 0;
 		{
-			auto appender = detail::file_appender<detail::STDIO_BUFFER_SIZE, true>(stdout, ret);
+			auto appender = detail::fd_appender<detail::STDIO_BUFFER_SIZE, false>(fd, ret);
+			detail::print(appender, fmt, static_cast<_Types&&>(args)...);
+		}
+		return ret;
+	}
+
+#if ZPR_COMPILED_FORMAT
+	// same as above, with a compiled format string.
+	template <detail::fixed_string _Str, typename... _Types>
+	size_t dprint(int fd, detail::compiled_format<_Str> fmt, _Types&&... args)
+	{
+		size_t ret = 0;
+		{
+			auto appender = detail::fd_appender<detail::STDIO_BUFFER_SIZE, false>(fd, ret);
 			detail::print(appender, fmt, static_cast<_Types&&>(args)...);
 		}
 		return ret;
 	}
+#endif
 
 	/*
-		Prints to the specified FILE stream.
+		Prints to the specified file descriptor, appending a newline at the end. The newline goes
+		out in the same write as the rest of the line.
 
 		Arguments:
-		`file`      -- the stream to print to
+		`fd`        -- the file descriptor to write to
 		`fmt`       -- the format string
 		`args`      -- the values to print
 
-		Returns the number of bytes printed.
+		Returns the number of bytes written.
 	*/
 	template <typename... _Types>
-	size_t fprint(FILE* file, tt::str_view fmt, _Types&&... args)
+	size_t dprintln(int fd, tt::str_view fmt, _Types&&... args)
 	{
 		size_t ret = 0;
 		{
-			auto appender = detail::file_appender<detail::STDIO_BUFFER_SIZE, false>(file, ret);
+			auto appender = detail::fd_appender<detail::STDIO_BUFFER_SIZE, true>(fd, ret);
+			detail::print(appender, fmt, static_cast<_Types&&>(args)...);
+		}
+		return ret;
+	}
+
+#if ZPR_COMPILED_FORMAT
+	// same as above, with a compiled format string.
+	template <detail::fixed_string _Str, typename... _Types>
+	size_t dprintln(int fd, detail::compiled_format<_Str> fmt, _Types&&... args)
+	{
+		size_t ret = 0;
+		{
+			auto appender = detail::fd_appender<detail::STDIO_BUFFER_SIZE, true>(fd, ret);
 			detail::print(appender, fmt, static_cast<_Types&&>(args)...);
 		}
 		return ret;
 	}
+#endif
+#endif
+
+#if !ZPR_FREESTANDING
 
 	/*
-		Prints to the specified FILE stream, appending a newline at the end.
+		A growable buffer to sprint() into, made of chunks of at least `chunk_size` bytes. reset() empties
+		it but keeps the chunks for the next use; if the last use needed more than one, they are replaced
+		with a single chunk as big as all of them, so that a buffer which is reused for similar output
+		settles into one contiguous chunk and stops calling malloc().
+
+		The contents can be taken as one tt::str_view (which has to join the chunks if there are several),
+		or as a list of iovecs (with ZPR_FD_OUTPUT) to pass to writev() as they are. If malloc() fails,
+		whatever doesn't fit is dropped.
+
+		(it lives in detail, like the other appenders, so that the formatters' unqualified calls find
+		the detail:: functions by ADL; use it as zpr::arena_buffer.)
+	*/
+	namespace detail
+	{
+		struct arena_buffer
+		{
+			static constexpr size_t DEFAULT_CHUNK_SIZE = 4096;
+
+			explicit arena_buffer(size_t chunk_size = DEFAULT_CHUNK_SIZE) : chunk_size(chunk_size) { }
+			~arena_buffer() { this->release(this->head); }
+
+			arena_buffer(arena_buffer&&) = delete;
+			arena_buffer(const arena_buffer&) = delete;
+			arena_buffer& operator= (arena_buffer&&) = delete;
+			arena_buffer& operator= (const arena_buffer&) = delete;
+
+			size_t size() const { return this->total; }
+			bool empty() const { return this->total == 0; }
+
+			void reset()
+			{
+				if(this->cur != this->head)
+				{
+					size_t cap = 0;
+					for(auto c = this->head; c != nullptr; c = c->next)
+						cap += c->cap;
+
+					this->release(this->head);
+					this->head = allocate(cap);
+				}
+
+				if(this->head != nullptr)
+					this->head->len = 0;
+
+				this->cur = this->head;
+				this->total = 0;
+			}
+
+			tt::str_view view()
+			{
+				if(this->head == nullptr)
+					return { };
+
+				if(this->cur != this->head)
+				{
+					auto joined = allocate(tt::_Maximum(this->total, this->chunk_size));
+					if(joined == nullptr)
+						return { this->head->data(), this->head->len };
+
+					for(auto c = this->head; c != this->cur->next; c = c->next)
+					{
+						memcpy(joined->data() + joined->len, c->data(), c->len);
+						joined->len += c->len;
+					}
+
+					this->release(this->head);
+					this->head = joined;
+					this->cur = joined;
+				}
+
+				return { this->head->data(), this->head->len };
+			}
+
+		#if ZPR_FD_OUTPUT
+			// fills in up to `max` iovecs, one per chunk; returns how many chunks there are, which can be more.
+			size_t iovecs(struct iovec* iov, size_t max) const
+			{
+				size_t n = 0;
+				for(auto c = this->head; c != nullptr && c != this->cur->next; c = c->next)
+				{
+					if(c->len == 0)
+						continue;
+
+					if(n < max)
+					{
+						iov[n].iov_base = c->data();
+						iov[n].iov_len = c->len;
+					}
+
+					n++;
+				}
+
+				return n;
+			}
+		#endif
+
+			// so that it can be used as an appender directly.
+			inline void operator() (char c) { (*this)(&c, 1); }
+			inline void operator() (tt::str_view sv) { (*this)(sv.data(), sv.size()); }
+			inline void operator() (const char* begin, const char* end) { (*this)(begin, static_cast<size_t>(end - begin)); }
+
+			inline void operator() (char c, size_t n)
+			{
+				while(n > 0)
+				{
+					auto ch = this->space(n);
+					if(ch == nullptr)
+						return;
+
+					auto x = tt::_Minimum(n, ch->cap - ch->len);
+					memset(ch->data() + ch->len, c, x);
+					ch->len += x;
+					this->total += x;
+					n -= x;
+				}
+			}
+
+			inline void operator() (const char* begin, size_t len)
+			{
+				while(len > 0)
+				{
+					auto ch = this->space(len);
+					if(ch == nullptr)
+						return;
+
+					auto x = tt::_Minimum(len, ch->cap - ch->len);
+					memcpy(ch->data() + ch->len, begin, x);
+					ch->len += x;
+					this->total += x;
+					begin += x;
+					len -= x;
+				}
+			}
+
+		private:
+			// the bytes follow the header.
+			struct chunk
+			{
+				chunk* next;
+				size_t cap;
+				size_t len;
+
+				char* data() { return reinterpret_cast<char*>(this + 1); }
+			};
+
+			static chunk* allocate(size_t cap)
+			{
+				auto c = static_cast<chunk*>(malloc(sizeof(chunk) + cap));
+				if(c != nullptr)
+				{
+					c->next = nullptr;
+					c->cap = cap;
+					c->len = 0;
+				}
+
+				return c;
+			}
+
+			static void release(chunk* c)
+			{
+				while(c != nullptr)
+				{
+					auto next = c->next;
+					free(c);
+					c = next;
+				}
+			}
+
+			// a chunk with room for at least one more byte: the current one, the next one left over from
+			// before the last reset(), or a new one.
+			chunk* space(size_t want)
+			{
+				if(this->cur != nullptr && this->cur->len < this->cur->cap)
+					return this->cur;
+
+				if(this->cur != nullptr && this->cur->next != nullptr)
+				{
+					this->cur = this->cur->next;
+					this->cur->len = 0;
+					return this->cur;
+				}
+
+				auto c = allocate(tt::_Maximum(want, this->chunk_size));
+				if(c == nullptr)
+					return nullptr;
+
+				if(this->cur != nullptr)
+					this->cur->next = c;
+				else
+					this->head = c;
+
+				this->cur = c;
+				return c;
+			}
+
+			chunk* head = nullptr;
+			chunk* cur = nullptr;
+			size_t total = 0;
+			size_t chunk_size;
+		};
+	}
+
+	using detail::arena_buffer;
+
+	/*
+		Appends to an arena_buffer, allocating more space if it runs out.
 
 		Arguments:
-		`file`      -- the stream to print to
+		`buf`       -- the buffer to append to
 		`fmt`       -- the format string
 		`args`      -- the values to print
 
-		Returns the number of bytes printed.
+		Returns the number of bytes appended.
 	*/
 	template <typename... _Types>
-	size_t fprintln(FILE* file, tt::str_view fmt, _Types&&... args)
+	size_t sprint(arena_buffer& buf, tt::str_view fmt, _Types&&... args)
 	{
-		size_t ret = 0;
-		{
-			auto appender = detail::file_appender<detail::STDIO_BUFFER_SIZE, true>(file, ret);
-			detail::print(appender, fmt, static_cast<_Types&&>(args)...);
-		}
-		return ret;
+		auto before = buf.size();
+		detail::print(buf, fmt, static_cast<_Types&&>(args)...);
+		return buf.size() - before;
 	}
+
+#if ZPR_COMPILED_FORMAT
+	// same as above, with a compiled format string.
+	template <detail::fixed_string _Str, typename... _Types>
+	size_t sprint(arena_buffer& buf, detail::compiled_format<_Str> fmt, _Types&&... args)
+	{
+		auto before = buf.size();
+		detail::print(buf, fmt, static_cast<_Types&&>(args)...);
+		return buf.size() - before;
+	}
+#endif
 #endif
 
 
@@ -2029,9 +3431,10 @@ namespace zpr
 				}
 
 				int base = 10;
+				bool pointer = (args.specifier == 'p');
 				if((args.specifier | 0x20) == 'x')  base = 16;
 				else if(args.specifier == 'b')      base = 2;
-				else if(args.specifier == 'p')
+				else if(pointer)
 				{
 					base = 16;
 					args.specifier = 'x';
@@ -2040,61 +3443,70 @@ namespace zpr
 
 				// if we print base 2 we need 64 digits!
 				constexpr size_t digits_buf_sz = 65;
-				char digits_buf[digits_buf_sz] = { };
+				char digits_buf[digits_buf_sz];
 
 				char* digits = 0;
 				size_t digits_len = 0;
 
 
 				{
-					if constexpr (tt::is_unsigned<Decayed_T>::value)
+					using Unsigned_T = tt::make_unsigned_t<Decayed_T>;
+					if(base == 10)
 					{
-						digits = detail::print_integer(digits_buf, digits_buf_sz, x, base);
+						// the digit count is known up front, so write them straight into the start of the buffer.
+						// the sign goes in the prefix.
+						auto mag = detail::decimal_magnitude(x);
+
+						digits = digits_buf;
+						digits_len = detail::count_decimal_digits(mag);
+						detail::write_decimal(digits, mag, digits_len);
+					}
+					else if(tt::is_unsigned<Decayed_T>::value || base == 16)
+					{
+						digits = detail::print_integer(digits_buf, digits_buf_sz, static_cast<Unsigned_T>(x), base);
 						digits_len = digits_buf_sz - (digits - digits_buf);
 					}
 					else
 					{
-						if(base == 16)
-						{
-							digits = detail::print_integer(digits_buf, digits_buf_sz,
-								static_cast<tt::make_unsigned_t<Decayed_T>>(x), base);
+						digits = detail::print_integer(digits_buf, digits_buf_sz, detail::decimal_magnitude(x), base);
+						digits_len = digits_buf_sz - (digits - digits_buf);
+					}
 
-							digits_len = digits_buf_sz - (digits - digits_buf);
-						}
-						else
+					if('A' <= args.specifier && args.specifier <= 'Z')
+					{
+						for(size_t i = 0; i < digits_len; i++)
 						{
-							auto abs_val = tt::_Absolute(x);
-							digits = detail::print_integer(digits_buf, digits_buf_sz, abs_val, base);
-
-							digits_len = digits_buf_sz - (digits - digits_buf);
+							if(digits[i] >= 'a')
+								digits[i] = static_cast<char>(digits[i] - 0x20);
 						}
 					}
 
-					if('A' <= args.specifier && args.specifier <= 'Z')
-						for(size_t i = 0; i < digits_len; i++)
-							digits[i] = static_cast<char>(digits[i] - 0x20);
+					// like printf, zero with a precision of zero is no digits at all.
+					if(x == 0 && args.have_precision() && args.precision == 0)
+						digits_len = 0;
 				}
 
 				char prefix[4] = { 0 };
 				int64_t prefix_len = 0;
-				int64_t prefix_digits_length = 0;
 				{
+					// '+' and ' ' only apply to signed decimals, and '#' doesn't apply to zero.
+					constexpr bool is_signed = tt::is_signed_v<Decayed_T>;
+
 					char* pf = prefix;
-					if(args.prepend_plus())
+					if(x < 0 && base == 10)
+						prefix_len++, *pf++ = '-';
+
+					else if(is_signed && base == 10 && args.prepend_plus())
 						prefix_len++, *pf++ = '+';
 
-					else if(args.prepend_space())
+					else if(is_signed && base == 10 && args.prepend_space())
 						prefix_len++, *pf++ = ' ';
 
-					else if(x < 0 && base == 10)
-						prefix_len++, *pf++ = '-';
-
-					if(base != 10 && args.alternate())
+					if(base != 10 && args.alternate() && (x != 0 || pointer))
 					{
 						*pf++ = '0';
 						*pf++ = (ZPR_HEX_0X_RESPECTS_UPPERCASE ? args.specifier : (args.specifier | 0x20));
 
-						prefix_digits_length += 2;
 						prefix_len += 2;
 					}
 				}
@@ -2104,7 +3516,6 @@ namespace zpr
 					: static_cast<int64_t>(digits_len)
 				);
 
-				int64_t total_digits_length = prefix_digits_length + static_cast<int64_t>(digits_len);
 				int64_t normal_length = prefix_len + static_cast<int64_t>(digits_len);
 				int64_t length_with_precision = prefix_len + output_length_with_precision;
 
@@ -2115,7 +3526,7 @@ namespace zpr
 
 				int64_t padding_width = args.width - length_with_precision;
 				int64_t zeropad_width = args.width - normal_length;
-				int64_t precpad_width = args.precision - total_digits_length;
+				int64_t precpad_width = args.precision - static_cast<int64_t>(digits_len);
 
 				if(padding_width <= 0) { use_left_pad = false; use_right_pad = false; }
 				if(zeropad_width <= 0) { use_zero_pad = false; }
@@ -2170,21 +3581,13 @@ namespace zpr
 		template <typename _Cb>
 		void print(float x, _Cb&& cb, format_args args)
 		{
-			if(args.specifier == 'e' || args.specifier == 'E')
-				print_exponent(static_cast<_Cb&&>(cb), x, static_cast<format_args&&>(args));
-
-			else
-				print_floating(static_cast<_Cb&&>(cb), x, static_cast<format_args&&>(args));
+			print_floating(static_cast<_Cb&&>(cb), x, static_cast<format_args&&>(args), /* single: */ true);
 		}
 
 		template <typename _Cb>
 		void print(double x, _Cb&& cb, format_args args)
 		{
-			if(args.specifier == 'e' || args.specifier == 'E')
-				print_exponent(static_cast<_Cb&&>(cb), x, static_cast<format_args&&>(args));
-
-			else
-				print_floating(static_cast<_Cb&&>(cb), x, static_cast<format_args&&>(args));
+			print_floating(static_cast<_Cb&&>(cb), x, static_cast<format_args&&>(args));
 		}
 	};
 
@@ -2381,6 +3784,20 @@ namespace zpr
 		return buf;
 	}
 
+#if ZPR_COMPILED_FORMAT
+	// same as above, with a compiled format string.
+	template <detail::fixed_string _Str, typename... _Types>
+	std::string sprint(detail::compiled_format<_Str> fmt, _Types&&... args)
+	{
+		std::string buf;
+		{
+			auto appender = detail::string_appender(buf);
+			detail::print(appender, fmt, static_cast<_Types&&>(args)...);
+		}
+		return buf;
+	}
+#endif
+
 	template <typename _Type1, typename _Type2>
 	struct print_formatter<std::pair<_Type1, _Type2>>
 	{
@@ -2403,6 +3820,67 @@ namespace zpr
 	Version History
 	===============
 
+	2.9.1 - 19/10/2026
+	------------------
+	Bug fixes:
+	- "..."_fmt unescaped '{{' and '}}' after the last argument (and everywhere, with no arguments), which
+	  runtime format strings print as written; both now give the same output.
+
+
+
+	2.9.0 - 19/10/2026
+	------------------
+	Add arena_buffer, a chunked buffer that sprint() can append to without truncating, and which keeps (and
+	eventually coalesces) its memory across reset(); its contents can be taken as a str_view or as iovecs.
+
+
+
+	2.8.0 - 19/10/2026
+	------------------
+	Add dprint() and dprintln(), which print to a file descriptor with one write() (or writev()) per call,
+	without going through stdio. Controlled by ZPR_FD_OUTPUT, which is on by default where <unistd.h> exists.
+
+
+
+	2.7.2 - 19/10/2026
+	------------------
+	Bug fixes, found by checking every flag/width/precision combination against printf:
+	- '{X}' uppercased the digits as well as the letters (so 0-9 came out as control characters)
+	- '+' and ' ' were applied to unsigned and non-decimal integers
+	- '#' added a prefix to zero (printf prints "0", not "0x0")
+	- precision counted the '0x' prefix as digits, and a precision of 0 still printed zero as "0"
+	- nan and inf ignored the sign bit, the '+' and ' ' flags and uppercase specifiers, and were zero-padded
+
+
+
+	2.7.1 - 19/10/2026
+	------------------
+	Decimal integers are printed straight into place, after counting their digits from the bit width. Add
+	ZPR_DECIMAL_LOOKUP_TABLE_LARGE, which uses a 40kb table of 4-digit groups.
+
+	Bug fixes:
+	- the most negative value of a signed type printed as garbage (eg. "--0" for INT64_MIN)
+	- negative numbers with '+' or ' ' (eg. '{+}') printed the flag instead of the '-'
+
+
+
+	2.7.0 - 19/10/2026
+	------------------
+	Replace the floating-point printer. '{}' now prints the shortest representation that round-trips (using Ryu), and
+	'{f}', '{e}' and '{g}' print from the exact binary value with round-half-even, matching printf digit-for-digit
+	(previously, fractions were rounded in double precision, precisions past 16 were approximated, and '{f}' switched
+	to exponent form above 1e15).
+
+
+
+	2.6.0 - 19/10/2026
+	------------------
+	Add compiled format strings, with the "..."_fmt literal (in zpr::literals). The format string is parsed at
+	compile time into literal text and pre-decoded format_args, and a mismatched number of arguments is a
+	compile error. Controlled by ZPR_COMPILED_FORMAT.
+
+
+
 	2.5.7 - 26/11/2021
 	------------------
 	Bug fixes:
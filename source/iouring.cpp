@@ -0,0 +1,352 @@
+// iouring.cpp
+// Copyright (c) 2022, zhiayang
+// SPDX-License-Identifier: Apache-2.0
+
+#include "slug.h"
+#include "trace.h"
+
+#if SLUG_IO_URING
+
+#include <poll.h>
+#include <liburing.h>
+#include <linux/input.h>
+#include <libevdev/libevdev.h>
+
+// the classic loop does a blocking read() per event frame (through libevdev), and one write() per
+// event we send to uinput (usually several per key). here, a multishot read stays posted on the
+// evdev fd and fills buffers from a provided-buffer ring, and everything we send while handling one
+// batch of input is copied into a registered buffer and written with a single (linked) SQE. the
+// writes are submitted together with the wait for the next input, so in the common case that's one
+// io_uring_enter per batch of input events -- or none at all with SQPOLL when input is busy.
+//
+// note that we bypass libevdev for reading here, so a SYN_DROPPED is only reported, not resynced.
+
+namespace slug
+{
+	static constexpr unsigned RING_ENTRIES      = 64;
+	static constexpr unsigned NUM_READ_BUFS     = 16;
+	static constexpr size_t READ_BUF_EVENTS     = 64;
+	static constexpr unsigned NUM_WRITE_SLOTS   = 32;
+	static constexpr size_t WRITE_SLOT_EVENTS   = 64;
+	static constexpr int READ_BUF_GROUP         = 1;
+
+	static_assert(UInputDevice::MAX_BATCH <= WRITE_SLOT_EVENTS);
+	static_assert(NUM_WRITE_SLOTS == 32);     // one bit each in free_slots
+
+	// indices into the registered file table
+	static constexpr int FILE_EVDEV             = 0;
+	static constexpr int FILE_UINPUT            = 1;
+
+	static constexpr uint64_t TAG_READ          = 1ull << 32;
+	static constexpr uint64_t TAG_WRITE         = 2ull << 32;
+	static constexpr uint64_t TAG_CANCEL        = 3ull << 32;
+	static constexpr uint64_t TAG_QUIT          = 4ull << 32;
+	static constexpr uint64_t TAG_MASK          = 0xFFFF'FFFFull << 32;
+
+	struct UringQueue : EventSink
+	{
+		io_uring ring {};
+		int uinput_fd = -1;
+		io_uring_buf_ring* read_ring = nullptr;
+		bool sqpoll = false;
+
+		uint32_t free_slots = ~0u;
+		io_uring_sqe* last_write = nullptr;
+		bool read_armed = false;
+		uint64_t enters = 0;
+
+		input_event read_bufs[NUM_READ_BUFS][READ_BUF_EVENTS] {};
+		input_event write_slots[NUM_WRITE_SLOTS][WRITE_SLOT_EVENTS] {};
+
+		io_uring_sqe* get_sqe()
+		{
+			auto sqe = io_uring_get_sqe(&this->ring);
+			if(sqe == nullptr)
+			{
+				this->submit_pending();
+				sqe = io_uring_get_sqe(&this->ring);
+			}
+
+			return sqe;
+		}
+
+		void submit_pending()
+		{
+			if(io_uring_sq_ready(&this->ring) == 0)
+				return;
+
+			if(not this->sqpoll || (IO_URING_READ_ONCE(*this->ring.sq.kflags) & IORING_SQ_NEED_WAKEUP))
+				this->enters++;
+
+			io_uring_submit(&this->ring);
+			this->last_write = nullptr;
+		}
+
+		void arm_read()
+		{
+			auto sqe = this->get_sqe();
+			io_uring_prep_read_multishot(sqe, FILE_EVDEV, 0, 0, READ_BUF_GROUP);
+			io_uring_sqe_set_flags(sqe, IOSQE_FIXED_FILE);
+			io_uring_sqe_set_data64(sqe, TAG_READ);
+
+			// a link from the previous write would make it wait for the read (which never finishes).
+			this->last_write = nullptr;
+			this->read_armed = true;
+		}
+
+		// completes once we're asked to quit, which wakes up the wait for input.
+		void arm_quit_poll()
+		{
+			auto sqe = this->get_sqe();
+			io_uring_prep_poll_add(sqe, getQuitFd(), POLLIN);
+			io_uring_sqe_set_data64(sqe, TAG_QUIT);
+			this->last_write = nullptr;
+		}
+
+		void cancel_read()
+		{
+			if(not this->read_armed)
+				return;
+
+			auto sqe = this->get_sqe();
+			io_uring_prep_cancel64(sqe, TAG_READ, 0);
+			io_uring_sqe_set_data64(sqe, TAG_CANCEL);
+			this->last_write = nullptr;
+		}
+
+		void recycle_read_buffer(unsigned bid)
+		{
+			io_uring_buf_ring_add(this->read_ring, this->read_bufs[bid], sizeof(this->read_bufs[bid]), static_cast<uint16_t>(bid),
+				io_uring_buf_ring_mask(NUM_READ_BUFS), 0);
+			io_uring_buf_ring_advance(this->read_ring, 1);
+		}
+
+		void reap_write(io_uring_cqe* cqe)
+		{
+			auto slot = static_cast<uint32_t>(cqe->user_data & ~TAG_MASK);
+			this->free_slots |= (1u << slot);
+
+			if(cqe->res < 0)
+				zpr::fprintln(stderr, "xkeyslug: uinput write failed: {} ({})", strerror(-cqe->res), -cqe->res);
+		}
+
+		virtual int fd() const override
+		{
+			return this->uinput_fd;
+		}
+
+		virtual void write(const input_event* events, size_t count) override
+		{
+			// every write slot is in flight; this shouldn't really happen since uinput writes complete
+			// inline, but if it does, just write it directly (after everything that's queued).
+			if(this->free_slots == 0)
+			{
+				this->submit_pending();
+				if(::write(this->uinput_fd, events, count * sizeof(input_event)) < 0)
+					zpr::fprintln(stderr, "xkeyslug: uinput write failed: {} ({})", strerror(errno), errno);
+
+				return;
+			}
+
+			auto slot = static_cast<unsigned>(__builtin_ctz(this->free_slots));
+			this->free_slots &= ~(1u << slot);
+
+			memcpy(this->write_slots[slot], events, count * sizeof(input_event));
+
+			// keep the writes in order, in case more than one gets submitted at once.
+			if(this->last_write != nullptr)
+				this->last_write->flags |= IOSQE_IO_LINK;
+
+			auto sqe = this->get_sqe();
+			io_uring_prep_write_fixed(sqe, FILE_UINPUT, this->write_slots[slot], static_cast<unsigned>(count * sizeof(input_event)),
+				0, static_cast<int>(slot));
+			io_uring_sqe_set_flags(sqe, IOSQE_FIXED_FILE);
+			io_uring_sqe_set_data64(sqe, TAG_WRITE | slot);
+
+			this->last_write = sqe;
+		}
+	};
+
+	static bool setup(UringQueue* q, int evdev_fd, int uinput_fd, bool sqpoll)
+	{
+		io_uring_params params {};
+		if(sqpoll)
+		{
+			params.flags |= IORING_SETUP_SQPOLL;
+			params.sq_thread_idle = 1000;
+		}
+
+		if(auto err = io_uring_queue_init_params(RING_ENTRIES, &q->ring, &params); err < 0)
+		{
+			zpr::fprintln(stderr, "xkeyslug: io_uring setup failed: {} ({})", strerror(-err), -err);
+			return false;
+		}
+
+		q->sqpoll = sqpoll;
+		q->uinput_fd = uinput_fd;
+
+		int files[] = { evdev_fd, uinput_fd };
+		if(auto err = io_uring_register_files(&q->ring, files, 2); err < 0)
+		{
+			zpr::fprintln(stderr, "xkeyslug: io_uring file registration failed: {} ({})", strerror(-err), -err);
+			io_uring_queue_exit(&q->ring);
+			return false;
+		}
+
+		iovec iovs[NUM_WRITE_SLOTS] {};
+		for(size_t i = 0; i < NUM_WRITE_SLOTS; i++)
+			iovs[i] = { .iov_base = q->write_slots[i], .iov_len = sizeof(q->write_slots[i]) };
+
+		if(auto err = io_uring_register_buffers(&q->ring, iovs, NUM_WRITE_SLOTS); err < 0)
+		{
+			zpr::fprintln(stderr, "xkeyslug: io_uring buffer registration failed: {} ({})", strerror(-err), -err);
+			io_uring_queue_exit(&q->ring);
+			return false;
+		}
+
+		int err = 0;
+		q->read_ring = io_uring_setup_buf_ring(&q->ring, NUM_READ_BUFS, READ_BUF_GROUP, 0, &err);
+		if(q->read_ring == nullptr)
+		{
+			zpr::fprintln(stderr, "xkeyslug: io_uring buffer ring setup failed: {} ({})", strerror(-err), -err);
+			io_uring_queue_exit(&q->ring);
+			return false;
+		}
+
+		for(unsigned i = 0; i < NUM_READ_BUFS; i++)
+			q->recycle_read_buffer(i);
+
+		return true;
+	}
+
+	static void process_completions(UringQueue* q, UInputDevice* uinput, FocusProvider* focus, LoopStats* stats, bool rearm)
+	{
+		io_uring_cqe* cqe = nullptr;
+		unsigned head = 0;
+		unsigned seen = 0;
+		io_uring_for_each_cqe(&q->ring, head, cqe)
+		{
+			seen++;
+			if((cqe->user_data & TAG_MASK) == TAG_WRITE)
+			{
+				q->reap_write(cqe);
+				continue;
+			}
+			else if((cqe->user_data & TAG_MASK) == TAG_CANCEL || (cqe->user_data & TAG_MASK) == TAG_QUIT)
+			{
+				continue;
+			}
+
+			auto more = (cqe->flags & IORING_CQE_F_MORE);
+			if(cqe->res < 0)
+			{
+				if(cqe->res != -ENOBUFS && cqe->res != -ECANCELED)
+					zpr::fprintln(stderr, "xkeyslug: evdev read failed: {} ({})", strerror(-cqe->res), -cqe->res);
+			}
+			else if(cqe->flags & IORING_CQE_F_BUFFER)
+			{
+				auto bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+				auto num = static_cast<size_t>(cqe->res) / sizeof(input_event);
+				for(size_t i = 0; i < num; i++)
+					handleInputEvent(uinput, focus, q->read_bufs[bid][i]);
+
+				uinput->flush();
+				stats->events += num;
+
+				q->recycle_read_buffer(bid);
+			}
+
+			if(not more)
+			{
+				q->read_armed = false;
+				if(rearm)
+					q->arm_read();
+			}
+		}
+
+		io_uring_cq_advance(&q->ring, seen);
+	}
+
+	bool runUringLoop(struct libevdev* device_ev, UInputDevice* uinput, FocusProvider* focus,
+		const Options& opts, LoopStats* stats)
+	{
+		auto uinput_sink = uinput->getSink();
+
+		auto q = new UringQueue();
+		if(not setup(q, libevdev_get_fd(device_ev), uinput_sink->fd(), opts.sqpoll))
+		{
+			zpr::fprintln(stderr, "xkeyslug: falling back to the classic loop");
+			delete q;
+			return false;
+		}
+
+		zpr::println("xkeyslug: using io_uring{}", opts.sqpoll ? " (sqpoll)" : "");
+		fflush(stdout);
+
+		uinput->setSink(q, /* batch: */ true);
+		q->arm_quit_poll();
+		q->arm_read();
+
+		while(not shouldQuit())
+		{
+			// only wait if there's nothing to do; the pending writes go in with the wait.
+			io_uring_cqe* cqe = nullptr;
+			if(io_uring_peek_cqe(&q->ring, &cqe) != 0)
+			{
+				q->enters++;
+				q->last_write = nullptr;
+				auto span = TraceSpan("io_uring_submit_and_wait");
+				if(auto err = io_uring_submit_and_wait(&q->ring, 1); err < 0 && err != -EINTR)
+				{
+					zpr::fprintln(stderr, "xkeyslug: io_uring wait failed: {} ({})", strerror(-err), -err);
+					break;
+				}
+			}
+			else
+			{
+				q->submit_pending();
+			}
+
+			process_completions(q, uinput, focus, stats, /* rearm: */ true);
+		}
+
+		// stop reading, and let everything in flight finish before the ring goes away: with SQPOLL the
+		// last writes may not even have been picked up yet, and whatever was read still has to be handled.
+		q->cancel_read();
+		while(q->read_armed || q->free_slots != ~0u)
+		{
+			q->enters++;
+			q->last_write = nullptr;
+			if(auto err = io_uring_submit_and_wait(&q->ring, 1); err < 0 && err != -EINTR)
+			{
+				zpr::fprintln(stderr, "xkeyslug: io_uring wait failed: {} ({})", strerror(-err), -err);
+				break;
+			}
+
+			process_completions(q, uinput, focus, stats, /* rearm: */ false);
+		}
+
+		uinput->setSink(uinput_sink);
+		stats->ring_enters = q->enters;
+
+		io_uring_free_buf_ring(&q->ring, q->read_ring, NUM_READ_BUFS, READ_BUF_GROUP);
+		io_uring_queue_exit(&q->ring);
+		delete q;
+
+		return true;
+	}
+}
+
+#else
+
+namespace slug
+{
+	bool runUringLoop(struct libevdev* device_ev, UInputDevice* uinput, FocusProvider* focus,
+		const Options& opts, LoopStats* stats)
+	{
+		zpr::fprintln(stderr, "xkeyslug: built without io_uring support (build with IO_URING=1)");
+		return false;
+	}
+}
+
+#endif
@@ -0,0 +1,106 @@
+// keymap.cpp
+// Copyright (c) 2022, zhiayang
+// SPDX-License-Identifier: Apache-2.0
+
+#include "slug.h"
+
+#include <vector>
+
+#include <sys/ioctl.h>
+#include <linux/input.h>
+#include <libevdev/libevdev.h>
+
+// the unconditional remaps (capslock -> MOD_CAPSLOCK, etc.) don't need to go through us at all;
+// we can rewrite the device's scancode -> keycode table so the kernel hands us the translated
+// keycode directly. the original entries are saved so we can put them back when we exit.
+// (if we crash instead, the keymap stays modified until the device is re-plugged.)
+
+namespace slug
+{
+	static std::vector<input_keymap_entry> g_originalEntries;
+
+	bool installKernelRemaps(struct libevdev* device_ev)
+	{
+		auto fd = libevdev_get_fd(device_ev);
+		auto remaps = getStaticRemaps();
+
+		// walk the whole keymap by index, since we don't know the scancodes up front.
+		std::vector<input_keymap_entry> to_change;
+		for(uint32_t idx = 0; idx <= UINT16_MAX; idx++)
+		{
+			input_keymap_entry entry {};
+			entry.flags = INPUT_KEYMAP_BY_INDEX;
+			entry.index = static_cast<uint16_t>(idx);
+
+			if(ioctl(fd, EVIOCGKEYCODE_V2, &entry) < 0)
+				break;
+
+			for(auto& remap : remaps)
+			{
+				if(entry.keycode == remap.from)
+					to_change.push_back(entry);
+			}
+		}
+
+		if(to_change.empty())
+		{
+			zpr::fprintln(stderr, "xkeyslug: no keymap entries to remap in the kernel");
+			return false;
+		}
+
+		for(auto entry : to_change)
+		{
+			auto original = entry;
+			for(auto& remap : remaps)
+			{
+				if(entry.keycode == remap.from)
+				{
+					entry.keycode = remap.to;
+					break;
+				}
+			}
+
+			// set by scancode; the index is only valid for lookups.
+			entry.flags = 0;
+			entry.index = 0;
+			if(ioctl(fd, EVIOCSKEYCODE_V2, &entry) < 0)
+			{
+				zpr::fprintln(stderr, "xkeyslug: failed to set keycode {} -> {}: {} ({})",
+					original.keycode, entry.keycode, strerror(errno), errno);
+
+				restoreKernelRemaps(device_ev);
+				return false;
+			}
+
+			original.flags = 0;
+			original.index = 0;
+			g_originalEntries.push_back(original);
+
+			// libevdev drops events for codes that the device didn't advertise when it was opened.
+			libevdev_enable_event_code(device_ev, EV_KEY, entry.keycode, nullptr);
+		}
+
+		zpr::println("xkeyslug: installed {} kernel remap{}", g_originalEntries.size(),
+			g_originalEntries.size() == 1 ? "" : "s");
+		fflush(stdout);
+
+		setStaticRemapsInKernel(true);
+		return true;
+	}
+
+	void restoreKernelRemaps(struct libevdev* device_ev)
+	{
+		auto fd = libevdev_get_fd(device_ev);
+		for(auto& entry : g_originalEntries)
+		{
+			if(ioctl(fd, EVIOCSKEYCODE_V2, &entry) < 0)
+			{
+				zpr::fprintln(stderr, "xkeyslug: failed to restore keycode {}: {} ({})",
+					entry.keycode, strerror(errno), errno);
+			}
+		}
+
+		g_originalEntries.clear();
+		setStaticRemapsInKernel(false);
+	}
+}
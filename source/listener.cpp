@@ -0,0 +1,124 @@
+// listener.cpp
+// Copyright (c) 2022, zhiayang
+// SPDX-License-Identifier: Apache-2.0
+
+#include "listener.h"
+
+#include <poll.h>
+#include <sys/socket.h>
+
+namespace slug
+{
+	bool makeUnixAddress(sockaddr_un* addr, const char* path)
+	{
+		*addr = { .sun_family = AF_UNIX, .sun_path = {} };
+		if(strlen(path) >= sizeof(addr->sun_path))
+		{
+			zpr::fprintln(stderr, "xkeyslug: socket path is too long: '{}'", path);
+			return false;
+		}
+
+		strncpy(addr->sun_path, path, sizeof(addr->sun_path) - 1);
+		return true;
+	}
+
+	static bool remove_stale_socket(const char* path, const sockaddr_un& addr)
+	{
+		struct stat st {};
+		if(lstat(path, &st) != 0)
+			return errno == ENOENT;
+
+		if(not S_ISSOCK(st.st_mode))
+		{
+			errno = EEXIST;
+			return false;
+		}
+
+		auto probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		auto live = (probe != -1 && connect(probe, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) == 0);
+		if(probe != -1)
+			close(probe);
+
+		if(live)
+		{
+			errno = EADDRINUSE;
+			return false;
+		}
+
+		return unlink(path) == 0;
+	}
+
+	bool UnixListener::start(const char* path, const char* what, int backlog, Callback on_client)
+	{
+		sockaddr_un addr {};
+		if(not makeUnixAddress(&addr, path))
+			return false;
+
+		m_listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+		// the socket file gets its mode from the umask; make sure nobody else can even connect.
+		auto bind_private = [this, &addr]() {
+			auto old_mask = umask(0177);
+			auto ret = bind(m_listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+			umask(old_mask);
+			return ret == 0;
+		};
+
+		if(m_listen_fd == -1 || not remove_stale_socket(path, addr) || not bind_private()
+			|| listen(m_listen_fd, backlog) != 0 || pipe2(m_wake_fds, O_CLOEXEC) != 0)
+		{
+			zpr::fprintln(stderr, "xkeyslug: failed to create {} '{}': {} ({})", what, path, strerror(errno), errno);
+			if(m_listen_fd != -1)
+				close(m_listen_fd);
+
+			m_listen_fd = -1;
+			return false;
+		}
+
+		m_path = path;
+		m_on_client = on_client;
+		m_thread = std::thread(&UnixListener::run, this);
+
+		return true;
+	}
+
+	void UnixListener::stop()
+	{
+		if(m_listen_fd == -1)
+			return;
+
+		write(m_wake_fds[1], "x", 1);
+		m_thread.join();
+
+		close(m_listen_fd);
+		close(m_wake_fds[0]);
+		close(m_wake_fds[1]);
+		unlink(m_path.c_str());
+
+		m_listen_fd = -1;
+	}
+
+	void UnixListener::run()
+	{
+		pollfd fds[2] = {
+			{ .fd = m_listen_fd, .events = POLLIN, .revents = 0 },
+			{ .fd = m_wake_fds[0], .events = POLLIN, .revents = 0 },
+		};
+
+		while(poll(fds, 2, -1) >= 0 || errno == EINTR)
+		{
+			if(fds[1].revents != 0)
+				return;
+
+			if(not (fds[0].revents & POLLIN))
+				continue;
+
+			auto client = accept4(m_listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+			if(client == -1)
+				continue;
+
+			if(not m_on_client(client))
+				return;
+		}
+	}
+}
@@ -0,0 +1,149 @@
+// log.cpp
+// Copyright (c) 2022, zhiayang
+// SPDX-License-Identifier: Apache-2.0
+
+#include "log.h"
+
+#include <sys/uio.h>
+
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <vector>
+
+namespace slug
+{
+	std::atomic<bool> g_logging = false;
+
+	static std::mutex g_ringsLock;
+	static std::vector<LogRing*> g_rings;
+
+	static std::atomic<bool> g_stopFlusher = false;
+	static std::thread g_flusherThread;
+
+	static thread_local LogRing* t_ring = nullptr;
+
+	LogRing* getLogRing()
+	{
+		if(t_ring == nullptr)
+		{
+			t_ring = new LogRing();
+
+			auto lk = std::lock_guard(g_ringsLock);
+			g_rings.push_back(t_ring);
+		}
+
+		return t_ring;
+	}
+
+	uint64_t getLogDropped()
+	{
+		auto lk = std::lock_guard(g_ringsLock);
+
+		uint64_t dropped = 0;
+		for(auto ring : g_rings)
+			dropped += ring->dropped.load(std::memory_order_relaxed);
+
+		return dropped;
+	}
+
+	// consecutive records for the same fd go out in one writev().
+	struct Batch
+	{
+		static constexpr size_t MAX_IOVS = 64;
+
+		void add(int fd, const char* data, size_t len)
+		{
+			if(len == 0)
+				return;
+
+			if(fd != this->fd || this->count == MAX_IOVS)
+				this->flush();
+
+			this->fd = fd;
+			this->iovs[this->count++] = { .iov_base = const_cast<char*>(data), .iov_len = len };
+		}
+
+		void flush()
+		{
+			if(this->count > 0)
+				writev(this->fd, this->iovs, static_cast<int>(this->count));
+
+			this->count = 0;
+		}
+
+		int fd = -1;
+		size_t count = 0;
+		iovec iovs[MAX_IOVS] {};
+	};
+
+	static void drain_rings()
+	{
+		auto lk = std::lock_guard(g_ringsLock);
+
+		for(auto ring : g_rings)
+		{
+			auto tail = ring->tail.load(std::memory_order_relaxed);
+			auto head = ring->head.load(std::memory_order_acquire);
+			if(tail == head)
+				continue;
+
+			auto batch = Batch {};
+			for(auto pos = tail; pos != head; )
+			{
+				auto header = reinterpret_cast<const LogRing::Header*>(ring->data + pos % LogRing::CAPACITY);
+				auto ofs = (pos + sizeof(LogRing::Header)) % LogRing::CAPACITY;
+				auto first = std::min(static_cast<size_t>(header->len), LogRing::CAPACITY - ofs);
+
+				batch.add(header->fd, ring->data + ofs, first);
+				batch.add(header->fd, ring->data, header->len - first);
+
+				pos = (pos + sizeof(LogRing::Header) + header->len + 7) & ~size_t(7);
+			}
+
+			// the iovecs point into the ring, so the space can only be given back afterwards.
+			batch.flush();
+			ring->tail.store(head, std::memory_order_release);
+		}
+	}
+
+	static void flusher()
+	{
+		using namespace std::chrono_literals;
+		while(not g_stopFlusher.load(std::memory_order_relaxed))
+		{
+			std::this_thread::sleep_for(20ms);
+			drain_rings();
+		}
+	}
+
+	void startLogger()
+	{
+		// anything already in stdio's buffers has to come out first.
+		fflush(stdout);
+		fflush(stderr);
+
+		// this is called from the thread that handles keys, and its ring shouldn't be allocated (and
+		// faulted in) by the first message it logs.
+		getLogRing();
+
+		g_stopFlusher = false;
+		g_flusherThread = std::thread(&flusher);
+		g_logging = true;
+	}
+
+	void stopLogger()
+	{
+		if(not g_logging)
+			return;
+
+		g_logging = false;
+		g_stopFlusher = true;
+		g_flusherThread.join();
+
+		drain_rings();
+
+		if(auto dropped = getLogDropped(); dropped > 0)
+			zpr::fprintln(stderr, "xkeyslug: log buffers were full, dropped {} messages", dropped);
+	}
+}
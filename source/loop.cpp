@@ -0,0 +1,330 @@
+// loop.cpp
+// Copyright (c) 2022, zhiayang
+// SPDX-License-Identifier: Apache-2.0
+
+#include "slug.h"
+#include "log.h"
+#include "stats.h"
+#include "trace.h"
+#include "handoff.h"
+#include "keynames.h"
+#include "recorder.h"
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <sys/eventfd.h>
+
+#include <atomic>
+
+#include <X11/Xlib.h>
+#include <libevdev/libevdev.h>
+
+static std::atomic<bool> g_quit = false;
+
+// becomes readable (and stays so) once we're asked to quit; every loop waits on it together with
+// the input, so a request can't slip in between checking shouldQuit() and going to sleep.
+static int g_quitFd = -1;
+
+
+bool slug::shouldQuit()
+{
+	return g_quit.load(std::memory_order_relaxed);
+}
+
+// called from signal handlers too, so only async-signal-safe things in here.
+void slug::requestQuit()
+{
+	g_quit.store(true, std::memory_order_relaxed);
+
+	uint64_t one = 1;
+	if(g_quitFd != -1)
+		write(g_quitFd, &one, sizeof(one));
+}
+
+int slug::getQuitFd()
+{
+	return g_quitFd;
+}
+
+bool slug::shouldStopReading(struct libevdev* device_ev, bool at_frame_end)
+{
+	if(not shouldQuit())
+		return false;
+
+	if(not handoffRequested())
+		return true;
+
+	return at_frame_end && libevdev_has_event_pending(device_ev) <= 0;
+}
+
+static void run_classic_loop(struct libevdev* device_ev, slug::UInputDevice* uinput, slug::FocusProvider* focus, slug::LoopStats* stats)
+{
+	pollfd fds[2] = {
+		{ .fd = libevdev_get_fd(device_ev), .events = POLLIN, .revents = 0 },
+		{ .fd = slug::getQuitFd(), .events = POLLIN, .revents = 0 },
+	};
+
+	bool at_frame_end = true;
+	while(not slug::shouldStopReading(device_ev, at_frame_end))
+	{
+		// only sleep in poll() when libevdev has nothing queued (it only polls the fd itself when
+		// its queue is empty). if it was the quit fd, go around and check whether to stop.
+		if(libevdev_has_event_pending(device_ev) == 0)
+		{
+			slug::traceBegin("poll");
+			poll(fds, 2, -1);
+			slug::traceEnd("poll");
+
+			if(fds[0].revents == 0)
+				continue;
+		}
+
+		struct input_event event {};
+
+		slug::traceBegin("libevdev_next_event");
+		auto r = libevdev_next_event(device_ev, LIBEVDEV_READ_FLAG_NORMAL | LIBEVDEV_READ_FLAG_BLOCKING, &event);
+		slug::traceEnd("libevdev_next_event");
+
+		if(r < 0)
+		{
+			zpr::fprintln(stderr, "libevdev error: {}", r);
+			continue;
+		}
+
+		slug::handleInputEvent(uinput, focus, event);
+		stats->events++;
+
+		at_frame_end = (event.type == EV_SYN && event.code == SYN_REPORT);
+	}
+}
+
+static std::vector<slug::keycode_t> held_keys(int fd)
+{
+	std::vector<slug::keycode_t> ret;
+
+	uint8_t keys[KEY_CNT / 8 + 1] {};
+	if(ioctl(fd, EVIOCGKEY(sizeof(keys)), keys) < 0)
+		return ret;
+
+	for(slug::keycode_t k = 0; k < KEY_CNT; k++)
+	{
+		if(keys[k / 8] & (1 << (k % 8)))
+			ret.push_back(k);
+	}
+
+	return ret;
+}
+
+// these went to everyone else as well, so they must not be sent a second time through uinput.
+static void discard_pending_events(struct libevdev* device_ev)
+{
+	while(libevdev_has_event_pending(device_ev) > 0)
+	{
+		struct input_event event {};
+		if(libevdev_next_event(device_ev, LIBEVDEV_READ_FLAG_NORMAL, &event) != LIBEVDEV_READ_STATUS_SYNC)
+			continue;
+
+		while(libevdev_next_event(device_ev, LIBEVDEV_READ_FLAG_SYNC, &event) == LIBEVDEV_READ_STATUS_SYNC)
+			;
+	}
+}
+
+// if we grab while a key is down (eg. the enter that started us), its release only comes to us, and
+// the key stays stuck for whoever saw the press, since a release through uinput comes from a different
+// device. so grab straight away when nothing is held (which is usually the case), and otherwise give
+// the keys a moment to come up. after that, grab anyway: a stuck key must not keep us from starting.
+// the keys still held are returned, so the mapping can treat them as pressed and send their releases
+// on through uinput like any other.
+static constexpr int GRAB_WAIT_MS = 1000;
+
+static int grab_device(struct libevdev* device_ev, std::vector<slug::keycode_t>* held)
+{
+	auto fd = libevdev_get_fd(device_ev);
+	auto deadline = slug::monotonicNs() + GRAB_WAIT_MS * 1'000'000ull;
+	bool waited = false;
+
+	while(true)
+	{
+		discard_pending_events(device_ev);
+
+		auto now = slug::monotonicNs();
+		auto give_up = (now >= deadline);
+		if(give_up || held_keys(fd).empty())
+		{
+			if(auto err = libevdev_grab(device_ev, LIBEVDEV_GRAB); err != 0)
+				return err;
+
+			// anything that came in before the grab went to everyone else too. a key can still go
+			// down between checking and grabbing, so check again afterwards and back off if it did.
+			*held = held_keys(fd);
+			if(give_up || held->empty())
+			{
+				discard_pending_events(device_ev);
+				if(not held->empty())
+					zpr::println("xkeyslug: grabbing with {} key(s) still held", held->size());
+
+				return 0;
+			}
+
+			libevdev_grab(device_ev, LIBEVDEV_UNGRAB);
+			held->clear();
+		}
+
+		if(not waited)
+		{
+			zpr::println("xkeyslug: waiting for keys to be released before grabbing");
+			fflush(stdout);
+			waited = true;
+		}
+
+		auto pfd = pollfd { .fd = fd, .events = POLLIN, .revents = 0 };
+		poll(&pfd, 1, static_cast<int>((deadline - now + 999'999) / 1'000'000));
+	}
+}
+
+struct ProcIO
+{
+	uint64_t syscr = 0;
+	uint64_t syscw = 0;
+};
+
+static ProcIO read_proc_io()
+{
+	ProcIO ret {};
+	if(auto f = fopen("/proc/self/io", "r"); f != nullptr)
+	{
+		char line[128] {};
+		while(fgets(line, sizeof(line), f))
+		{
+			sscanf(line, "syscr: %lu", &ret.syscr);
+			sscanf(line, "syscw: %lu", &ret.syscw);
+		}
+
+		fclose(f);
+	}
+
+	return ret;
+}
+
+void slug::loop(struct libevdev* device_ev, const Options& opts, const Takeover* takeover)
+{
+	g_quitFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if(g_quitFd == -1)
+	{
+		zpr::fprintln(stderr, "xkeyslug: eventfd failed: {} ({})", strerror(errno), errno);
+		exit(1);
+	}
+
+	// a handed-over fd is still grabbed, and grabbing it again would fail with EBUSY.
+	std::vector<keycode_t> held;
+	if(takeover == nullptr)
+	{
+		if(auto err = grab_device(device_ev, &held); err != 0)
+		{
+			zpr::fprintln(stderr, "failed to grab device: {} ({})", strerror(-err), -err);
+			exit(-1);
+		}
+	}
+
+	auto device_name = libevdev_get_name(device_ev);
+	zpr::println("xkeyslug: {} device '{}'", takeover ? "took over" : "grabbed", device_name);
+	fflush(stdout);
+
+	auto x_display = XOpenDisplay(0);
+	if(x_display == nullptr)
+	{
+		zpr::fprintln(stderr, "X11 error: could not open display '{}'", XDisplayName(0));
+		exit(1);
+	}
+
+	// this needs to happen before the uinput device is created, so it picks up the new keycodes.
+	if(opts.kernel_remap)
+		installKernelRemaps(device_ev);
+
+	if(opts.hid_bpf)
+		loadHidBpf(libevdev_get_fd(device_ev));
+
+	// so the event timestamps can be compared against our own clock.
+	libevdev_set_clock_id(device_ev, CLOCK_MONOTONIC);
+
+	if(opts.stats_socket != nullptr)
+		startStatsServer(opts.stats_socket);
+
+	if(opts.flight_recorder != nullptr)
+		g_flightRecorder = FlightRecorder::open(opts.flight_recorder);
+
+	if(opts.trace != nullptr)
+		startTracing(opts.trace);
+
+	auto focus = slug::X11Focus(x_display);
+	auto sink = takeover ? slug::UInputSink(takeover->uinput_fd) : slug::UInputSink(device_ev);
+	auto uinputter = slug::UInputDevice(&sink, openFnModeControl(libevdev_get_fd(device_ev)));
+
+	if(takeover != nullptr)
+	{
+		uinputter.restoreModifiers(takeover->modifiers, takeover->real_modifiers);
+		restoreHeldRemaps(takeover->remaps);
+	}
+	else
+	{
+		seedHeldKeys(&uinputter, held);
+	}
+
+	if(auto mods = ModifierMask::of(uinputter.getRealModifiers()); mods.bits != 0)
+		zpr::println("xkeyslug: modifiers held at start: {}", mods);
+
+	if(opts.handoff_socket != nullptr)
+		startHandoffListener(opts.handoff_socket);
+
+	auto handler = [](int) {
+		zpr::println("xkeyslug: quitting");
+		requestQuit();
+	};
+
+	signal(SIGINT, handler);
+	signal(SIGTERM, handler);
+	signal(SIGUSR1, [](int) { dumpRuleStats(STDOUT_FILENO); });
+
+	auto io_before = read_proc_io();
+	startLogger();
+
+	LoopStats stats {};
+	auto used_uring = opts.io_uring && runUringLoop(device_ev, &uinputter, &focus, opts, &stats);
+	auto used_busy_poll = not used_uring && opts.busy_poll_us > 0 && runBusyPollLoop(device_ev, &uinputter, &focus, opts, &stats);
+	if(not used_uring && not used_busy_poll)
+		run_classic_loop(device_ev, &uinputter, &focus, &stats);
+
+	// the classic path is all read()s and write()s, which /proc/self/io counts; io_uring
+	// submissions don't show up there, so those are counted by the loop itself.
+	auto io_after = read_proc_io();
+	auto syscalls = (io_after.syscr - io_before.syscr) + (io_after.syscw - io_before.syscw) + stats.ring_enters;
+	zpr::println("xkeyslug: {} events, {.2f} syscalls/event ({})", stats.events,
+		stats.events == 0 ? 0.0 : static_cast<double>(syscalls) / static_cast<double>(stats.events),
+		used_uring ? "io_uring" : (used_busy_poll ? "busy-poll" : "classic"));
+
+	stopLogger();
+
+	XCloseDisplay(x_display);
+	stopStatsServer();
+	stopTracing();
+
+	delete g_flightRecorder;
+	g_flightRecorder = nullptr;
+
+	if(opts.kernel_remap)
+		restoreKernelRemaps(device_ev);
+
+	if(opts.hid_bpf)
+		unloadHidBpf();
+
+	stopHandoffListener();
+	if(completeHandoff(libevdev_get_fd(device_ev), &sink, &uinputter))
+		return;
+
+	// libevdev doesn't know about a grab that came with a handed-over fd.
+	if(takeover != nullptr)
+		ioctl(libevdev_get_fd(device_ev), EVIOCGRAB, 0);
+	else
+		libevdev_grab(device_ev, LIBEVDEV_UNGRAB);
+}
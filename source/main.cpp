@@ -3,95 +3,104 @@
 // SPDX-License-Identifier: Apache-2.0
 
 #include "slug.h"
-#include <signal.h>
+#include "handoff.h"
 
-#include <atomic>
-#include <thread>
-#include <chrono>
-
-#include <X11/Xlib.h>
 #include <libevdev/libevdev.h>
 
 static constexpr const char* KEYBOARD_EVENT_DEVICE = "/dev/input/by-id/usb-Apple_Inc._Apple_Internal_Keyboard___Trackpad_FM7036205D9N1R1B3+TNN-if01-event-kbd";
 
-static std::atomic<bool> g_quit = false;
-
 int main(int argc, char** argv)
 {
-	auto device_ev = libevdev_new();
-	auto device_fd = open(KEYBOARD_EVENT_DEVICE, O_RDONLY);
-	if(device_fd == -1)
-	{
-		zpr::fprintln(stderr, "failed to open device ('{}'): {} ({})",
-			KEYBOARD_EVENT_DEVICE, strerror(errno), errno);
-		exit(-1);
-	}
-
-	libevdev_set_fd(device_ev, device_fd);
-
-	// wait a bit before grabbing
-	using namespace std::chrono_literals;
-	std::this_thread::sleep_for(500ms);
-
-	slug::loop(device_ev);
-
-	libevdev_free(device_ev);
-	close(device_fd);
-}
+	slug::Options opts {};
+	const char* device_path = KEYBOARD_EVENT_DEVICE;
+	const char* takeover_path = nullptr;
 
-
-void slug::loop(struct libevdev* device_ev)
-{
-	if(auto err = libevdev_grab(device_ev, LIBEVDEV_GRAB); err != 0)
+	for(int i = 1; i < argc; i++)
 	{
-		zpr::fprintln(stderr, "failed to grab device: {} ({})", strerror(err), err);
-		exit(-1);
+		auto arg = std::string_view(argv[i]);
+		if(arg == "--kernel-remap")
+		{
+			opts.kernel_remap = true;
+		}
+		else if(arg == "--hid-bpf")
+		{
+			opts.hid_bpf = true;
+		}
+		else if(arg == "--io-uring")
+		{
+			opts.io_uring = true;
+		}
+		else if(arg == "--sqpoll")
+		{
+			opts.io_uring = true;
+			opts.sqpoll = true;
+		}
+		else if(arg.starts_with("--busy-poll="))
+		{
+			opts.busy_poll_us = static_cast<uint32_t>(strtoul(arg.substr(12).data(), nullptr, 10));
+		}
+		else if(arg.starts_with("--stats-socket="))
+		{
+			opts.stats_socket = argv[i] + 15;
+		}
+		else if(arg.starts_with("--flight-recorder="))
+		{
+			opts.flight_recorder = argv[i] + 18;
+		}
+		else if(arg.starts_with("--trace="))
+		{
+			opts.trace = argv[i] + 8;
+		}
+		else if(arg.starts_with("--handoff-socket="))
+		{
+			opts.handoff_socket = argv[i] + 17;
+		}
+		else if(arg.starts_with("--takeover="))
+		{
+			takeover_path = argv[i] + 11;
+		}
+		else if(arg.starts_with("--device="))
+		{
+			device_path = argv[i] + 9;
+		}
+		else
+		{
+			zpr::fprintln(stderr, "usage: {} [--device=<path>] [--kernel-remap] [--hid-bpf] [--io-uring] [--sqpoll] [--busy-poll=<us>]"
+				" [--stats-socket=<path>] [--flight-recorder=<path>]"
+				" [--trace=<path>] [--handoff-socket=<path>] [--takeover=<path>]", argv[0]);
+			exit(1);
+		}
 	}
 
-	auto device_name = libevdev_get_name(device_ev);
-	zpr::println("xkeyslug: grabbed device '{}'", device_name);
-	fflush(stdout);
+	auto device_ev = libevdev_new();
 
-	auto x_display = XOpenDisplay(0);
-	if(x_display == nullptr)
+	// the running instance hands over its (still grabbed) device.
+	if(takeover_path != nullptr)
 	{
-		zpr::fprintln(stderr, "X11 error: could not open display '{}'", XDisplayName(0));
-		exit(1);
-	}
-
-	auto uinputter = slug::UInputDevice(device_ev);
+		auto takeover = slug::takeOver(takeover_path);
+		if(not takeover.has_value())
+			exit(1);
 
-	auto handler = [](int) {
-		zpr::println("xkeyslug: quitting");
-		g_quit.store(true, std::memory_order_relaxed);
-	};
+		libevdev_set_fd(device_ev, takeover->evdev_fd);
+		slug::loop(device_ev, opts, &*takeover);
 
-	signal(SIGINT, handler);
-	signal(SIGTERM, handler);
+		libevdev_free(device_ev);
+		close(takeover->evdev_fd);
+		return 0;
+	}
 
-	while(not g_quit.load(std::memory_order_relaxed))
+	auto device_fd = open(device_path, O_RDONLY);
+	if(device_fd == -1)
 	{
-		struct input_event event {};
-		auto r = libevdev_next_event(device_ev, LIBEVDEV_READ_FLAG_NORMAL | LIBEVDEV_READ_FLAG_BLOCKING, &event);
-		if(r < 0)
-		{
-			zpr::fprintln(stderr, "libevdev error: {}", r);
-			continue;
-		}
-
-		if(event.type == EV_SYN && event.code == SYN_DROPPED)
-			zpr::fprintln(stderr, "too slow!"), fflush(stderr);
-
-		if(event.type != EV_KEY)
-		{
-			uinputter.send(event.type, event.code, event.value, /* sync: */ true);
-			continue;
-		}
-
-		processKeyEvent(&uinputter, x_display, event.code, KeyAction { event.value });
+		zpr::fprintln(stderr, "failed to open device ('{}'): {} ({})",
+			device_path, strerror(errno), errno);
+		exit(-1);
 	}
 
-	XCloseDisplay(x_display);
+	libevdev_set_fd(device_ev, device_fd);
+	slug::loop(device_ev, opts);
 
-	libevdev_grab(device_ev, LIBEVDEV_UNGRAB);
+	libevdev_free(device_ev);
+	close(device_fd);
 }
+
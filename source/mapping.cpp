@@ -3,6 +3,11 @@
 // SPDX-License-Identifier: Apache-2.0
 
 #include "slug.h"
+#include "log.h"
+#include "stats.h"
+#include "trace.h"
+#include "probes.h"
+#include "recorder.h"
 
 #include <linux/input.h>
 #include <unordered_map>
@@ -26,18 +31,239 @@ static inline bool is_modifier(keycode_t key)
 		|| key == MOD_CAPSLOCK;
 }
 
+// glob-style window title patterns, where '*' matches any run of characters. each pattern is split
+// into its literal segments at compile time, so matching is just a prefix check, a find() for each
+// inner segment and a suffix check. this only runs when a window's title changes (see x11.cpp).
+struct TitlePattern
+{
+	static constexpr size_t MAX_SEGMENTS = 8;
+
+	consteval TitlePattern(std::string_view glob, uint32_t profile) : profile(profile)
+	{
+		anchored_start = not glob.starts_with('*');
+		anchored_end = not glob.ends_with('*');
+
+		while(true)
+		{
+			auto star = glob.find('*');
+			auto segment = glob.substr(0, star);
+			if(not segment.empty())
+			{
+				if(num_segments == MAX_SEGMENTS)
+					too_many_segments_in_title_pattern();
+
+				segments[num_segments++] = segment;
+			}
+
+			if(star == std::string_view::npos)
+				break;
+
+			glob.remove_prefix(star + 1);
+		}
+	}
+
+	bool matches(std::string_view title) const
+	{
+		size_t i = 0;
+		size_t pos = 0;
+		if(anchored_start && num_segments > 0)
+		{
+			if(not title.starts_with(segments[0]))
+				return false;
+
+			pos = segments[0].size();
+			i = 1;
+		}
+
+		auto inner_end = (anchored_end && num_segments > i) ? num_segments - 1 : num_segments;
+		for(; i < inner_end; i++)
+		{
+			if(auto k = title.find(segments[i], pos); k != std::string_view::npos)
+				pos = k + segments[i].size();
+			else
+				return false;
+		}
+
+		if(not anchored_end)
+			return true;
+		else if(i == num_segments)
+			return pos == title.size();
+
+		auto& last = segments[num_segments - 1];
+		return title.size() - pos >= last.size() && title.ends_with(last);
+	}
+
+	uint32_t profile;
+
+private:
+	// not constexpr, so calling it from the constructor is a compile error.
+	static void too_many_segments_in_title_pattern() { }
+
+	bool anchored_start = false;
+	bool anchored_end = false;
+	size_t num_segments = 0;
+	std::string_view segments[MAX_SEGMENTS] {};
+};
+
+static constexpr TitlePattern g_titlePatterns[] = {
+	{ "* - VIM*", TITLE_VIM },      // vim with 'title' set
+	{ "*: vim", TITLE_VIM },        // konsole's default "%d : %n" tab title
+	{ "*: nvim", TITLE_VIM },
+};
+
+uint32_t slug::matchWindowTitle(std::string_view title)
+{
+	uint32_t profiles = 0;
+	for(auto& pattern : g_titlePatterns)
+	{
+		if(pattern.matches(title))
+			profiles |= pattern.profile;
+	}
+
+	return profiles;
+}
+
+// with --kernel-remap, these get installed into the device's keymap, so we never see the
+// original keycodes at all and don't need to check them here.
+static constexpr StaticRemap g_staticRemaps[] = {
+	{ KEY_CAPSLOCK, MOD_CAPSLOCK },
+};
+
+static bool g_staticRemapsInKernel = false;
+
+std::span<const StaticRemap> slug::getStaticRemaps()
+{
+	return g_staticRemaps;
+}
+
+void slug::setStaticRemapsInKernel(bool in_kernel)
+{
+	g_staticRemapsInKernel = in_kernel;
+}
+
+// while capslock is held, these keys are sent as (momentary) presses of the other key.
+static constexpr StaticRemap g_capslockLayer[] = {
+	{ KEY_Q, KEY_BACKSPACE },
+	{ KEY_K, KEY_BACKSPACE },
+	{ KEY_W, KEY_UP },
+	{ KEY_A, KEY_LEFT },
+	{ KEY_S, KEY_DOWN },
+	{ KEY_D, KEY_RIGHT },
+	{ KEY_SEMICOLON, KEY_HOME },
+	{ KEY_LEFT, KEY_HOME },
+	{ KEY_APOSTROPHE, KEY_END },
+	{ KEY_RIGHT, KEY_END },
+};
+
+RemapLayer slug::getCapslockLayer()
+{
+	return { .key = KEY_CAPSLOCK, .remaps = g_capslockLayer };
+}
+
+// every rule (branch) below has an id, so we can count how often it fires and how long the events
+// it handled took. these are reported by id, so don't renumber them; add new ones at the end.
+enum RuleId : uint16_t
+{
+	RULE_NONE                   = 0,    // nothing matched, the key was forwarded
+	RULE_STATIC_REMAP           = 1,
+	RULE_SUBLIME_KEEP_META      = 2,
+	RULE_META_TO_CTRL           = 3,
+	RULE_CAPSLOCK_LAYER         = 4,
+	RULE_KONSOLE_VIM_CTRL_W     = 5,
+	RULE_KONSOLE_K              = 6,
+	RULE_KONSOLE_T              = 7,
+	RULE_KONSOLE_W              = 8,
+	RULE_KONSOLE_C              = 9,
+	RULE_KONSOLE_V              = 10,
+	RULE_FIREFOX_TAB_NUMBER     = 11,
+	RULE_ALT_LEFT               = 12,
+	RULE_ALT_RIGHT              = 13,
+	RULE_ALT_UP                 = 14,
+	RULE_ALT_DOWN               = 15,
+	RULE_ALT_BACKSPACE          = 16,
+	RULE_ALT_DELETE             = 17,
+
+	NUM_RULES
+};
+
+static constexpr const char* g_ruleNames[] = {
+	"passthrough",
+	"static_remap",
+	"sublime_keep_meta",
+	"meta_to_ctrl",
+	"capslock_layer",
+	"konsole_vim_ctrl_w",
+	"konsole_ctrl_shift_k",
+	"konsole_ctrl_shift_t",
+	"konsole_ctrl_shift_w",
+	"konsole_ctrl_shift_c",
+	"konsole_ctrl_shift_v",
+	"firefox_tab_number",
+	"alt_left",
+	"alt_right",
+	"alt_up",
+	"alt_down",
+	"alt_backspace",
+	"alt_delete",
+};
+
+static_assert(std::size(g_ruleNames) == NUM_RULES);
+
+static RuleCounter g_ruleCounters[NUM_RULES] {};
+
+// at most a single-key rule and then a combo rule match for one event.
+static RuleId g_matchedRules[2] {};
+static size_t g_numMatchedRules = 0;
+
+static void hit(RuleId rule)
+{
+	SLUG_PROBE1(rule_hit, static_cast<int>(rule));
+	if(g_numMatchedRules < std::size(g_matchedRules))
+		g_matchedRules[g_numMatchedRules++] = rule;
+}
+
+size_t slug::getNumRules()
+{
+	return NUM_RULES;
+}
+
+const char* slug::getRuleName(size_t id)
+{
+	return id < NUM_RULES ? g_ruleNames[id] : "?";
+}
+
+const RuleCounter& slug::getRuleCounter(size_t id)
+{
+	return g_ruleCounters[id];
+}
+
 static keycode_t remap_single_key(const slug::WindowInfo& window_info, UInputDevice* ui, keycode_t keycode)
 {
-	if(keycode == KEY_CAPSLOCK)
-		return MOD_CAPSLOCK;
+	if(not g_staticRemapsInKernel)
+	{
+		for(auto& remap : g_staticRemaps)
+		{
+			if(keycode == remap.from)
+			{
+				hit(RULE_STATIC_REMAP);
+				return remap.to;
+			}
+		}
+	}
 
 	// for sublime text, keep meta as meta.
 	if(keycode == KEY_LEFTMETA)
 	{
 		if(window_info.wm_class == "Sublime_text")
+		{
+			hit(RULE_SUBLIME_KEEP_META);
 			return KEY_LEFTMETA;
+		}
 		else
+		{
+			hit(RULE_META_TO_CTRL);
 			return KEY_RIGHTCTRL;
+		}
 	}
 
 	return keycode;
@@ -47,52 +273,94 @@ static bool remap_key_combo(const slug::WindowInfo& window_info, UInputDevice* u
 {
 	if(ui->isPressed(MOD_CAPSLOCK))
 	{
-		if(keycode == KEY_Q || keycode == KEY_K)    return ui->sendKeyMomentary(KEY_BACKSPACE);
-		else if(keycode == KEY_W)                   return ui->sendKeyMomentary(KEY_UP);
-		else if(keycode == KEY_A)                   return ui->sendKeyMomentary(KEY_LEFT);
-		else if(keycode == KEY_S)                   return ui->sendKeyMomentary(KEY_DOWN);
-		else if(keycode == KEY_D)                   return ui->sendKeyMomentary(KEY_RIGHT);
-		else if(keycode == KEY_SEMICOLON || keycode == KEY_LEFT)
-			return ui->sendKeyMomentary(KEY_HOME);
-		else if(keycode == KEY_APOSTROPHE || keycode == KEY_RIGHT)
-			return ui->sendKeyMomentary(KEY_END);
+		for(auto& remap : g_capslockLayer)
+		{
+			if(keycode == remap.from)
+			{
+				hit(RULE_CAPSLOCK_LAYER);
+				return ui->sendKeyMomentary(remap.to);
+			}
+		}
 	}
 
 	if(window_info.wm_class == "konsole")
 	{
 		if(ui->isPressedReal(KEY_LEFTMETA))
 		{
+			// let vim have ctrl-w for window commands instead of closing the tab.
+			if(keycode == KEY_W && (window_info.title_profiles & TITLE_VIM))
+			{
+				hit(RULE_KONSOLE_VIM_CTRL_W);
+				return false;
+			}
+
 			if(keycode == KEY_K)
+			{
+				hit(RULE_KONSOLE_K);
 				return ui->sendCombo({ KEY_LEFTCTRL, KEY_LEFTSHIFT }, KEY_K);
+			}
 			else if(keycode == KEY_T)
+			{
+				hit(RULE_KONSOLE_T);
 				return ui->sendCombo({ KEY_LEFTCTRL, KEY_LEFTSHIFT }, KEY_T);
+			}
 			else if(keycode == KEY_W)
+			{
+				hit(RULE_KONSOLE_W);
 				return ui->sendCombo({ KEY_LEFTCTRL, KEY_LEFTSHIFT }, KEY_W);
+			}
 			else if(keycode == KEY_C)
+			{
+				hit(RULE_KONSOLE_C);
 				return ui->sendCombo({ KEY_LEFTCTRL, KEY_LEFTSHIFT }, KEY_C);
+			}
 			else if(keycode == KEY_V)
+			{
+				hit(RULE_KONSOLE_V);
 				return ui->sendCombo({ KEY_LEFTCTRL, KEY_LEFTSHIFT }, KEY_V);
+			}
 		}
 	}
 	else if(window_info.wm_class != "Sublime_text")
 	{
 		if(window_info.wm_class == "firefox" && ui->isPressedReal(KEY_LEFTMETA) && KEY_1 <= keycode && keycode <= KEY_9)
+		{
+			hit(RULE_FIREFOX_TAB_NUMBER);
 			return ui->sendCombo({ KEY_LEFTALT }, keycode);
+		}
 
 		if(ui->isPressedReal(KEY_LEFTALT))
 		{
 			if(keycode == KEY_LEFT)
+			{
+				hit(RULE_ALT_LEFT);
 				return ui->sendCombo({ KEY_LEFTCTRL }, KEY_LEFT);
+			}
 			else if(keycode == KEY_RIGHT)
+			{
+				hit(RULE_ALT_RIGHT);
 				return ui->sendCombo({ KEY_LEFTCTRL }, KEY_RIGHT);
+			}
 			else if(keycode == KEY_UP)
+			{
+				hit(RULE_ALT_UP);
 				return ui->sendCombo({ KEY_LEFTCTRL }, KEY_UP);
+			}
 			else if(keycode == KEY_DOWN)
+			{
+				hit(RULE_ALT_DOWN);
 				return ui->sendCombo({ KEY_LEFTCTRL }, KEY_DOWN);
+			}
 			else if(keycode == KEY_BACKSPACE)
+			{
+				hit(RULE_ALT_BACKSPACE);
 				return ui->sendCombo({ KEY_LEFTCTRL }, KEY_BACKSPACE);
+			}
 			else if(keycode == KEY_DELETE)
+			{
+				hit(RULE_ALT_DELETE);
 				return ui->sendCombo({ KEY_LEFTCTRL }, KEY_DELETE);
+			}
 		}
 	}
 
@@ -116,7 +384,30 @@ static bool remap_key_combo(const slug::WindowInfo& window_info, UInputDevice* u
 
 static std::unordered_map<keycode_t, keycode_t> g_currentMapping;
 
-void slug::processKeyEvent(UInputDevice* uinput, Display* x_display, unsigned int real_keycode, KeyAction action)
+std::vector<std::pair<keycode_t, keycode_t>> slug::getHeldRemaps()
+{
+	return { g_currentMapping.begin(), g_currentMapping.end() };
+}
+
+void slug::restoreHeldRemaps(std::span<const std::pair<keycode_t, keycode_t>> remaps)
+{
+	g_currentMapping = { remaps.begin(), remaps.end() };
+}
+
+void slug::seedHeldKeys(UInputDevice* uinput, std::span<const keycode_t> keys)
+{
+	// their presses went out through the keyboard itself, not uinput, so only our view changes.
+	for(auto key : keys)
+	{
+		if(not is_modifier(key))
+			continue;
+
+		uinput->press(key);
+		uinput->pressReal(key);
+	}
+}
+
+static void process_key_event(UInputDevice* uinput, FocusProvider* focus, unsigned int real_keycode, KeyAction action)
 {
 	// special handling for function key
 	if(real_keycode == KEY_FN)
@@ -125,7 +416,14 @@ void slug::processKeyEvent(UInputDevice* uinput, Display* x_display, unsigned in
 		return;
 	}
 
-	auto window_info = getCurrentWindowInfo(x_display);
+	auto focus_start = g_stats.enabled ? monotonicNs() : 0;
+
+	traceBegin("getCurrentWindowInfo");
+	auto& window_info = focus->getCurrentWindowInfo();
+	traceEnd("getCurrentWindowInfo");
+
+	if(g_stats.enabled)
+		g_stats.focus_query.record(monotonicNs() - focus_start);
 
 	if(is_modifier(real_keycode))
 		uinput->pressReal(real_keycode);
@@ -153,7 +451,14 @@ void slug::processKeyEvent(UInputDevice* uinput, Display* x_display, unsigned in
 	// first, perform single remappings.
 	auto keycode = remap_single_key(window_info, uinput, real_keycode);
 	if(keycode != real_keycode)
+	{
+		SLUG_PROBE2(rule_single, real_keycode, keycode);
+		if(g_flightRecorder != nullptr)
+			g_flightRecorder->remap(real_keycode, keycode);
+
 		g_currentMapping[real_keycode] = keycode;
+		countStat(g_stats.remaps);
+	}
 
 	if(is_modifier(keycode))
 		uinput->press(keycode);
@@ -162,6 +467,93 @@ void slug::processKeyEvent(UInputDevice* uinput, Display* x_display, unsigned in
 		uinput->press(real_keycode);
 
 	// if there was no mapping, then just forward the key.
-	if(not remap_key_combo(window_info, uinput, keycode, action))
+	if(remap_key_combo(window_info, uinput, keycode, action))
+	{
+		SLUG_PROBE2(rule_combo, keycode, window_info.wm_class.c_str());
+		if(g_flightRecorder != nullptr)
+			g_flightRecorder->combo(keycode);
+
+		countStat(g_stats.combos);
+	}
+	else
+	{
 		uinput->sendKey(keycode, action, /* sync: */ true);
+	}
+}
+
+void slug::processKeyEvent(UInputDevice* uinput, FocusProvider* focus, unsigned int real_keycode, KeyAction action)
+{
+	auto span = TraceSpan("processKeyEvent");
+
+	SLUG_PROBE2(key_entry, real_keycode, static_cast<int>(action));
+
+	// the hits are always counted (for SIGUSR1), but the time only with the stats server on.
+	auto timed = g_stats.enabled;
+	auto start = timed ? monotonicNs() : 0;
+	g_numMatchedRules = 0;
+
+	process_key_event(uinput, focus, real_keycode, action);
+
+	// releases (and fn) don't go through the rules at all.
+	if(action != KeyAction::Release && real_keycode != KEY_FN)
+	{
+		auto ns = timed ? monotonicNs() - start : 0;
+		if(g_numMatchedRules == 0)
+			g_matchedRules[g_numMatchedRules++] = RULE_NONE;
+
+		for(size_t i = 0; i < g_numMatchedRules; i++)
+		{
+			auto& counter = g_ruleCounters[g_matchedRules[i]];
+			counter.hits.fetch_add(1, std::memory_order_relaxed);
+			if(timed)
+				counter.total_ns.fetch_add(ns, std::memory_order_relaxed);
+		}
+	}
+
+	SLUG_PROBE1(key_return, real_keycode);
+}
+
+static void handle_input_event(UInputDevice* uinput, FocusProvider* focus, const struct input_event& event)
+{
+	// every loop calls handleInputEvent right after reading, so this is as good as the read itself.
+	SLUG_PROBE3(event_read, event.type, event.code, event.value);
+	if(g_flightRecorder != nullptr)
+		g_flightRecorder->input(event.type, event.code, event.value);
+
+	if(event.type == EV_SYN && event.code == SYN_DROPPED)
+	{
+		logErrorln("too slow!"_fmt);
+		countStat(g_stats.syn_dropped);
+	}
+
+	if(event.type != EV_KEY)
+	{
+		uinput->send(event.type, event.code, event.value, /* sync: */ true);
+		return;
+	}
+
+	processKeyEvent(uinput, focus, event.code, KeyAction { event.value });
+}
+
+void slug::handleInputEvent(UInputDevice* uinput, FocusProvider* focus, const struct input_event& event)
+{
+	if(not g_stats.enabled)
+	{
+		handle_input_event(uinput, focus, event);
+		return;
+	}
+
+	// the loops call this right after reading the event, and (except for io_uring, which batches)
+	// the output has been written by the time it returns. loop() sets the evdev clock to monotonic.
+	auto read_ns = monotonicNs();
+	auto event_ns = static_cast<uint64_t>(event.input_event_sec) * 1'000'000'000
+		+ static_cast<uint64_t>(event.input_event_usec) * 1000;
+
+	if(read_ns >= event_ns)
+		g_stats.kernel_to_read.record(read_ns - event_ns);
+
+	handle_input_event(uinput, focus, event);
+
+	g_stats.read_to_write.record(monotonicNs() - read_ns);
+	g_stats.events.fetch_add(1, std::memory_order_relaxed);
 }
@@ -0,0 +1,361 @@
+// recorder.cpp
+// Copyright (c) 2022, zhiayang
+// SPDX-License-Identifier: Apache-2.0
+
+#include "stats.h"
+#include "recorder.h"
+
+#include <sys/mman.h>
+
+#include <atomic>
+#include <algorithm>
+
+namespace slug
+{
+	FlightRecorder* g_flightRecorder = nullptr;
+
+	static uint64_t realtime_ns()
+	{
+		struct timespec ts {};
+		clock_gettime(CLOCK_REALTIME, &ts);
+		return static_cast<uint64_t>(ts.tv_sec) * 1'000'000'000 + static_cast<uint64_t>(ts.tv_nsec);
+	}
+
+	static size_t put_varint(uint8_t* out, uint64_t value)
+	{
+		size_t n = 0;
+		while(value >= 0x80)
+		{
+			out[n++] = static_cast<uint8_t>(value | 0x80);
+			value >>= 7;
+		}
+
+		out[n++] = static_cast<uint8_t>(value);
+		return n;
+	}
+
+	static uint64_t zigzag(int value)
+	{
+		return (static_cast<uint64_t>(static_cast<int64_t>(value)) << 1) ^ static_cast<uint64_t>(static_cast<int64_t>(value) >> 63);
+	}
+
+	static int unzigzag(uint64_t value)
+	{
+		return static_cast<int>(static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1));
+	}
+
+	FlightRecorder* FlightRecorder::open(const char* path, size_t num_blocks)
+	{
+		// this has keystrokes in it, so nobody else gets to read it.
+		auto fd = ::open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+		if(fd == -1)
+		{
+			zpr::fprintln(stderr, "xkeyslug: failed to open flight recorder '{}': {} ({})", path, strerror(errno), errno);
+			return nullptr;
+		}
+
+		auto size = HEADER_SIZE + num_blocks * BLOCK_SIZE;
+
+		struct stat st {};
+		auto reuse = fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) == size;
+		if(not reuse && ftruncate(fd, static_cast<off_t>(size)) != 0)
+		{
+			zpr::fprintln(stderr, "xkeyslug: failed to size flight recorder '{}': {} ({})", path, strerror(errno), errno);
+			close(fd);
+			return nullptr;
+		}
+
+		auto map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+
+		if(map == MAP_FAILED)
+		{
+			zpr::fprintln(stderr, "xkeyslug: failed to map flight recorder '{}': {} ({})", path, strerror(errno), errno);
+			return nullptr;
+		}
+
+		auto rec = new FlightRecorder();
+		rec->m_map = static_cast<uint8_t*>(map);
+		rec->m_map_size = size;
+		rec->m_num_blocks = num_blocks;
+
+		auto header = reinterpret_cast<RecorderFileHeader*>(rec->m_map);
+		if(reuse && memcmp(header->magic, RecorderFileHeader::MAGIC, sizeof(header->magic)) == 0
+			&& header->version == RecorderFileHeader::VERSION && header->block_size == BLOCK_SIZE
+			&& header->num_blocks == num_blocks)
+		{
+			// carry on after the newest block.
+			for(size_t i = 0; i < num_blocks; i++)
+				rec->m_seq = std::max(rec->m_seq, reinterpret_cast<RecorderBlockHeader*>(rec->m_map + HEADER_SIZE + i * BLOCK_SIZE)->seq);
+		}
+		else
+		{
+			memset(rec->m_map, 0, size);
+			memcpy(header->magic, RecorderFileHeader::MAGIC, sizeof(header->magic));
+			header->version = RecorderFileHeader::VERSION;
+			header->block_size = BLOCK_SIZE;
+			header->num_blocks = num_blocks;
+		}
+
+		rec->start_block(monotonicNs());
+
+		zpr::println("xkeyslug: flight recorder at '{}' ({} KiB)", path, size / 1024);
+		fflush(stdout);
+
+		return rec;
+	}
+
+	FlightRecorder::~FlightRecorder()
+	{
+		msync(m_map, m_map_size, MS_ASYNC);
+		munmap(m_map, m_map_size);
+	}
+
+	RecorderBlockHeader* FlightRecorder::block(uint64_t seq)
+	{
+		return reinterpret_cast<RecorderBlockHeader*>(m_map + HEADER_SIZE + ((seq - 1) % m_num_blocks) * BLOCK_SIZE);
+	}
+
+	void FlightRecorder::start_block(uint64_t now)
+	{
+		m_seq++;
+		auto blk = this->block(m_seq);
+
+		// invalidate it first, so a half-written header is never mistaken for a good block.
+		blk->seq = 0;
+		std::atomic_signal_fence(std::memory_order_release);
+
+		blk->base_mono_ns = now;
+		blk->base_real_ns = realtime_ns();
+		blk->used = 0;
+		std::atomic_signal_fence(std::memory_order_release);
+
+		blk->seq = m_seq;
+		m_last_ns = now;
+	}
+
+	void FlightRecorder::append(RecordKind kind, const uint8_t* payload, size_t len)
+	{
+		auto now = monotonicNs();
+
+		// kind byte + up to 10 bytes of delta.
+		auto blk = this->block(m_seq);
+		if(sizeof(RecorderBlockHeader) + blk->used + 1 + 10 + len > BLOCK_SIZE)
+		{
+			this->start_block(now);
+			blk = this->block(m_seq);
+		}
+
+		auto out = reinterpret_cast<uint8_t*>(blk + 1) + blk->used;
+
+		size_t n = 0;
+		out[n++] = static_cast<uint8_t>(kind);
+		n += put_varint(out + n, now - m_last_ns);
+		memcpy(out + n, payload, len);
+		n += len;
+
+		// the record has to be there before the decoder can see it.
+		std::atomic_signal_fence(std::memory_order_release);
+		blk->used += static_cast<uint32_t>(n);
+
+		m_last_ns = now;
+	}
+
+	void FlightRecorder::input(unsigned int type, unsigned int code, int value)
+	{
+		uint8_t buf[32];
+		size_t n = put_varint(buf, type);
+		n += put_varint(buf + n, code);
+		n += put_varint(buf + n, zigzag(value));
+
+		this->append(RecordKind::Input, buf, n);
+	}
+
+	void FlightRecorder::output(unsigned int type, unsigned int code, int value)
+	{
+		uint8_t buf[32];
+		size_t n = put_varint(buf, type);
+		n += put_varint(buf + n, code);
+		n += put_varint(buf + n, zigzag(value));
+
+		this->append(RecordKind::Output, buf, n);
+	}
+
+	void FlightRecorder::remap(keycode_t from, keycode_t to)
+	{
+		uint8_t buf[16];
+		size_t n = put_varint(buf, from);
+		n += put_varint(buf + n, to);
+
+		this->append(RecordKind::Remap, buf, n);
+	}
+
+	void FlightRecorder::combo(keycode_t code)
+	{
+		uint8_t buf[8];
+		size_t n = put_varint(buf, code);
+
+		this->append(RecordKind::Combo, buf, n);
+	}
+
+	void FlightRecorder::focus(std::string_view wm_class, std::string_view title)
+	{
+		wm_class = wm_class.substr(0, MAX_STRING);
+		title = title.substr(0, MAX_STRING);
+
+		uint8_t buf[4 + 2 * MAX_STRING];
+		size_t n = put_varint(buf, wm_class.size());
+		memcpy(buf + n, wm_class.data(), wm_class.size());
+		n += wm_class.size();
+
+		n += put_varint(buf + n, title.size());
+		memcpy(buf + n, title.data(), title.size());
+		n += title.size();
+
+		this->append(RecordKind::Focus, buf, n);
+	}
+
+
+
+
+	static bool get_varint(const uint8_t*& ptr, const uint8_t* end, uint64_t* out)
+	{
+		uint64_t value = 0;
+		for(int shift = 0; ptr < end && shift < 64; shift += 7)
+		{
+			auto byte = *ptr++;
+			value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+			if(not (byte & 0x80))
+			{
+				*out = value;
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	static bool get_string(const uint8_t*& ptr, const uint8_t* end, std::string* out)
+	{
+		uint64_t len = 0;
+		if(not get_varint(ptr, end, &len) || len > static_cast<uint64_t>(end - ptr))
+			return false;
+
+		*out = std::string(reinterpret_cast<const char*>(ptr), len);
+		ptr += len;
+		return true;
+	}
+
+	static void decode_block(const RecorderBlockHeader* blk, std::vector<DecodedRecord>* out)
+	{
+		auto ptr = reinterpret_cast<const uint8_t*>(blk + 1);
+		auto end = ptr + std::min(static_cast<size_t>(blk->used), FlightRecorder::BLOCK_SIZE - sizeof(RecorderBlockHeader));
+
+		uint64_t time = blk->base_mono_ns;
+		while(ptr < end)
+		{
+			auto rec = DecodedRecord {};
+			rec.kind = static_cast<RecordKind>(*ptr++);
+
+			uint64_t delta = 0;
+			if(not get_varint(ptr, end, &delta))
+				return;
+
+			time += delta;
+			rec.mono_ns = time;
+			rec.real_ns = blk->base_real_ns + (time - blk->base_mono_ns);
+
+			uint64_t a = 0;
+			uint64_t b = 0;
+			uint64_t c = 0;
+			switch(rec.kind)
+			{
+				case RecordKind::Input:
+				case RecordKind::Output:
+					if(not get_varint(ptr, end, &a) || not get_varint(ptr, end, &b) || not get_varint(ptr, end, &c))
+						return;
+
+					rec.type = static_cast<unsigned int>(a);
+					rec.code = static_cast<unsigned int>(b);
+					rec.value = unzigzag(c);
+					break;
+
+				case RecordKind::Remap:
+					if(not get_varint(ptr, end, &a) || not get_varint(ptr, end, &b))
+						return;
+
+					rec.code = static_cast<unsigned int>(a);
+					rec.value = static_cast<int>(b);
+					break;
+
+				case RecordKind::Combo:
+					if(not get_varint(ptr, end, &a))
+						return;
+
+					rec.code = static_cast<unsigned int>(a);
+					break;
+
+				case RecordKind::Focus:
+					if(not get_string(ptr, end, &rec.wm_class) || not get_string(ptr, end, &rec.title))
+						return;
+
+					break;
+
+				default:
+					// garbage; the rest of the block can't be trusted either.
+					return;
+			}
+
+			out->push_back(std::move(rec));
+		}
+	}
+
+	bool decodeFlightRecording(const char* path, std::vector<DecodedRecord>* out)
+	{
+		auto fd = ::open(path, O_RDONLY | O_CLOEXEC);
+		if(fd == -1)
+		{
+			zpr::fprintln(stderr, "failed to open '{}': {} ({})", path, strerror(errno), errno);
+			return false;
+		}
+
+		struct stat st {};
+		fstat(fd, &st);
+
+		auto size = static_cast<size_t>(st.st_size);
+		auto map = size >= FlightRecorder::HEADER_SIZE ? mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+		close(fd);
+
+		if(map == MAP_FAILED)
+		{
+			zpr::fprintln(stderr, "'{}' is not a flight recording", path);
+			return false;
+		}
+
+		auto base = static_cast<const uint8_t*>(map);
+		auto header = reinterpret_cast<const RecorderFileHeader*>(base);
+		if(memcmp(header->magic, RecorderFileHeader::MAGIC, sizeof(header->magic)) != 0
+			|| header->version != RecorderFileHeader::VERSION || header->block_size != FlightRecorder::BLOCK_SIZE
+			|| FlightRecorder::HEADER_SIZE + header->num_blocks * FlightRecorder::BLOCK_SIZE > size)
+		{
+			zpr::fprintln(stderr, "'{}' is not a flight recording (or is from another version)", path);
+			munmap(map, size);
+			return false;
+		}
+
+		std::vector<const RecorderBlockHeader*> blocks;
+		for(size_t i = 0; i < header->num_blocks; i++)
+		{
+			auto blk = reinterpret_cast<const RecorderBlockHeader*>(base + FlightRecorder::HEADER_SIZE + i * FlightRecorder::BLOCK_SIZE);
+			if(blk->seq != 0)
+				blocks.push_back(blk);
+		}
+
+		std::sort(blocks.begin(), blocks.end(), [](auto a, auto b) { return a->seq < b->seq; });
+		for(auto blk : blocks)
+			decode_block(blk, out);
+
+		munmap(map, size);
+		return true;
+	}
+}
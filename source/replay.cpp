@@ -0,0 +1,207 @@
+// replay.cpp
+// Copyright (c) 2022, zhiayang
+// SPDX-License-Identifier: Apache-2.0
+
+#include "replay.h"
+#include "keynames.h"
+
+namespace slug
+{
+	static uint64_t to_us(const struct timeval& tv)
+	{
+		return static_cast<uint64_t>(tv.tv_sec) * 1'000'000 + static_cast<uint64_t>(tv.tv_usec);
+	}
+
+	void MemorySink::write(const struct input_event* events, size_t count)
+	{
+		for(size_t i = 0; i < count; i++)
+		{
+			auto ev = events[i];
+			ev.input_event_sec = this->now.tv_sec;
+			ev.input_event_usec = this->now.tv_usec;
+			this->events.push_back(ev);
+		}
+	}
+
+	bool TimelineFocus::load(const char* path)
+	{
+		auto f = fopen(path, "r");
+		if(f == nullptr)
+		{
+			zpr::fprintln(stderr, "failed to open '{}': {} ({})", path, strerror(errno), errno);
+			return false;
+		}
+
+		char line[1024] {};
+		size_t line_num = 0;
+		while(fgets(line, sizeof(line), f))
+		{
+			line_num++;
+
+			auto sv = std::string_view(line);
+			while(not sv.empty() && (sv.back() == '\n' || sv.back() == '\r'))
+				sv.remove_suffix(1);
+
+			if(sv.empty() || sv[0] == '#')
+				continue;
+
+			unsigned long sec = 0;
+			unsigned long usec = 0;
+			int consumed = 0;
+			if(sscanf(line, "%lu.%lu %n", &sec, &usec, &consumed) != 2 || consumed == 0)
+			{
+				zpr::fprintln(stderr, "{}:{}: expected '<sec>.<usec> <class> <title>'", path, line_num);
+				fclose(f);
+				return false;
+			}
+
+			sv.remove_prefix(std::min(sv.size(), static_cast<size_t>(consumed)));
+
+			auto space = sv.find(' ');
+			auto entry = Entry { .time_us = sec * 1'000'000 + usec, .info = {} };
+			entry.info.wm_class = std::string(sv.substr(0, space));
+			if(entry.info.wm_class == "-")
+				entry.info.wm_class.clear();
+			if(space != std::string_view::npos)
+				entry.info.wm_name = std::string(sv.substr(space + 1));
+
+			entry.info.title_profiles = matchWindowTitle(entry.info.wm_name);
+
+			if(not m_timeline.empty() && entry.time_us < m_timeline.back().time_us)
+			{
+				zpr::fprintln(stderr, "{}:{}: timestamps must not go backwards", path, line_num);
+				fclose(f);
+				return false;
+			}
+
+			m_timeline.push_back(std::move(entry));
+		}
+
+		fclose(f);
+		return true;
+	}
+
+	void TimelineFocus::setTime(const struct timeval& time)
+	{
+		// replays go forward in time, so just advance from where we were.
+		auto us = to_us(time);
+		while(m_current + 1 < m_timeline.size() && m_timeline[m_current + 1].time_us <= us)
+			m_current++;
+
+		m_started = not m_timeline.empty() && m_timeline[m_current].time_us <= us;
+	}
+
+	const WindowInfo& TimelineFocus::getCurrentWindowInfo()
+	{
+		if(not m_started)
+			return m_none;
+
+		return m_timeline[m_current].info;
+	}
+
+	std::vector<struct input_event> readEventFile(const char* path)
+	{
+		std::vector<struct input_event> ret;
+
+		auto fd = open(path, O_RDONLY);
+		if(fd == -1)
+		{
+			zpr::fprintln(stderr, "failed to open '{}': {} ({})", path, strerror(errno), errno);
+			return ret;
+		}
+
+		struct input_event buf[64];
+		while(true)
+		{
+			auto n = read(fd, buf, sizeof(buf));
+			if(n <= 0)
+				break;
+
+			if(n % sizeof(struct input_event) != 0)
+				zpr::fprintln(stderr, "'{}': ignoring a truncated event at the end", path);
+
+			ret.insert(ret.end(), buf, buf + static_cast<size_t>(n) / sizeof(struct input_event));
+		}
+
+		close(fd);
+		return ret;
+	}
+
+	bool readEventText(const char* path, std::vector<struct input_event>* out)
+	{
+		auto f = fopen(path, "r");
+		if(f == nullptr)
+		{
+			zpr::fprintln(stderr, "failed to open '{}': {} ({})", path, strerror(errno), errno);
+			return false;
+		}
+
+		char line[256] {};
+		size_t line_num = 0;
+		while(fgets(line, sizeof(line), f))
+		{
+			line_num++;
+
+			auto sv = std::string_view(line);
+			while(not sv.empty() && (sv.back() == '\n' || sv.back() == '\r'))
+				sv.remove_suffix(1);
+
+			if(sv.empty() || sv[0] == '#')
+				continue;
+
+			unsigned long sec = 0;
+			unsigned long usec = 0;
+			unsigned int type = 0;
+			unsigned int code = 0;
+			int value = 0;
+			char code_str[64] {};
+			if(sscanf(line, "%lu.%lu %u %63s %d", &sec, &usec, &type, code_str, &value) != 5)
+			{
+				zpr::fprintln(stderr, "{}:{}: expected '<sec>.<usec> <type> <code> <value>'", path, line_num);
+				fclose(f);
+				return false;
+			}
+
+			// the code can also be given by name, eg. KEY_LEFTMETA.
+			char* end = nullptr;
+			code = static_cast<unsigned int>(strtoul(code_str, &end, 10));
+			if(*end != 0)
+			{
+				auto key = keycodeFromName(code_str);
+				if(not key.has_value())
+				{
+					zpr::fprintln(stderr, "{}:{}: unknown code '{}'", path, line_num, std::string_view(code_str));
+					fclose(f);
+					return false;
+				}
+
+				code = *key;
+			}
+
+			struct input_event ev {};
+			ev.input_event_sec = static_cast<decltype(ev.input_event_sec)>(sec);
+			ev.input_event_usec = static_cast<decltype(ev.input_event_usec)>(usec);
+			ev.type = static_cast<uint16_t>(type);
+			ev.code = static_cast<uint16_t>(code);
+			ev.value = value;
+			out->push_back(ev);
+		}
+
+		fclose(f);
+		return true;
+	}
+
+	void replayEvents(std::span<const struct input_event> input, TimelineFocus* focus, MemorySink* sink)
+	{
+		auto uinput = UInputDevice(sink);
+
+		for(auto& ev : input)
+		{
+			auto time = timeval { .tv_sec = ev.input_event_sec, .tv_usec = ev.input_event_usec };
+			focus->setTime(time);
+			sink->now = time;
+
+			handleInputEvent(&uinput, focus, ev);
+		}
+	}
+}
@@ -0,0 +1,154 @@
+// stats.cpp
+// Copyright (c) 2022, zhiayang
+// SPDX-License-Identifier: Apache-2.0
+
+#include "stats.h"
+#include "log.h"
+#include "listener.h"
+
+#include <sys/uio.h>
+#include <sys/socket.h>
+
+namespace slug
+{
+	PipelineStats g_stats {};
+
+	uint64_t LatencyHistogram::percentile(double p) const
+	{
+		auto total = this->count.load(std::memory_order_relaxed);
+		if(total == 0)
+			return 0;
+
+		auto target = static_cast<uint64_t>(p * static_cast<double>(total));
+		uint64_t seen = 0;
+		for(size_t i = 0; i < NUM_BUCKETS; i++)
+		{
+			seen += this->buckets[i].load(std::memory_order_relaxed);
+			if(seen > target)
+				return std::min(bucket_max(i), this->max_ns.load(std::memory_order_relaxed));
+		}
+
+		return this->max_ns.load(std::memory_order_relaxed);
+	}
+
+	static void format_histogram(zpr::arena_buffer& out, const char* stage, const LatencyHistogram& hist)
+	{
+		for(auto q : { 0.5, 0.9, 0.99, 0.999 })
+			zpr::sprint(out, "xkeyslug_latency_ns{{stage=\"{}\",quantile=\"{}\"}} {}\n"_fmt, stage, q, hist.percentile(q));
+
+		zpr::sprint(out, "xkeyslug_latency_ns_max{{stage=\"{}\"}} {}\n"_fmt, stage, hist.max_ns.load(std::memory_order_relaxed));
+		zpr::sprint(out, "xkeyslug_latency_ns_sum{{stage=\"{}\"}} {}\n"_fmt, stage, hist.sum_ns.load(std::memory_order_relaxed));
+		zpr::sprint(out, "xkeyslug_latency_ns_count{{stage=\"{}\"}} {}\n"_fmt, stage, hist.count.load(std::memory_order_relaxed));
+	}
+
+	void formatStats(zpr::arena_buffer& out)
+	{
+		zpr::sprint(out, "xkeyslug_events_total {}\n"_fmt, g_stats.events.load(std::memory_order_relaxed));
+		zpr::sprint(out, "xkeyslug_remaps_total {}\n"_fmt, g_stats.remaps.load(std::memory_order_relaxed));
+		zpr::sprint(out, "xkeyslug_combos_total {}\n"_fmt, g_stats.combos.load(std::memory_order_relaxed));
+		zpr::sprint(out, "xkeyslug_syn_dropped_total {}\n"_fmt, g_stats.syn_dropped.load(std::memory_order_relaxed));
+		zpr::sprint(out, "xkeyslug_log_dropped_total {}\n"_fmt, getLogDropped());
+
+		format_histogram(out, "kernel_to_read", g_stats.kernel_to_read);
+		format_histogram(out, "read_to_write", g_stats.read_to_write);
+		format_histogram(out, "focus_query", g_stats.focus_query);
+
+		for(size_t i = 0; i < getNumRules(); i++)
+		{
+			auto& counter = getRuleCounter(i);
+			zpr::sprint(out, "xkeyslug_rule_hits_total{{id=\"{}\",rule=\"{}\"}} {}\n"_fmt, i, getRuleName(i),
+				counter.hits.load(std::memory_order_relaxed));
+			zpr::sprint(out, "xkeyslug_rule_ns_total{{id=\"{}\",rule=\"{}\"}} {}\n"_fmt, i, getRuleName(i),
+				counter.total_ns.load(std::memory_order_relaxed));
+		}
+	}
+
+	void dumpRuleStats(int fd)
+	{
+		zpr::dprint(fd, "xkeyslug: rule hits\n  {3} {-24} {12} {10}\n"_fmt, "id", "rule", "hits", "avg ns");
+
+		for(size_t i = 0; i < getNumRules(); i++)
+		{
+			auto& counter = getRuleCounter(i);
+			auto hits = counter.hits.load(std::memory_order_relaxed);
+			auto total = counter.total_ns.load(std::memory_order_relaxed);
+
+			zpr::dprintln(fd, "  {3} {-24} {12} {10}"_fmt, i, getRuleName(i), hits, hits == 0 ? 0 : total / hits);
+		}
+	}
+
+	static UnixListener g_listener;
+
+	static void send_all(int fd, struct iovec* iov, size_t count)
+	{
+		while(count > 0)
+		{
+			msghdr msg {};
+			msg.msg_iov = iov;
+			msg.msg_iovlen = count;
+
+			auto n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+			if(n < 0 && errno == EINTR)
+				continue;
+			else if(n <= 0)
+				return;
+
+			auto done = static_cast<size_t>(n);
+			while(count > 0 && done >= iov->iov_len)
+			{
+				done -= iov->iov_len;
+				iov++;
+				count--;
+			}
+
+			if(count > 0)
+			{
+				iov->iov_base = static_cast<char*>(iov->iov_base) + done;
+				iov->iov_len -= done;
+			}
+		}
+	}
+
+	// one snapshot per connection, then close it; `socat - UNIX-CONNECT:<path>` is enough to read it.
+	static bool serve(int client)
+	{
+		// reused for every connection; after the first few, a snapshot no longer allocates.
+		static auto text = zpr::arena_buffer();
+
+		text.reset();
+		formatStats(text);
+
+		struct iovec iov[16];
+		auto count = text.iovecs(iov, std::size(iov));
+		if(count > std::size(iov))
+		{
+			auto all = text.view();
+			iov[0] = { .iov_base = const_cast<char*>(all.data()), .iov_len = all.size() };
+			count = 1;
+		}
+
+		send_all(client, iov, count);
+
+		close(client);
+		return true;
+	}
+
+	bool startStatsServer(const char* path)
+	{
+		if(not g_listener.start(path, "stats socket", 4, &serve))
+			return false;
+
+		g_stats.enabled = true;
+
+		zpr::println("xkeyslug: serving stats on '{}'", path);
+		fflush(stdout);
+
+		return true;
+	}
+
+	void stopStatsServer()
+	{
+		g_listener.stop();
+		g_stats.enabled = false;
+	}
+}
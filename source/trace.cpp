@@ -0,0 +1,275 @@
+// trace.cpp
+// Copyright (c) 2022, zhiayang
+// SPDX-License-Identifier: Apache-2.0
+
+#include "trace.h"
+#include "stats.h"
+
+#include <sys/prctl.h>
+
+#include <thread>
+#include <chrono>
+#include <algorithm>
+
+namespace slug
+{
+	// a string to be printed inside a JSON string literal.
+	struct JsonEscaped
+	{
+		const char* str;
+	};
+}
+
+template <>
+struct zpr::print_formatter<slug::JsonEscaped>
+{
+	template <typename _Cb>
+	void print(slug::JsonEscaped s, _Cb&& cb, format_args args)
+	{
+		constexpr char hex[] = "0123456789abcdef";
+		for(auto p = s.str; *p != '\0'; p++)
+		{
+			auto c = static_cast<unsigned char>(*p);
+			if(c == '"' || c == '\\')
+			{
+				cb('\\');
+				cb(*p);
+			}
+			else if(c < 0x20)
+			{
+				char esc[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf] };
+				cb(esc, 6);
+			}
+			else
+			{
+				cb(*p);
+			}
+		}
+	}
+};
+
+namespace slug
+{
+	std::atomic<bool> g_tracing = false;
+
+	struct TraceRecord
+	{
+		const char* name;
+		uint64_t ts_ns;
+		char phase;
+	};
+
+	// single producer (the owning thread), single consumer (the flusher).
+	struct TraceBuffer
+	{
+		static constexpr size_t CAPACITY = 16384;
+
+		pid_t tid = 0;
+		char thread_name[16] {};
+
+		std::atomic<size_t> head = 0;      // written by the producer
+		std::atomic<size_t> tail = 0;      // written by the consumer
+		std::atomic<uint64_t> dropped = 0;
+
+		// producer only: slots kept for the 'E's of accepted 'B's, and how deep we are inside a
+		// span whose 'B' was dropped (everything in there is dropped too, so spans stay balanced).
+		size_t reserved = 0;
+		size_t skip_depth = 0;
+
+		TraceRecord records[CAPACITY] {};
+	};
+
+	// the buffers are all allocated up front, so that a thread's first span doesn't allocate; each
+	// thread that traces takes the next one. for now, only the event loop's thread traces.
+	static constexpr size_t MAX_THREADS = 2;
+
+	static TraceBuffer* g_buffers[MAX_THREADS] {};
+	static std::atomic<size_t> g_numBuffers = 0;
+	static std::atomic<uint64_t> g_noBuffer = 0;
+
+	// bumped by every startTracing, so threads don't hold on to a buffer from an earlier session.
+	static std::atomic<uint32_t> g_session = 0;
+
+	static FILE* g_traceFile = nullptr;
+	static bool g_firstRecord = true;
+	static std::atomic<bool> g_stopFlusher = false;
+	static std::thread g_flusherThread;
+
+	static thread_local TraceBuffer* t_buffer = nullptr;
+	static thread_local uint32_t t_session = 0;
+
+	static TraceBuffer* get_buffer()
+	{
+		if(t_session == g_session.load(std::memory_order_relaxed))
+			return t_buffer;
+
+		t_session = g_session.load(std::memory_order_relaxed);
+		t_buffer = nullptr;
+
+		auto idx = g_numBuffers.load(std::memory_order_relaxed);
+		while(idx < MAX_THREADS && not g_numBuffers.compare_exchange_weak(idx, idx + 1, std::memory_order_acq_rel))
+			;
+
+		if(idx < MAX_THREADS && g_buffers[idx] != nullptr)
+		{
+			t_buffer = g_buffers[idx];
+			t_buffer->tid = gettid();
+			prctl(PR_GET_NAME, t_buffer->thread_name);
+		}
+
+		return t_buffer;
+	}
+
+	void traceEvent(const char* name, char phase)
+	{
+		// eg. the end of a TraceSpan that started before stopTracing().
+		if(not g_tracing.load(std::memory_order_relaxed))
+			return;
+
+		auto buf = get_buffer();
+		if(buf == nullptr)
+		{
+			g_noBuffer.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		auto head = buf->head.load(std::memory_order_relaxed);
+		if(phase == 'B')
+		{
+			// room for this and its 'E', on top of the 'E's already promised.
+			auto used = head - buf->tail.load(std::memory_order_acquire);
+			if(buf->skip_depth > 0 || used + buf->reserved + 2 > TraceBuffer::CAPACITY)
+			{
+				buf->skip_depth++;
+				buf->dropped.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+
+			buf->reserved++;
+		}
+		else if(buf->skip_depth > 0)
+		{
+			buf->skip_depth--;
+			buf->dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		else
+		{
+			buf->reserved--;
+		}
+
+		auto& rec = buf->records[head % TraceBuffer::CAPACITY];
+		rec.name = name;
+		rec.ts_ns = monotonicNs();
+		rec.phase = phase;
+
+		buf->head.store(head + 1, std::memory_order_release);
+	}
+
+	static void write_record(pid_t pid, pid_t tid, const TraceRecord& rec)
+	{
+		zpr::fprint(g_traceFile, "{}{{\"name\":\"{}\",\"ph\":\"{}\",\"ts\":{}.{03},\"pid\":{},\"tid\":{}}"_fmt,
+			g_firstRecord ? "\n" : ",\n", JsonEscaped { rec.name }, rec.phase, rec.ts_ns / 1000, rec.ts_ns % 1000, pid, tid);
+
+		g_firstRecord = false;
+	}
+
+	static void drain_buffers()
+	{
+		auto pid = getpid();
+		auto count = std::min(g_numBuffers.load(std::memory_order_acquire), MAX_THREADS);
+
+		for(size_t i = 0; i < count; i++)
+		{
+			auto buf = g_buffers[i];
+			auto tail = buf->tail.load(std::memory_order_relaxed);
+			auto head = buf->head.load(std::memory_order_acquire);
+
+			if(tail == 0 && head > 0)
+			{
+				zpr::fprint(g_traceFile, "{}{{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":{},\"tid\":{},\"args\":{{\"name\":\"{}\"}}",
+					g_firstRecord ? "\n" : ",\n", pid, buf->tid, JsonEscaped { buf->thread_name });
+
+				g_firstRecord = false;
+			}
+
+			for(; tail != head; tail++)
+				write_record(pid, buf->tid, buf->records[tail % TraceBuffer::CAPACITY]);
+
+			buf->tail.store(tail, std::memory_order_release);
+		}
+
+		fflush(g_traceFile);
+	}
+
+	static void flusher()
+	{
+		using namespace std::chrono_literals;
+		while(not g_stopFlusher.load(std::memory_order_relaxed))
+		{
+			std::this_thread::sleep_for(100ms);
+			drain_buffers();
+		}
+	}
+
+	bool startTracing(const char* path)
+	{
+		g_traceFile = fopen(path, "w");
+		if(g_traceFile == nullptr)
+		{
+			zpr::fprintln(stderr, "xkeyslug: failed to open trace file '{}': {} ({})", path, strerror(errno), errno);
+			return false;
+		}
+
+		fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", g_traceFile);
+		g_firstRecord = true;
+
+		for(auto& buf : g_buffers)
+			buf = new TraceBuffer();
+
+		g_numBuffers = 0;
+		g_noBuffer = 0;
+		g_session++;
+
+		g_stopFlusher = false;
+		g_flusherThread = std::thread(&flusher);
+		g_tracing = true;
+
+		zpr::println("xkeyslug: writing trace to '{}'", path);
+		fflush(stdout);
+
+		return true;
+	}
+
+	void stopTracing()
+	{
+		if(g_traceFile == nullptr)
+			return;
+
+		g_tracing = false;
+		g_stopFlusher = true;
+		g_flusherThread.join();
+
+		// anything recorded between the last flush and now.
+		drain_buffers();
+
+		// nothing traces any more by now (the loop has returned), so the buffers can go.
+		uint64_t dropped = g_noBuffer.load(std::memory_order_relaxed);
+		for(auto& buf : g_buffers)
+		{
+			dropped += buf->dropped.load(std::memory_order_relaxed);
+			delete buf;
+			buf = nullptr;
+		}
+
+		g_numBuffers = 0;
+		g_session++;
+
+		zpr::fprintln(g_traceFile, "\n]}");
+		fclose(g_traceFile);
+		g_traceFile = nullptr;
+
+		if(dropped > 0)
+			zpr::fprintln(stderr, "xkeyslug: trace buffers were full, dropped {} records", dropped);
+	}
+}
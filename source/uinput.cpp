@@ -3,16 +3,26 @@
 // SPDX-License-Identifier: Apache-2.0
 
 #include "slug.h"
+#include "log.h"
+#include "trace.h"
+#include "probes.h"
+#include "recorder.h"
 
-#include <filesystem>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <limits.h>
+#include <sys/ioctl.h>
+#include <sys/sysmacros.h>
+#include <linux/uinput.h>
 
 #include <libevdev/libevdev.h>
 #include <libevdev/libevdev-uinput.h>
 
 namespace slug
 {
-	namespace stdfs = std::filesystem;
-	UInputDevice::UInputDevice(struct libevdev* based_on)
+	UInputSink::UInputSink(struct libevdev* based_on)
 	{
 		auto err = libevdev_uinput_create_from_device(/* based? based on what? */ based_on,
 			LIBEVDEV_UINPUT_OPEN_MANAGED, &m_uinput);
@@ -22,54 +32,435 @@ namespace slug
 			zpr::fprintln(stderr, "failed to create uinput: {}", err);
 			exit(1);
 		}
+	}
+
+	UInputSink::UInputSink(int uinput_fd) : m_fd(uinput_fd)
+	{
+	}
 
-		m_fn_control_fd = -1;
+	UInputSink::~UInputSink()
+	{
+		if(m_released)
+			return;
 
-		auto path = stdfs::path("/sys/class/input/");
-		for(auto dir : stdfs::directory_iterator(path))
+		if(m_uinput != nullptr)
 		{
-			auto foo = path / dir.path() / "device/fnmode";
-			if(stdfs::exists(foo))
-			{
-				zpr::println("xkeyslug: using '{}' to control fn key", foo.native());
-				fflush(stdout);
+			libevdev_uinput_destroy(m_uinput);
+		}
+		else
+		{
+			ioctl(m_fd, UI_DEV_DESTROY);
+			close(m_fd);
+		}
+	}
+
+	int UInputSink::fd() const
+	{
+		return m_uinput != nullptr ? libevdev_uinput_get_fd(m_uinput) : m_fd;
+	}
+
+	void UInputSink::release()
+	{
+		m_released = true;
+	}
+
+	void UInputSink::write(const struct input_event* events, size_t count)
+	{
+		// the kernel fills in the timestamps, and takes any number of events in one write.
+		::write(this->fd(), events, count * sizeof(input_event));
+	}
+
+	// like mkdir -p; XDG_STATE_HOME (or ~/.local/state) doesn't have to exist yet.
+	static bool make_dirs(const std::string& dir)
+	{
+		for(size_t i = 1; i <= dir.size(); i++)
+		{
+			if(i < dir.size() && dir[i] != '/')
+				continue;
+
+			if(mkdir(dir.substr(0, i).c_str(), 0700) != 0 && errno != EEXIST)
+				return false;
+		}
+
+		return true;
+	}
+
+	// remembers where the fnmode file was for each keyboard, one "<keyboard> <owner> <path>" per line.
+	// the keyboard is its bus:vendor:product, which survives replugging and reboots (unlike the event
+	// node), and the owner is the HID_ID of the device the file belongs to, which is checked again
+	// before the path is trusted. a keyboard without one is recorded as "<keyboard> <boot id> -".
+	static std::string fnmode_cache_path()
+	{
+		std::string dir;
+		if(auto state = getenv("XDG_STATE_HOME"); state != nullptr && state[0] != '\0')
+			dir = state;
+		else if(auto home = getenv("HOME"); home != nullptr && home[0] != '\0')
+			dir = zpr::sprint("{}/.local/state", home);
+		else
+			return {};
+
+		if(not make_dirs(dir))
+			return {};
+
+		return dir + "/xkeyslug-fnmode";
+	}
+
+	static std::string keyboard_identity(int evdev_fd)
+	{
+		struct input_id id {};
+		if(ioctl(evdev_fd, EVIOCGID, &id) != 0)
+			return {};
+
+		return zpr::sprint("{04x}:{04x}:{04x}", id.bustype, id.vendor, id.product);
+	}
+
+	// the HID_ID from the uevent of the device that `path` (a sysfs attribute) belongs to.
+	static std::string owner_of(const std::string& path)
+	{
+		auto f = fopen((path.substr(0, path.rfind('/')) + "/uevent").c_str(), "r");
+		if(f == nullptr)
+			return {};
+
+		std::string ret;
+		char line[256] {};
+		while(fgets(line, sizeof(line), f))
+		{
+			auto text = std::string_view(line);
+			if(not text.starts_with("HID_ID="))
+				continue;
 
-				m_fn_control_fd = open(foo.c_str(), O_RDWR);
-				if(m_fn_control_fd == -1)
-					zpr::fprintln(stderr, "failed to open '{}': {} ({})", foo.c_str(), strerror(errno), errno);
+			text.remove_prefix(7);
+			if(text.ends_with('\n'))
+				text.remove_suffix(1);
+
+			ret = std::string(text);
+			break;
+		}
+
+		fclose(f);
+		return ret;
+	}
+
+	struct CachedFnMode
+	{
+		std::string keyboard;
+		std::string owner;
+		std::string path;
+	};
+
+	static std::vector<CachedFnMode> read_fnmode_cache(const std::string& cache)
+	{
+		std::vector<CachedFnMode> ret;
+
+		auto f = cache.empty() ? nullptr : fopen(cache.c_str(), "r");
+		if(f == nullptr)
+			return ret;
+
+		char line[PATH_MAX + 64] {};
+		while(fgets(line, sizeof(line), f))
+		{
+			auto text = std::string_view(line);
+			if(text.ends_with('\n'))
+				text.remove_suffix(1);
+
+			auto first = text.find(' ');
+			auto second = (first == std::string_view::npos) ? first : text.find(' ', first + 1);
+			if(second == std::string_view::npos)
+				continue;
+
+			ret.push_back({
+				.keyboard = std::string(text.substr(0, first)),
+				.owner = std::string(text.substr(first + 1, second - first - 1)),
+				.path = std::string(text.substr(second + 1)),
+			});
+		}
+
+		fclose(f);
+		return ret;
+	}
+
+	static void write_fnmode_cache(const std::string& cache, const CachedFnMode& entry)
+	{
+		if(cache.empty())
+			return;
+
+		auto entries = read_fnmode_cache(cache);
+		std::erase_if(entries, [&entry](auto& e) { return e.keyboard == entry.keyboard; });
+		entries.push_back(entry);
+
+		// write a new file and rename it over the old one, so a crash (or another instance writing at
+		// the same time) can never leave a truncated cache behind.
+		auto temp = zpr::sprint("{}.{}.tmp", cache, getpid());
+		auto f = fopen(temp.c_str(), "w");
+		if(f == nullptr)
+			return;
+
+		for(auto& e : entries)
+			zpr::fprintln(f, "{} {} {}", e.keyboard, e.owner, e.path);
+
+		if(fclose(f) != 0 || rename(temp.c_str(), cache.c_str()) != 0)
+			unlink(temp.c_str());
+	}
+
+	// negative entries are only good for the boot they were made in, since a driver that wasn't
+	// loaded then might be now.
+	static std::string boot_id()
+	{
+		auto f = fopen("/proc/sys/kernel/random/boot_id", "r");
+		if(f == nullptr)
+			return {};
+
+		char line[64] {};
+		auto ok = fgets(line, sizeof(line), f) != nullptr;
+		fclose(f);
+
+		auto text = std::string_view(ok ? line : "");
+		if(text.ends_with('\n'))
+			text.remove_suffix(1);
+
+		return std::string(text);
+	}
+
+	// the fnmode attribute belongs to whichever driver provides it, which is usually the keyboard's
+	// hid device a few levels above its event node; so look there first, going up from eventN. this
+	// is cheap and can't find the wrong device, so it doesn't need the cache.
+	static std::string find_fnmode_above(dev_t rdev)
+	{
+		char buf[PATH_MAX] {};
+		if(realpath(zpr::sprint("/sys/dev/char/{}:{}", major(rdev), minor(rdev)).c_str(), buf) == nullptr)
+			return {};
+
+		for(auto dir = std::string(buf); dir.starts_with("/sys/devices/"); dir.resize(dir.rfind('/')))
+		{
+			auto path = dir + "/fnmode";
+			if(access(path.c_str(), F_OK) == 0)
+				return path;
+		}
+
+		return {};
+	}
+
+	// otherwise (eg. the touchbar driver sits on another interface), try every input device.
+	static std::string find_fnmode_anywhere()
+	{
+		auto dir = opendir("/sys/class/input");
+		if(dir == nullptr)
+			return {};
+
+		std::string ret;
+		while(auto ent = readdir(dir))
+		{
+			if(ent->d_name[0] == '.')
+				continue;
 
+			auto path = zpr::sprint("/sys/class/input/{}/device/fnmode", ent->d_name);
+			if(access(path.c_str(), F_OK) == 0)
+			{
+				ret = path;
 				break;
 			}
 		}
+
+		closedir(dir);
+		return ret;
+	}
+
+	static std::string find_fnmode(int evdev_fd, dev_t rdev)
+	{
+		if(auto path = find_fnmode_above(rdev); not path.empty())
+			return path;
+
+		auto keyboard = keyboard_identity(evdev_fd);
+		auto cache = fnmode_cache_path();
+
+		// only if the file is still there and still belongs to the same device; a "-" means the last
+		// search (this boot) found nothing.
+		auto boot = boot_id();
+		for(auto& entry : read_fnmode_cache(cache))
+		{
+			if(entry.keyboard != keyboard)
+				continue;
+
+			if(entry.path == "-" && not boot.empty() && entry.owner == boot)
+				return {};
+
+			if(access(entry.path.c_str(), F_OK) == 0 && owner_of(entry.path) == entry.owner)
+				return entry.path;
+		}
+
+		auto path = find_fnmode_anywhere();
+		if(keyboard.empty())
+			return path;
+
+		if(path.empty())
+		{
+			if(not boot.empty())
+				write_fnmode_cache(cache, { .keyboard = keyboard, .owner = boot, .path = "-" });
+		}
+		else if(auto owner = owner_of(path); not owner.empty())
+		{
+			write_fnmode_cache(cache, { .keyboard = keyboard, .owner = owner, .path = path });
+		}
+
+		return path;
+	}
+
+	int openFnModeControl(int evdev_fd)
+	{
+		struct stat st {};
+		if(fstat(evdev_fd, &st) != 0)
+			return -1;
+
+		auto path = find_fnmode(evdev_fd, st.st_rdev);
+		if(path.empty())
+			return -1;
+
+		zpr::println("xkeyslug: using '{}' to control fn key", path);
+		fflush(stdout);
+
+		auto fd = open(path.c_str(), O_RDWR | O_CLOEXEC);
+		if(fd == -1)
+			zpr::fprintln(stderr, "failed to open '{}': {} ({})", path, strerror(errno), errno);
+
+		return fd;
+	}
+
+	// or'd into the mode: write it if it hasn't been yet, and then stop.
+	static constexpr int FNMODE_STOP = 0x100;
+
+	// the key thread only stores the mode it wants in m_fn_wanted and carries on, so keys keep flowing
+	// while a write is in progress. each time around, this writes whatever was wanted last and drops
+	// anything in between: if fn goes down and up again during a write, only the final mode is
+	// written. keys pressed in the meantime see whichever mode the driver has at that point.
+	static void fnmode_writer(int fd, std::atomic<int>* wanted)
+	{
+		int written = 0;
+		while(true)
+		{
+			auto value = wanted->load(std::memory_order_acquire);
+			auto mode = (value & ~FNMODE_STOP);
+
+			if(mode == written)
+			{
+				if(value & FNMODE_STOP)
+					return;
+
+				wanted->wait(value, std::memory_order_acquire);
+				continue;
+			}
+
+			// fnmode is an attribute, so the offset doesn't matter; pwrite just keeps it from growing.
+			char c = static_cast<char>('0' + mode);
+			if(pwrite(fd, &c, 1, 0) != 1)
+				logErrorln("xkeyslug: failed to write fnmode: {} ({})"_fmt, strerror(errno), errno);
+
+			written = mode;
+		}
+	}
+
+	UInputDevice::UInputDevice(EventSink* sink, int fn_control_fd) : m_fn_control_fd(fn_control_fd), m_sink(sink)
+	{
+		if(m_fn_control_fd != -1)
+			m_fn_thread = std::thread(&fnmode_writer, m_fn_control_fd, &m_fn_wanted);
 	}
 
 	UInputDevice::~UInputDevice()
 	{
-		libevdev_uinput_destroy(m_uinput);
+		delete[] m_batch;
 		if(m_fn_control_fd != -1)
+		{
+			// nothing holds fn once we're gone, even if it was down when we quit.
+			auto last = (m_fn_mode == 0 ? 0 : 1);
+			m_fn_wanted.store(last | FNMODE_STOP, std::memory_order_release);
+			m_fn_wanted.notify_one();
+			m_fn_thread.join();
+
 			close(m_fn_control_fd);
+		}
 	}
 
 	void UInputDevice::changeFnKeyState(KeyAction action)
 	{
 		if(m_fn_control_fd == -1)
 		{
-			zpr::fprintln(stderr, "xkeyslug: couldn't find fnmode controller, ignoring fn key");
+			if(not std::exchange(m_fn_warned, true))
+				logErrorln("xkeyslug: couldn't find fnmode controller, ignoring fn key"_fmt);
+
 			return;
 		}
 
 		if(action == KeyAction::Repeat)
 			return;
 
-		zpr::println("xkeyslug: simulating fn key: {}", action == KeyAction::Release ? "release" : "press");
-		fflush(stdout);
+		// 2 makes the top row send F1..F12, 1 makes it send the media keys.
+		auto mode = (action == KeyAction::Press ? 2 : 1);
+		if(mode == m_fn_mode)
+			return;
+
+		m_fn_mode = mode;
+		logPrintln("xkeyslug: simulating fn key: {}"_fmt, action == KeyAction::Release ? "release" : "press");
+
+		m_fn_wanted.store(mode, std::memory_order_release);
+		m_fn_wanted.notify_one();
+	}
+
+	void UInputDevice::setSink(EventSink* sink, bool batch)
+	{
+		this->flush();
+
+		m_sink = sink;
+		m_batching = batch;
+		if(m_batching && m_batch == nullptr)
+			m_batch = new input_event[MAX_BATCH];
+	}
+
+	EventSink* UInputDevice::getSink() const
+	{
+		return m_sink;
+	}
+
+	void UInputDevice::flush()
+	{
+		if(m_batch_len > 0)
+		{
+			SLUG_PROBE1(uinput_flush, m_batch_len);
+
+			auto span = TraceSpan("uinput_flush");
+			m_sink->write(m_batch, m_batch_len);
+		}
+
+		m_batch_len = 0;
+	}
+
+	void UInputDevice::write_event(unsigned int type, unsigned int code, int value)
+	{
+		SLUG_PROBE3(uinput_write, type, code, value);
+		if(g_flightRecorder != nullptr)
+			g_flightRecorder->output(type, code, value);
+
+		auto event = input_event {
+			.time = {},
+			.type = static_cast<uint16_t>(type),
+			.code = static_cast<uint16_t>(code),
+			.value = value
+		};
+
+		if(not m_batching)
+		{
+			auto span = TraceSpan("uinput_write");
+			m_sink->write(&event, 1);
+			return;
+		}
 
-		write(m_fn_control_fd, action == KeyAction::Press ? "2" : "1", 1);
+		if(m_batch_len == MAX_BATCH)
+			this->flush();
+
+		m_batch[m_batch_len++] = event;
 	}
 
 	bool UInputDevice::send(unsigned int type, unsigned int code, int value, bool should_sync)
 	{
-		libevdev_uinput_write_event(m_uinput, type, code, value);
+		this->write_event(type, code, value);
 		if(should_sync)
 			this->sync();
 
@@ -78,8 +469,8 @@ namespace slug
 
 	bool UInputDevice::sendKeyMomentary(keycode_t keycode, bool should_sync)
 	{
-		libevdev_uinput_write_event(m_uinput, EV_KEY, keycode, static_cast<int>(KeyAction::Press));
-		libevdev_uinput_write_event(m_uinput, EV_KEY, keycode, static_cast<int>(KeyAction::Release));
+		this->write_event(EV_KEY, keycode, static_cast<int>(KeyAction::Press));
+		this->write_event(EV_KEY, keycode, static_cast<int>(KeyAction::Release));
 
 		if(should_sync)
 			this->sync();
@@ -89,7 +480,7 @@ namespace slug
 
 	bool UInputDevice::sendKey(keycode_t key, KeyAction action, bool should_sync)
 	{
-		libevdev_uinput_write_event(m_uinput, EV_KEY, key, static_cast<int>(action));
+		this->write_event(EV_KEY, key, static_cast<int>(action));
 		if(should_sync)
 			this->sync();
 
@@ -174,10 +565,26 @@ namespace slug
 		return m_real_modifiers.find(key) != m_real_modifiers.end();
 	}
 
+	const std::unordered_set<keycode_t>& UInputDevice::getModifiers() const
+	{
+		return m_modifiers;
+	}
+
+	const std::unordered_set<keycode_t>& UInputDevice::getRealModifiers() const
+	{
+		return m_real_modifiers;
+	}
+
+	void UInputDevice::restoreModifiers(std::span<const keycode_t> modifiers, std::span<const keycode_t> real_modifiers)
+	{
+		m_modifiers = { modifiers.begin(), modifiers.end() };
+		m_real_modifiers = { real_modifiers.begin(), real_modifiers.end() };
+	}
+
 
 
 	void UInputDevice::sync()
 	{
-		libevdev_uinput_write_event(m_uinput, EV_SYN, SYN_REPORT, 0);
+		this->write_event(EV_SYN, SYN_REPORT, 0);
 	}
 }
@@ -3,22 +3,138 @@
 // SPDX-License-Identifier: Apache-2.0
 
 #include "slug.h"
+#include "probes.h"
+#include "recorder.h"
 
 #include <X11/Xlib.h>
+#include <X11/Xatom.h>
 #include <X11/Xutil.h>
 
 namespace slug
 {
-	WindowInfo getCurrentWindowInfo(Display* x_display)
+	static int (*g_prevErrorHandler)(Display*, XErrorEvent*) = nullptr;
+	static int x_error_handler(Display* x_display, XErrorEvent* error)
+	{
+		// windows can disappear between XGetInputFocus and anything we do with them afterwards;
+		// the default handler would kill us for that, so just ignore it.
+		if(error->error_code == BadWindow)
+			return 0;
+
+		return g_prevErrorHandler(x_display, error);
+	}
+
+	X11Focus::X11Focus(Display* x_display) : m_display(x_display)
+	{
+		m_net_wm_name = XInternAtom(m_display, "_NET_WM_NAME", False);
+		m_utf8_string = XInternAtom(m_display, "UTF8_STRING", False);
+
+		if(g_prevErrorHandler == nullptr)
+			g_prevErrorHandler = XSetErrorHandler(&x_error_handler);
+	}
+
+	static std::string fetch_window_title(Display* x_display, Window window, Atom net_wm_name, Atom utf8_string)
+	{
+		Atom actual_type {};
+		int actual_format = 0;
+		unsigned long num_items = 0;
+		unsigned long bytes_after = 0;
+		unsigned char* data = nullptr;
+
+		auto err = XGetWindowProperty(x_display, window, net_wm_name, 0, 1024, False, utf8_string,
+			&actual_type, &actual_format, &num_items, &bytes_after, &data);
+
+		if(err == Success && data != nullptr && actual_type == utf8_string && actual_format == 8)
+		{
+			auto ret = std::string(reinterpret_cast<const char*>(data), num_items);
+			XFree(data);
+			return ret;
+		}
+
+		if(data != nullptr)
+			XFree(data);
+
+		// fallback to the legacy WM_NAME.
+		char* name = nullptr;
+		if(XFetchName(x_display, window, &name) != 0 && name != nullptr)
+		{
+			auto ret = std::string(name);
+			XFree(name);
+			return ret;
+		}
+
+		return {};
+	}
+
+	void X11Focus::drain_property_events()
+	{
+		// XGetInputFocus is a round-trip, so any PropertyNotify events that happened before it
+		// are already sitting in the queue; we don't need to go back to the server here.
+		while(XEventsQueued(m_display, QueuedAlready) > 0)
+		{
+			XEvent event {};
+			XNextEvent(m_display, &event);
+
+			if(event.type != PropertyNotify || event.xproperty.window != m_window)
+				continue;
+
+			if(event.xproperty.atom == m_net_wm_name || event.xproperty.atom == XA_WM_NAME)
+				m_title_dirty = true;
+		}
+	}
+
+	void X11Focus::refresh_title()
+	{
+		m_info.wm_name = fetch_window_title(m_display, m_window, m_net_wm_name, m_utf8_string);
+		m_info.title_profiles = matchWindowTitle(m_info.wm_name);
+		m_title_dirty = false;
+		m_changed = true;
+	}
+
+	const WindowInfo& X11Focus::getCurrentWindowInfo()
+	{
+		SLUG_PROBE0(focus_query_entry);
+		auto& info = this->query_focus();
+		SLUG_PROBE2(focus_query_return, info.wm_class.c_str(), info.wm_name.c_str());
+
+		if(m_changed && g_flightRecorder != nullptr)
+			g_flightRecorder->focus(info.wm_class, info.wm_name);
+
+		m_changed = false;
+
+		return info;
+	}
+
+	const WindowInfo& X11Focus::query_focus()
 	{
 		Window focused_window {};
 		int revert_to = 0;
-		XGetInputFocus(x_display, &focused_window, &revert_to);
+		XGetInputFocus(m_display, &focused_window, &revert_to);
+
+		this->drain_property_events();
+
+		if(focused_window == m_focus && m_window != None)
+		{
+			if(m_title_dirty)
+				this->refresh_title();
+
+			return m_info;
+		}
+
+		if(m_window != None)
+			XSelectInput(m_display, m_window, NoEventMask);
+
+		m_focus = focused_window;
+		m_window = None;
+		m_info = {};
+		m_changed = true;
 
 	retry:
+		if(focused_window == None || focused_window == PointerRoot)
+			return m_info;
+
 		XClassHint hints {};
-		if(XGetClassHint(x_display, focused_window, &hints) == BadWindow)
-			return {};
+		if(XGetClassHint(m_display, focused_window, &hints) == BadWindow)
+			return m_info;
 
 		auto name_str = hints.res_name == nullptr ? std::string{} : std::string(hints.res_name);
 		auto class_str = hints.res_class == nullptr ? std::string{} : std::string(hints.res_class);
@@ -34,19 +150,28 @@ namespace slug
 			Window parent_window {};
 			Window* children {};
 			unsigned int num_children = 0;
-			XQueryTree(x_display, focused_window, /* root: */ &root_window, &parent_window, &children, &num_children);
+			if(XQueryTree(m_display, focused_window, /* root: */ &root_window, &parent_window, &children, &num_children) == 0)
+				return m_info;
+
+			if(children != nullptr)
+				XFree(children);
 
 			focused_window = parent_window;
 			goto retry;
 		}
-		else
-		{
-			return { .wm_name = name_str, .wm_class = class_str };
-		}
+
+		m_window = focused_window;
+		m_info.wm_class = std::move(class_str);
+
+		// ask for PropertyNotify so we know when the title changes.
+		XSelectInput(m_display, m_window, PropertyChangeMask);
+		this->refresh_title();
+
+		return m_info;
 	}
 
-	bool matchWindowClass(Display* x_display, std::string_view window_class)
+	bool matchWindowClass(FocusProvider* focus, std::string_view window_class)
 	{
-		return getCurrentWindowInfo(x_display).wm_class == window_class;
+		return focus->getCurrentWindowInfo().wm_class == window_class;
 	}
 }
@@ -0,0 +1,193 @@
+// flightrec.cpp
+// Copyright (c) 2022, zhiayang
+// SPDX-License-Identifier: Apache-2.0
+
+// decodes a flight recording (xkeyslug --flight-recorder=<path>, see recorder.h). by default it prints
+// everything; --last=<sec> keeps only the final few seconds. --events and --focus write out the input
+// events and focus changes in the format that xkeyslug-replay takes, so a report can be reproduced.
+
+#include "recorder.h"
+#include "keynames.h"
+
+#include <vector>
+#include <optional>
+#include <algorithm>
+
+#include <linux/input.h>
+
+static void usage(const char* argv0)
+{
+	zpr::fprintln(stderr, "usage: {} <recording> [--last=<sec>] [--events=<out.bin>] [--focus=<out.txt>]", argv0);
+	exit(1);
+}
+
+static void print_record(const slug::DecodedRecord& rec, uint64_t first_ns)
+{
+	auto t = static_cast<double>(rec.real_ns - first_ns) / 1e9;
+	auto event = [&rec]() {
+		input_event ev {};
+		ev.type = static_cast<uint16_t>(rec.type);
+		ev.code = static_cast<uint16_t>(rec.code);
+		ev.value = rec.value;
+		return ev;
+	};
+
+	switch(rec.kind)
+	{
+		case slug::RecordKind::Input:
+			zpr::println("{12.6f}  in      {}", t, event());
+			break;
+
+		case slug::RecordKind::Output:
+			zpr::println("{12.6f}    out   {}", t, event());
+			break;
+
+		case slug::RecordKind::Remap:
+			zpr::println("{12.6f}  remap   {} -> {}", t, slug::KeyName { rec.code }, slug::KeyName { static_cast<slug::keycode_t>(rec.value) });
+			break;
+
+		case slug::RecordKind::Combo:
+			zpr::println("{12.6f}  combo   {}", t, slug::KeyName { rec.code });
+			break;
+
+		case slug::RecordKind::Focus:
+			zpr::println("{12.6f}  focus   '{}' '{}'", t, rec.wm_class, rec.title);
+			break;
+	}
+}
+
+static bool write_events(const char* path, const std::vector<slug::DecodedRecord>& records)
+{
+	std::vector<struct input_event> events;
+	for(auto& rec : records)
+	{
+		if(rec.kind != slug::RecordKind::Input)
+			continue;
+
+		auto ev = input_event {};
+		ev.input_event_sec = static_cast<time_t>(rec.real_ns / 1'000'000'000);
+		ev.input_event_usec = static_cast<suseconds_t>((rec.real_ns / 1000) % 1'000'000);
+		ev.type = static_cast<uint16_t>(rec.type);
+		ev.code = static_cast<uint16_t>(rec.code);
+		ev.value = rec.value;
+		events.push_back(ev);
+	}
+
+	auto fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if(fd == -1)
+	{
+		zpr::fprintln(stderr, "failed to open '{}': {} ({})", path, strerror(errno), errno);
+		return false;
+	}
+
+	auto bytes = events.size() * sizeof(struct input_event);
+	auto ok = write(fd, events.data(), bytes) == static_cast<ssize_t>(bytes);
+	close(fd);
+
+	return ok;
+}
+
+static bool write_focus(const char* path, const std::vector<slug::DecodedRecord>& records)
+{
+	auto f = fopen(path, "w");
+	if(f == nullptr)
+	{
+		zpr::fprintln(stderr, "failed to open '{}': {} ({})", path, strerror(errno), errno);
+		return false;
+	}
+
+	for(auto& rec : records)
+	{
+		if(rec.kind != slug::RecordKind::Focus)
+			continue;
+
+		// the timeline format is space-separated, and one line per entry.
+		auto wm_class = rec.wm_class.empty() ? std::string("-") : rec.wm_class;
+		std::replace(wm_class.begin(), wm_class.end(), ' ', '_');
+
+		auto title = rec.title;
+		std::replace(title.begin(), title.end(), '\n', ' ');
+
+		zpr::fprintln(f, "{}.{06} {} {}", rec.real_ns / 1'000'000'000, (rec.real_ns / 1000) % 1'000'000, wm_class, title);
+	}
+
+	fclose(f);
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	const char* input_path = nullptr;
+	const char* events_path = nullptr;
+	const char* focus_path = nullptr;
+	double last_sec = 0;
+
+	for(int i = 1; i < argc; i++)
+	{
+		auto arg = std::string_view(argv[i]);
+		if(arg.starts_with("--last="))
+			last_sec = strtod(argv[i] + 7, nullptr);
+		else if(arg.starts_with("--events="))
+			events_path = argv[i] + 9;
+		else if(arg.starts_with("--focus="))
+			focus_path = argv[i] + 8;
+		else if(not arg.starts_with("-") && input_path == nullptr)
+			input_path = argv[i];
+		else
+			usage(argv[0]);
+	}
+
+	if(input_path == nullptr)
+		usage(argv[0]);
+
+	std::vector<slug::DecodedRecord> records;
+	if(not slug::decodeFlightRecording(input_path, &records))
+		return 1;
+
+	if(records.empty())
+	{
+		zpr::println("(empty recording)");
+		return 0;
+	}
+
+	if(last_sec > 0)
+	{
+		auto cutoff = records.back().real_ns - std::min(records.back().real_ns, static_cast<uint64_t>(last_sec * 1e9));
+
+		// whatever was focused at the cutoff still matters, even if the change was before it.
+		std::optional<slug::DecodedRecord> focus;
+		for(auto& rec : records)
+		{
+			if(rec.real_ns >= cutoff)
+				break;
+			else if(rec.kind == slug::RecordKind::Focus)
+				focus = rec;
+		}
+
+		std::erase_if(records, [&](auto& rec) { return rec.real_ns < cutoff; });
+		if(focus.has_value())
+		{
+			focus->real_ns = cutoff;
+			records.insert(records.begin(), *focus);
+		}
+	}
+
+	if(events_path == nullptr && focus_path == nullptr)
+	{
+		auto first = records.front().real_ns;
+		zpr::println("{} records, starting at {} (unix time, ns)", records.size(), first);
+
+		for(auto& rec : records)
+			print_record(rec, first);
+
+		return 0;
+	}
+
+	if(events_path != nullptr && not write_events(events_path, records))
+		return 1;
+
+	if(focus_path != nullptr && not write_focus(focus_path, records))
+		return 1;
+
+	return 0;
+}
@@ -0,0 +1,206 @@
+// hidbpf-harness.cpp
+// Copyright (c) 2022, zhiayang
+// SPDX-License-Identifier: Apache-2.0
+
+// exercises the HID-BPF offload (source/hidbpf.cpp) without real hardware: creates a boot-protocol
+// keyboard through /dev/uhid, attaches the program to it, then sends reports and checks that the
+// evdev node produces the remapped keys. needs root (or access to /dev/uhid and bpf).
+
+#include "slug.h"
+
+#include <poll.h>
+#include <dirent.h>
+
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+
+#include <linux/uhid.h>
+#include <linux/input.h>
+
+static constexpr const char* DEVICE_NAME = "xkeyslug hid-bpf harness";
+
+// standard boot keyboard: modifier byte, reserved byte, 6 key array; no report id.
+static constexpr uint8_t REPORT_DESCRIPTOR[] = {
+	0x05, 0x01, 0x09, 0x06, 0xA1, 0x01, 0x05, 0x07, 0x19, 0xE0, 0x29, 0xE7, 0x15, 0x00, 0x25, 0x01,
+	0x75, 0x01, 0x95, 0x08, 0x81, 0x02, 0x95, 0x01, 0x75, 0x08, 0x81, 0x01, 0x95, 0x05, 0x75, 0x01,
+	0x05, 0x08, 0x19, 0x01, 0x29, 0x05, 0x91, 0x02, 0x95, 0x01, 0x75, 0x03, 0x91, 0x01, 0x95, 0x06,
+	0x75, 0x08, 0x15, 0x00, 0x25, 0x65, 0x05, 0x07, 0x19, 0x00, 0x29, 0x65, 0x81, 0x00, 0xC0,
+};
+
+struct KeyEvent
+{
+	unsigned int code;
+	int value;
+
+	bool operator== (const KeyEvent&) const = default;
+	auto operator<=> (const KeyEvent&) const = default;
+};
+
+static bool send_report(int uhid_fd, std::initializer_list<slug::keycode_t> keys)
+{
+	uhid_event ev {};
+	ev.type = UHID_INPUT2;
+	ev.u.input2.size = 8;
+
+	size_t i = 2;
+	for(auto k : keys)
+		ev.u.input2.data[i++] = slug::hidUsageForKeycode(k);
+
+	return write(uhid_fd, &ev, sizeof(ev)) == sizeof(ev);
+}
+
+static std::vector<KeyEvent> read_keys(int evdev_fd)
+{
+	std::vector<KeyEvent> ret;
+
+	// if the report didn't change anything, there won't be a SYN at all, so time out.
+	pollfd pfd { .fd = evdev_fd, .events = POLLIN, .revents = 0 };
+	while(poll(&pfd, 1, 200) > 0)
+	{
+		input_event ev {};
+		if(read(evdev_fd, &ev, sizeof(ev)) != sizeof(ev))
+			break;
+
+		if(ev.type == EV_KEY)
+			ret.push_back({ ev.code, ev.value });
+		else if(ev.type == EV_SYN)
+			break;
+	}
+
+	std::sort(ret.begin(), ret.end());
+	return ret;
+}
+
+static std::string find_evdev_node()
+{
+	for(int tries = 0; tries < 100; tries++)
+	{
+		if(auto dir = opendir("/sys/class/input"); dir != nullptr)
+		{
+			while(auto ent = readdir(dir))
+			{
+				if(strncmp(ent->d_name, "event", 5) != 0)
+					continue;
+
+				char name[256] {};
+				auto path = zpr::sprint("/sys/class/input/{}/device/name", ent->d_name);
+				if(auto fd = open(path.c_str(), O_RDONLY); fd != -1)
+				{
+					auto n = read(fd, name, sizeof(name) - 1);
+					close(fd);
+
+					if(n > 0 && std::string_view(name, static_cast<size_t>(n)).starts_with(DEVICE_NAME))
+					{
+						closedir(dir);
+						return zpr::sprint("/dev/input/{}", ent->d_name);
+					}
+				}
+			}
+
+			closedir(dir);
+		}
+
+		using namespace std::chrono_literals;
+		std::this_thread::sleep_for(20ms);
+	}
+
+	return {};
+}
+
+static int g_failures = 0;
+static void check(const char* what, std::vector<KeyEvent> got, std::vector<KeyEvent> expected)
+{
+	std::sort(expected.begin(), expected.end());
+	if(got == expected)
+		return;
+
+	g_failures++;
+	zpr::println("FAIL: {}", what);
+	for(auto& e : expected) zpr::println("    expected: {} {}", e.code, e.value);
+	for(auto& g : got)      zpr::println("    got:      {} {}", g.code, g.value);
+}
+
+int main(int argc, char** argv)
+{
+	auto uhid_fd = open("/dev/uhid", O_RDWR | O_CLOEXEC);
+	if(uhid_fd == -1)
+	{
+		zpr::fprintln(stderr, "failed to open /dev/uhid: {} ({})", strerror(errno), errno);
+		return 1;
+	}
+
+	uhid_event create {};
+	create.type = UHID_CREATE2;
+	strncpy(reinterpret_cast<char*>(create.u.create2.name), DEVICE_NAME, sizeof(create.u.create2.name) - 1);
+	create.u.create2.rd_size = sizeof(REPORT_DESCRIPTOR);
+	create.u.create2.bus = BUS_USB;
+	create.u.create2.vendor = 0x1209;
+	create.u.create2.product = 0x0001;
+	memcpy(create.u.create2.rd_data, REPORT_DESCRIPTOR, sizeof(REPORT_DESCRIPTOR));
+
+	if(write(uhid_fd, &create, sizeof(create)) != sizeof(create))
+	{
+		zpr::fprintln(stderr, "failed to create uhid device: {} ({})", strerror(errno), errno);
+		return 1;
+	}
+
+	auto node = find_evdev_node();
+	auto evdev_fd = node.empty() ? -1 : open(node.c_str(), O_RDONLY | O_NONBLOCK);
+	if(evdev_fd == -1)
+	{
+		zpr::fprintln(stderr, "could not find the evdev node for the uhid device");
+		return 1;
+	}
+
+	zpr::println("using {}", node);
+	if(not slug::loadHidBpf(evdev_fd))
+		return 1;
+
+	// a key that isn't remapped should come through untouched.
+	send_report(uhid_fd, { KEY_X });
+	check("passthrough press", read_keys(evdev_fd), { { KEY_X, 1 } });
+	send_report(uhid_fd, { });
+	check("passthrough release", read_keys(evdev_fd), { { KEY_X, 0 } });
+
+	for(auto& remap : slug::getStaticRemaps())
+	{
+		if(slug::hidUsageForKeycode(remap.from) == 0 || slug::hidUsageForKeycode(remap.to) == 0)
+			continue;
+
+		send_report(uhid_fd, { remap.from });
+		check("static remap press", read_keys(evdev_fd), { { remap.to, 1 } });
+		send_report(uhid_fd, { });
+		check("static remap release", read_keys(evdev_fd), { { remap.to, 0 } });
+	}
+
+	auto layer = slug::getCapslockLayer();
+	for(auto& remap : layer.remaps)
+	{
+		if(slug::hidUsageForKeycode(remap.from) == 0 || slug::hidUsageForKeycode(remap.to) == 0)
+			continue;
+
+		auto what = zpr::sprint("layer {} -> {}", remap.from, remap.to);
+
+		// the layer key itself should never show up.
+		send_report(uhid_fd, { layer.key });
+		check(what.c_str(), read_keys(evdev_fd), { });
+		send_report(uhid_fd, { layer.key, remap.from });
+		check(what.c_str(), read_keys(evdev_fd), { { remap.to, 1 } });
+		send_report(uhid_fd, { });
+		check(what.c_str(), read_keys(evdev_fd), { { remap.to, 0 } });
+	}
+
+	slug::unloadHidBpf();
+
+	uhid_event destroy {};
+	destroy.type = UHID_DESTROY;
+	write(uhid_fd, &destroy, sizeof(destroy));
+
+	close(evdev_fd);
+	close(uhid_fd);
+
+	zpr::println("{}", g_failures == 0 ? "all passed" : zpr::sprint("{} failures", g_failures));
+	return g_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,92 @@
+// replay.cpp
+// Copyright (c) 2022, zhiayang
+// SPDX-License-Identifier: Apache-2.0
+
+// runs a recording of keyboard events through the remapper and writes out what it would have sent
+// to uinput. the input is raw input_events (eg. `cat /dev/input/eventN > keys.bin`); the focus
+// timeline is optional (see TimelineFocus in replay.h), without it no window is ever focused.
+// with --text-input, the events are read as text in the same format as the text output, which is
+// what the recordings in tests/replay are.
+
+#include "replay.h"
+
+static void usage(const char* argv0)
+{
+	zpr::fprintln(stderr, "usage: {} [--text-input] <events> [--focus <timeline>] [-o <output> | --text]", argv0);
+	zpr::fprintln(stderr, "    --text-input   <events> is text, one '<sec>.<usec> <type> <code> <value>' per line,");
+	zpr::fprintln(stderr, "                   where <code> can also be a name (eg. KEY_A)");
+	zpr::fprintln(stderr, "    -o <output>    write the output as raw input_events (default: text to stdout)");
+	exit(1);
+}
+
+int main(int argc, char** argv)
+{
+	const char* input_path = nullptr;
+	const char* focus_path = nullptr;
+	const char* output_path = nullptr;
+	bool text_input = false;
+
+	for(int i = 1; i < argc; i++)
+	{
+		auto arg = std::string_view(argv[i]);
+		if(arg == "--focus" && i + 1 < argc)
+			focus_path = argv[++i];
+		else if(arg == "-o" && i + 1 < argc)
+			output_path = argv[++i];
+		else if(arg == "--text")
+			output_path = nullptr;
+		else if(arg == "--text-input")
+			text_input = true;
+		else if(not arg.starts_with("-") && input_path == nullptr)
+			input_path = argv[i];
+		else
+			usage(argv[0]);
+	}
+
+	if(input_path == nullptr)
+		usage(argv[0]);
+
+	auto focus = slug::TimelineFocus();
+	if(focus_path != nullptr && not focus.load(focus_path))
+		return 1;
+
+	std::vector<struct input_event> input;
+	if(not text_input)
+		input = slug::readEventFile(input_path);
+	else if(not slug::readEventText(input_path, &input))
+		return 1;
+
+	auto sink = slug::MemorySink();
+	slug::replayEvents(input, &focus, &sink);
+
+	if(output_path != nullptr)
+	{
+		auto fd = open(output_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if(fd == -1)
+		{
+			zpr::fprintln(stderr, "failed to open '{}': {} ({})", output_path, strerror(errno), errno);
+			return 1;
+		}
+
+		auto bytes = sink.events.size() * sizeof(struct input_event);
+		if(write(fd, sink.events.data(), bytes) != static_cast<ssize_t>(bytes))
+		{
+			zpr::fprintln(stderr, "failed to write '{}': {} ({})", output_path, strerror(errno), errno);
+			close(fd);
+			return 1;
+		}
+
+		close(fd);
+	}
+	else
+	{
+		for(auto& ev : sink.events)
+		{
+			zpr::println("{}.{06} {} {} {}", static_cast<long>(ev.input_event_sec), static_cast<long>(ev.input_event_usec),
+				ev.type, ev.code, ev.value);
+		}
+	}
+
+	zpr::fprintln(stderr, "xkeyslug-replay: {} events in, {} events out", input.size(), sink.events.size());
+	return 0;
+}